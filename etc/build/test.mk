@@ -100,6 +100,25 @@ endif
 test:
 	@$(MAKE) debug=2 teco
 
+#
+#  Define target to run performance benchmarks. Options for the benchmark
+#  script may be passed with BENCH (e.g., make bench BENCH="--size=64").
+#
+
+ifneq ($(PERL), )
+
+.PHONY: bench
+bench:
+	test/benchmarks/bench.pl $(BENCH)
+
+else
+
+.PHONY: bench
+bench:
+	@$(error Make target '$@' requires Perl)
+
+endif
+
 #
 #  Define target to smoke test scripts, files, and executable image.
 #
@@ -61,6 +61,7 @@ my $nfiles   = 0;
 my $ntests   = 0;
 my $okay     = 0;
 my %scripts;
+my %features;
 my %benchmark_files;
 my @teco_files = ();
 
@@ -198,6 +199,57 @@ if ($make)
 
 exit( $okay == $nfiles ? 0 : 1 );       # Return success (0) or failure (1)
 
+# Check to see whether the target TECO has a feature that a test script
+# requires, and which may depend on how it was built. Each feature is only
+# probed once.
+
+sub check_feature
+{
+    my ( $infile, $feature ) = @_;
+
+    if ( !exists $features{$feature} )
+    {
+        if ( $feature eq 'mapping' && $target eq 'TECO-64' )
+        {
+            # Input files are only mapped into memory by the gap buffer, and
+            # the edit buffer then uses less memory than the size of the file.
+
+            my $data  = "$testdir/cases/_teco_map.tmp";
+            my $probe = "$testdir/cases/_teco_map.tec";
+
+            write_file( $data, "hello, world!\n" x 256 );
+            write_file( $probe,
+                    qq{0,512E3 \@ER"$data" Y 1,-6EJ-Z "L }
+                  . q{@^A/mapped/ 10^T ' HK EK EX} );
+
+            my $result = qx{teco -n -d -i --mung $probe 2>&1};
+
+            $features{$feature} = ( $result =~ /mapped/ms );
+
+            unlink $data, $probe;
+        }
+        elsif ( $feature eq 'mapping' )
+        {
+            $features{$feature} = 0;
+        }
+        else
+        {
+            croak "Unknown feature $feature in script: $infile";
+        }
+    }
+
+    if ( !$features{$feature} )
+    {
+        ++$nskipped;
+
+        print "Skipping $feature file: $infile\n" if $skip;
+
+        return;
+    }
+
+    return $feature;
+}
+
 # Check to see that the test script specifies a valid TECO.
 
 sub check_teco
@@ -488,6 +540,7 @@ sub parse_script
     my $function;
     my $command;
     my $teco;
+    my $requires;
     my $redirect;
     my $expects;
     my $text;
@@ -508,6 +561,10 @@ sub parse_script
             {
                 $command = $1;
             }
+            elsif ( $line =~ /Requires:\s(.+)\s!/ms )
+            {
+                $requires = $1;
+            }
             elsif ( $line =~ /!\s+(<)?(TECO.*):\s(.+)\s!/ms )
             {
                 if ( !$teco || $target eq 'TECO C' )
@@ -547,6 +604,8 @@ sub parse_script
     croak "No TECO version found in script: $infile" unless $teco;
     croak "No expectations found in script: $infile" unless $expects;
 
+    return if $requires && !check_feature( $infile, $requires );
+
     $ntests += $local_tests;
 
     $outfile =~ s/ (.+) [.]tec /$1/msx;
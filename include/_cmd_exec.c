@@ -230,6 +230,7 @@ static const struct cmd_table e_table[] =
     ENTRY('2',         scan_flag2,       exec_E2         ),
     ENTRY('3',         scan_flag2,       exec_E3         ),
     ENTRY('4',         scan_flag2,       exec_E4         ),
+    ENTRY('?',         scan_E_quest,     exec_E_quest    ),
     ENTRY('A',         NULL,             exec_EA         ),
     ENTRY('a',         NULL,             exec_EA         ),
     ENTRY('B',         scan_ER,          exec_EB         ),
@@ -28,6 +28,108 @@
 
 #define _CBUF_H
 
+///  @enum    token_type
+///  @brief   Types of compiled tokens.
+
+enum token_type
+{
+    TOKEN_WHITE,                    ///< Run of whitespace characters
+    TOKEN_MOD,                      ///< Run of : and @ modifiers
+    TOKEN_CMD,                      ///< ^x, E, or F command
+    TOKEN_TEXT                      ///< Text string argument(s) for command
+};
+
+///  @struct  token
+///  @brief   Compiled token for a command string. This describes a run of
+///           whitespace characters, a run of modifiers, a command whose
+///           handler had to be looked up in a second table, or the text
+///           string arguments for a command, so that we don't have to scan
+///           them again each time a loop or macro is executed.
+
+struct token
+{
+    uint_t pos;                     ///< Position of token + 1 (0 if unused)
+    uint_t next;                    ///< Position following token
+    uint_t lines;                   ///< No. of LFs in token
+    enum token_type type;           ///< Type of token
+
+    union
+    {
+        struct
+        {
+            bool valid;             ///< false if modifiers must be scanned
+            bool colon;             ///< : modifier
+            bool dcolon;            ///< :: modifier
+            bool atsign;            ///< @ modifier
+        } mod;                      ///< TOKEN_MOD
+
+        struct
+        {
+            const struct cmd_table *entry; ///< Resolved command table entry
+            char c1;                ///< Command character (^x converted)
+            char c2;                ///< Second command character (or NUL)
+        } cmd;                      ///< TOKEN_CMD
+
+        struct
+        {
+            int delim;              ///< Default delimiter
+            int ntexts;             ///< No. of text strings
+            bool atsign;            ///< @ modifier seen
+            bool paired;            ///< Paired delimiters allowed (E1&2)
+            tstring text1;          ///< First text string
+            tstring text2;          ///< Second text string
+        } text;                     ///< TOKEN_TEXT
+    };
+};
+
+///  @struct  flow
+///  @brief   Flow control command in a command string: the start or end of a
+///           loop or conditional, an else clause, a tag, an O command, or any
+///           other command that can cause a branch. These are indexed so that
+///           branches don't have to rescan the command string each time they
+///           need to find a tag, or the end of a loop or conditional.
+
+struct flow
+{
+    uint_t pos;                     ///< Position following command
+    uint_t lines;                   ///< No. of LFs counted before position
+    const char *text;               ///< Tag text (! commands only)
+    uint_t len;                     ///< Length of tag text
+    int c1;                         ///< Command character
+    bool comment;                   ///< true if !! comment
+    bool dup;                       ///< true if tag is duplicated later
+    uint_t end_loop;                ///< End of loop (flow index + 1, or 0)
+    uint_t end_if;                  ///< End of conditional (index + 1, or 0)
+    uint_t end_else;                ///< Else or end of conditional (ditto)
+    int depth;                      ///< Change in depth to end of loop
+    int min_depth;                  ///< Min. depth at ' before end of loop
+};
+
+///  @struct  flows
+///  @brief   Index of flow control commands in a command string. This is
+///           built incrementally, as far as is needed to find the command we
+///           want. Since the E1 and E2 flags can affect how commands are
+///           parsed, the index is rebuilt if they change. If we find an error
+///           in the string, or anything that a serial scan might parse
+///           differently, the index stops there, and callers that need to go
+///           further have to scan the string, so that any error is reported
+///           the same way as without the index.
+
+struct flows
+{
+    int_t e1;                       ///< E1 flag when index was built
+    int_t e2;                       ///< E2 flag when index was built
+    uint_t count;                   ///< No. of commands
+    uint_t size;                    ///< Allocated no. of commands
+    struct flow *flow;              ///< Commands, in order of position
+    uint_t scanned;                 ///< Position scanned up to
+    uint_t lines;                   ///< No. of LFs counted up to there
+    bool done;                      ///< true if entire string scanned
+    bool failed;                    ///< true if scan stopped before the end
+    uint_t nslots;                  ///< No. of tag slots (a power of 2)
+    uint_t *slot;                   ///< Hash table of tags (flow index + 1)
+};
+
 // Command buffer variable
 
 extern tbuffer *cbuf;
@@ -40,6 +142,27 @@ extern void reset_cbuf(void);
 
 extern void store_cbuf(int c);
 
+// Command token functions
+
+extern void discard_tokens(const char *data);
+
+extern struct flow *find_flow(struct flows *flows, uint_t pos);
+
+extern const struct flow *find_label(struct flows *flows, const char *text,
+                                     uint_t len);
+
+extern const struct token *find_token(uint_t pos, enum token_type type);
+
+extern struct flow *get_flow(struct flows *flows, uint_t n);
+
+extern struct flows *get_flows(void);
+
+extern const struct token *get_white(uint_t pos);
+
+extern void reset_tokens(void);
+
+extern struct token *store_token(uint_t pos, enum token_type type);
+
 #if     !defined(INLINE)
 
 extern int fetch_cbuf(void);
@@ -71,6 +71,7 @@ struct watch
     union tchar tchar;              ///< 9:W - Terminal characteristics
     int maxline;                    ///< 11:W - Length of longest line in edit buffer
     int status;                     ///< 12:W - Width of status window
+    int_t painted;                  ///< 13:W - No. of chrs. painted in edit window
     int_t botdot;                   ///< Buffer position of bottom right corner
 };
 
@@ -100,6 +101,8 @@ extern void init_dpy(void);
 
 extern void init_keys(void);
 
+extern void mark_dpy(int_t start, int_t end, int_t nbytes, int nlines);
+
 extern void putc_cmd(int c);
 
 extern void refresh_dpy(void);
@@ -168,6 +171,8 @@ extern char keysize[UCHAR_MAX + 1];
 
 extern void check_colors(void);
 
+extern int_t count_chrs(int_t pos, int maxcol);
+
 extern int_t find_column(void);
 
 extern void refresh_status(void);
@@ -60,6 +60,17 @@ extern bool append_edit(struct ifile *ifile, bool single);
 
 extern void change_dot(int c);
 
+// Change text between two absolute positions in place, by calling a function
+// for each contiguous piece of the text. The function may change the text,
+// but may not add or remove any line delimiters.
+
+extern void change_edit(int_t start, int_t end, void (*change)(uchar *text,
+                                                                 uint_t nbytes));
+
+// Check that edit buffer hasn't been changed by another process.
+
+extern void check_edit(void);
+
 //  Delete nbytes at dot. Argument can be positive or negative.
 
 extern void delete_edit(int_t nbytes);
@@ -105,4 +116,14 @@ extern void set_dot(int_t pos);
 
 extern uint_t size_edit(uint_t size);
 
+// Get contiguous text starting at absolute position. Since the text may be
+// stored in more than one piece, the caller should be prepared to call this
+// more than once to get all of the text it wants.
+//
+// Returns: pointer to text, with the no. of contiguous bytes stored in the
+//          location specified by the second argument (0 if the position is
+//          not within the buffer).
+
+extern const uchar *span_edit(int_t pos, int_t *nbytes);
+
 #endif  // !defined(_EDITBUF_H)
@@ -144,6 +144,7 @@ union e3_flag
         uint utf8    : 1;       ///< Allow UTF-8 characters
         uint keepNUL : 1;       ///< Keep NUL chrs. in input files
         uint CR_type : 1;       ///< Convert LF to CR/LF on type out
+        uint mmap    : 1;       ///< Map input files into memory
     };
 };
 
@@ -282,6 +283,7 @@ struct flags
     int_t          eu;          ///< Upper/lower case flag
     int_t          ev;          ///< Edit verify flag
     int_t       radix;          ///< Current input radix
+    bool        profile;        ///< Command profile flag
     bool        trace;          ///< Command trace flag
 };
 
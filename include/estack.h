@@ -70,6 +70,8 @@ extern bool check_parens(void);
 
 extern void delete_x(void);
 
+extern bool empty_x(void);
+
 extern void exec_oper(enum x_oper oper);
 
 extern void exit_x(void);
@@ -93,6 +93,8 @@ extern bool scan_EQ(struct cmd *cmd);
 
 extern bool scan_ER(struct cmd *cmd);
 
+extern bool scan_E_quest(struct cmd *cmd);
+
 extern bool scan_E_under(struct cmd *cmd);
 
 extern bool scan_F0(struct cmd *cmd);
@@ -312,6 +314,8 @@ extern void exec_EZ(struct cmd *cmd);
 
 extern void exec_E_percent(struct cmd *cmd);
 
+extern void exec_E_quest(struct cmd *cmd);
+
 extern void exec_E_under(struct cmd *cmd);
 
 extern void exec_F1(struct cmd *cmd);
@@ -485,7 +489,7 @@ extern void reset_indirect(void);
 
 extern void reset_search(void);
 
-extern bool skip_cmd(struct cmd *cmd, const char *skip);
+extern bool skip_cmd(struct cmd *cmd, const char *skip, bool *empty);
 
 extern void scan_texts(struct cmd *cmd, int ntexts, int delim);
 
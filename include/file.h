@@ -88,6 +88,8 @@ extern struct ofile *open_output(const char *name, uint stream, bool colon,
 
 extern FILE *open_temp(const char *oname, uint stream);
 
+extern void read_ahead(struct ifile *ifile, uint_t nbytes);
+
 extern void read_command(struct ifile *ifile, uint stream, tbuffer *text);
 
 extern bool read_memory(char *p, uint len);
@@ -100,4 +102,7 @@ extern bool set_wild(const char *filename);
 
 extern void write_memory(const char *file);
 
+extern void write_text(FILE *fp, const char *text, uint_t nbytes, bool CR_out,
+                       char *last);
+
 #endif  // !defined(_FILE_H)
@@ -0,0 +1,77 @@
+///
+///  @file    profile.h
+///  @brief   Header file for TECO command profiling.
+///
+///  @copyright 2019-2023 Franklin P. Johnston / Nowwith Treble Software
+///
+///  Permission is hereby granted, free of charge, to any person obtaining a
+///  copy of this software and associated documentation files (the "Software"),
+///  to deal in the Software without restriction, including without limitation
+///  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+///  and/or sell copies of the Software, and to permit persons to whom the
+///  Software is furnished to do so, subject to the following conditions:
+///
+///  The above copyright notice and this permission notice shall be included in
+///  all copies or substantial portions of the Software.
+///
+///  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIA-
+///  BILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///  THE SOFTWARE.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#if     !defined(_PROFILE_H)
+
+#define _PROFILE_H
+
+#include "teco.h"                   // Needed for uint_t
+
+#define PROF_CMD    0               ///< ID for top-level command string
+
+extern void exit_prof(void);
+
+#if     defined(NTRACE)
+
+#define count_prof(field, n)  ((void)(n)) ///< Profiling disabled in this build
+
+#else
+
+///  @struct  prof_count
+///
+///  @brief   Running totals of bytes handled by the edit buffer and by file
+///           I/O. These are always kept, and the profiler charges each
+///           command with the difference between their values before and
+///           after it executed (unsigned arithmetic makes wrap-around
+///           harmless).
+
+struct prof_count
+{
+    uint_t inserted;                ///< No. of bytes inserted in edit buffer
+    uint_t deleted;                 ///< No. of bytes deleted from edit buffer
+    uint_t read;                    ///< No. of bytes read from input files
+    uint_t written;                 ///< No. of bytes written to output files
+};
+
+extern struct prof_count prof_count;
+
+///  @def    count_prof
+///
+///  @brief  Add no. of bytes to a running total.
+
+#define count_prof(field, n)  (prof_count.field += (uint_t)(n))
+
+// Profiling functions
+
+extern void exec_prof(void (*exec)(struct cmd *cmd), struct cmd *cmd);
+
+extern void reset_prof(uint macro);
+
+extern uint set_prof(const struct cmd *cmd);
+
+#endif
+
+#endif  // !defined(_PROFILE_H)
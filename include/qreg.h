@@ -33,12 +33,15 @@
 
 ///  @struct  qreg
 ///  @brief   Definition of Q-register storage, which includes a string and a
-///           numeric value.
+///           numeric value. Text storage can be shared by Q-registers on the
+///           push-down list, and by executing macros, in which case it has a
+///           reference count, and is copied before being modified.
 
 struct qreg
 {
     int_t n;                        ///< Q-register numeric value
     tbuffer text;                   ///< Q-register text storage
+    uint *refs;                     ///< Reference count (NULL if not shared)
 };
 
 ///  @var     QNAMES
@@ -51,10 +54,16 @@ struct qreg
 
 #define QCOUNT      (int)(sizeof(QNAMES) - 1)
 
+// Global variables
+
+extern uint_t qversion;
+
 // Q-register functions
 
 extern void append_qchr(int qindex, int c);
 
+extern void append_qtext(int qindex, const char *text, uint_t nbytes);
+
 extern void delete_qtext(int qindex);
 
 extern uint_t get_qall(void);
@@ -69,6 +78,8 @@ extern struct qreg *get_qreg(int qindex);
 
 extern uint_t get_qsize(int qindex);
 
+extern tbuffer hold_qtext(int qindex);
+
 extern void init_qreg(void);
 
 extern void pop_qlocal(void);
@@ -81,6 +92,8 @@ extern void push_qlocal(void);
 
 extern bool push_qreg(int qindex);
 
+extern void release_qtext(void);
+
 extern void reset_macro(void);
 
 extern void reset_qreg(void);
@@ -53,8 +53,6 @@ struct search
     int_t text_start;                   ///< Start search at this position
     int_t text_end;                     ///< End search at this position
     int_t text_pos;                     ///< Position of string relative to dot
-    uint_t match_len;                   ///< No. of characters left to match
-    const char *match_buf;              ///< Next character to match
 };
 
 // Global variables
@@ -65,6 +63,8 @@ extern tstring last_search;
 
 extern void build_search(const char *src, uint_t len);
 
+extern uint get_threads(void);
+
 extern bool search_loop(struct search *s);
 
 extern bool search_backward(struct search *s);
@@ -75,4 +75,6 @@ extern bool search_forward(struct search *s);
 
 extern void search_success(struct cmd *cmd);
 
+extern void set_threads(uint n);
+
 #endif  // !defined(_SEARCH_H)
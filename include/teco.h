@@ -121,6 +121,21 @@ enum
     MAIN_CTRLC                          ///< CTRL/C or abort entry
 };
 
+///  @enum   mem_type
+///  @brief  Types of memory allocations, for statistics (see -6EJ command).
+
+enum mem_type
+{
+    MEM_ALL,                            ///< Totals for all types
+    MEM_EDIT,                           ///< Edit buffer
+    MEM_QREG,                           ///< Q-registers
+    MEM_PAGE,                           ///< Stored pages
+    MEM_CMD,                            ///< Command strings and tokens
+    MEM_SEARCH,                         ///< Search strings and patterns
+    MEM_MISC,                           ///< Everything else
+    MEM_MAX                             ///< No. of types
+};
+
 
 ///  @struct   tbuffer
 ///  @brief    Definition of general buffer, used both for the main command
@@ -212,6 +227,7 @@ struct ifile
     char *name;                     ///< Input file name
     uint_t size;                    ///< Input file size
     bool LF;                        ///< First LF has been read
+    off_t ahead;                    ///< End of data read ahead so far
 };
 
 ///  @struct  ofile
@@ -232,6 +248,8 @@ extern uint_t cmd_line;
 
 extern jmp_buf jump_main;
 
+extern jmp_buf *jump_scan;
+
 extern uint_t last_len;
 
 extern char scratch[PATH_MAX];
@@ -252,6 +270,8 @@ extern void *alloc_mem(uint_t size);
 
 extern tbuffer alloc_tbuf(uint_t size);
 
+extern void *alloc_type(uint_t size, enum mem_type type);
+
 extern tstring build_string(const char *src, uint_t len);
 
 extern const char *build_trimmed(const char *src, uint_t len);
@@ -296,10 +316,16 @@ extern void print_size(uint_t size);
 
 extern void reset_map(void);
 
+extern void retype_mem(void *p1, enum mem_type type);
+
 extern void *shrink_mem(void *p1, uint_t size, uint_t delta);
 
+extern uint_t stat_mem(enum mem_type type, bool blocks);
+
 extern int teco_env(int n, bool colon);
 
 extern int tprint(const char *format, ...);
 
+extern void track_mem(enum mem_type type, uint_t oldsize, uint_t newsize);
+
 #endif  // !defined(_TECO_H)
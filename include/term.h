@@ -76,6 +76,8 @@ extern bool check_help(void);
 
 extern void echo_in(int c);
 
+extern void flush_term(void);
+
 extern int getc_term(bool nowait);
 
 extern void init_term(void);
@@ -35,6 +35,7 @@
 #include "estack.h"
 #include "exec.h"
 #include "file.h"
+#include "profile.h"
 
 
 ///
@@ -61,6 +62,7 @@ bool append(bool n_set, int_t n_arg, bool colon)
     f.ctrl_e = false;                   // Assume not appending FF
 
     int_t olddot = t->dot;
+    int_t oldZ   = t->Z;
 
     set_dot(t->Z);                      // Go to end of buffer
 
@@ -83,6 +85,8 @@ bool append(bool n_set, int_t n_arg, bool colon)
         (void)append_edit(ifile, (bool)false); // Append all we can
     }
 
+    count_prof(read, t->Z - oldZ);
+
     set_dot(olddot);
 
     return true;
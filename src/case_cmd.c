@@ -25,7 +25,6 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <assert.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +41,10 @@
 
 static void exec_case(struct cmd *cmd, bool lower);
 
+static void lower_text(uchar *text, uint_t nbytes);
+
+static void upper_text(uchar *text, uint_t nbytes);
+
 
 ///
 ///  @brief    Execute FL command: convert characters to lower case.
@@ -134,34 +137,43 @@ static void exec_case(struct cmd *cmd, bool lower)
         }
     }
 
-    int_t saved_dot = t->dot;
+    // Convert the text in place, a contiguous piece at a time.
 
-    set_dot(t->dot + m);
+    m += t->dot;
+    n += t->dot;
 
-    for (int_t i = m; i < n; ++i)
+    if (m < t->B)
     {
-        int c = t->c;
-
-        if (c == EOF)
-        {
-            break;
-        }
+        m = t->B;
+    }
 
-        if (lower && isupper(c))
-        {
-            change_dot(tolower(c));
-        }
-        else if (!lower && islower(c))
-        {
-            change_dot(toupper(c));
-        }
-        else
-        {
-            set_dot(t->dot + 1);
-        }
+    if (n > t->Z)
+    {
+        n = t->Z;
     }
 
-    set_dot(saved_dot);
+    change_edit(m, n, lower ? lower_text : upper_text);
+}
+
+
+///
+///  @brief    Convert text to lower case. This is written without branches or
+///            table lookups so that the compiler can vectorize it.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void lower_text(uchar *text, uint_t nbytes)
+{
+    assert(text != NULL);
+
+    for (uint_t i = 0; i < nbytes; ++i)
+    {
+        uchar c = text[i];
+
+        text[i] = c | (uchar)(((uchar)(c - 'A') < 26) << 5);
+    }
 }
 
 
@@ -181,3 +193,24 @@ bool scan_case(struct cmd *cmd)
 
     return false;
 }
+
+
+///
+///  @brief    Convert text to upper case. This is written without branches or
+///            table lookups so that the compiler can vectorize it.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void upper_text(uchar *text, uint_t nbytes)
+{
+    assert(text != NULL);
+
+    for (uint_t i = 0; i < nbytes; ++i)
+    {
+        uchar c = text[i];
+
+        text[i] = c & (uchar)~(((uchar)(c - 'a') < 26) << 5);
+    }
+}
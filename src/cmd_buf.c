@@ -158,12 +158,12 @@ int fetch_cbuf(void)
 
 void init_cbuf(void)
 {
-    root = alloc_mem((uint_t)sizeof(*root));
+    root = alloc_type((uint_t)sizeof(*root), MEM_CMD);
 
     root->len  = 0;
     root->pos  = 0;
     root->size = KB;
-    root->data = alloc_mem(root->size);
+    root->data = alloc_type(root->size, MEM_CMD);
 
     cbuf = root;
 }
@@ -263,6 +263,9 @@ void reset_cbuf(void)
     assert(root != NULL);               // Verify default command buffer
 
     cbuf = root;
+
+    discard_tokens(cbuf->data);
+
     cbuf->pos = 0;
     cbuf->len = 0;
     cbuf->data[0] = NUL;
@@ -286,6 +289,8 @@ void store_cbuf(int c)
     assert(cbuf != NULL);               // Verify command string
     assert(cbuf->data != NULL);         // Verify command buffer
 
+    discard_tokens(cbuf->data);         // Any tokens will be out of date
+
     if (cbuf->len == cbuf->size)        // Has buffer filled up?
     {
         assert(cbuf->size != 0);        // Verify non-zero size
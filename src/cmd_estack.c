@@ -135,12 +135,16 @@ static uint precedence[X_MAX];      ///< Current precedence table
 ///
 ///            We also apply for a linked list of stacks, since some TECO
 ///            commands, such as those that process macros, require their
-///            own context with their own expression stack.
+///            own context with their own expression stack. Stacks are not
+///            deallocated when a macro returns, but are kept for reuse by the
+///            next macro called at the same depth, so that macro calls don't
+///            need to allocate any memory.
 ///
 
 struct xstack
 {
     struct xstack *next;            ///< Next block in linked list
+    struct xstack *up;              ///< Block for next level up (or NULL)
     struct
     {
         int_t stack[MAX_VALUES];    ///< Operand list
@@ -196,12 +200,21 @@ void delete_x(void)
 {
     if (x->next != NULL)
     {
-        struct xstack *ptr = x;
+        x = x->next;
+    }
+}
 
-        x = ptr->next;
 
-        free_mem(&ptr);
-    }
+///
+///  @brief    Check to see if expression stack is empty.
+///
+///  @returns  true if there are no operands or operators, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool empty_x(void)
+{
+    return (x->number.count == 0 && x->oper.count == 0);
 }
 
 
@@ -370,12 +383,19 @@ void exit_x(void)
 {
     if (x != NULL)
     {
-        do
+        while (x->next != NULL)         // Find root stack
+        {
+            x = x->next;
+        }
+
+        struct xstack *up;
+
+        do                              // Now delete it and all above it
         {
-            delete_x();                    // Free up temporary stacks
-        } while (x->next != NULL);
+            up = x->up;
 
-        free_mem(&x);                   // Now delete root stack
+            free_mem(&x);
+        } while ((x = up) != NULL);
     }
 }
 
@@ -443,27 +463,23 @@ void init_x(void)
         x = alloc_mem((uint_t)sizeof(*x));
 
         x->next = NULL;
-
-        reset_x();
+        x->up   = NULL;
     }
     else
     {
-        struct xstack *next;
-
-        while ((next = x->next) != NULL)
+        while (x->next != NULL)         // Return to root stack
         {
-            free_mem(&x);
-
-            x = next;
+            x = x->next;
         }
-
-        reset_x();
     }
+
+    reset_x();
 }
 
 
 ///
-///  @brief    Set new expression stack.
+///  @brief    Set new expression stack, reusing one from a previous macro call
+///            at the same depth if we can.
 ///
 ///  @returns  Nothing.
 ///
@@ -471,10 +487,18 @@ void init_x(void)
 
 void new_x(void)
 {
-    struct xstack *p = alloc_mem((uint_t)sizeof(*p));
+    assert(x != NULL);
+
+    if (x->up == NULL)                  // Need to allocate new stack?
+    {
+        struct xstack *p = alloc_mem((uint_t)sizeof(*p));
+
+        p->next = x;
+        p->up   = NULL;
+        x->up   = p;
+    }
 
-    p->next = x;
-    x = p;
+    x = x->up;
 
     reset_x();
 }
@@ -37,6 +37,7 @@
 #include "errors.h"
 #include "estack.h"
 #include "exec.h"
+#include "profile.h"
 #include "term.h"
 
 #include "_cmd_exec.c"              // Include command tables
@@ -95,11 +96,236 @@ uint_t cmd_line;                    ///< Line number in current command/macro
 
 // Local functions
 
+static const struct cmd_table *compile_special(struct cmd *cmd);
+
+static uint_t compile_texts(struct cmd *cmd, int ntexts, int delim);
+
+static INLINE int fetch_cmd(void);
+
 static INLINE void scan_cmd(struct cmd *cmd);
 
+static bool scan_mods(struct cmd *cmd);
+
 static INLINE const struct cmd_table *scan_special(struct cmd *cmd);
 
-static void scan_text(int delim, tstring *text);
+static uint_t scan_text(int delim, tstring *text);
+
+
+///
+///  @brief    Compile special command: look up the handler for an E or F
+///            command, or for a ^x command, and save it in a token so that we
+///            don't have to do that again the next time that the command is
+///            executed. ^^x commands aren't compiled, since they're just
+///            operands.
+///
+///  @returns  Pointer to command table, or NULL if need to keep scanning.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static const struct cmd_table *compile_special(struct cmd *cmd)
+{
+    assert(cmd != NULL);
+
+    uint_t pos = cbuf->pos - 1;         // Position of command
+    const struct cmd_table *entry;
+    int c;
+
+    switch (cmd->c1)
+    {
+        case '^':                       // ^x and ^^x commands
+            c = require_cbuf();
+
+            if (c == '^')
+            {
+                scan_x(cmd);
+                confirm(cmd, NO_M, NO_N, NO_COLON, NO_DCOLON, NO_ATSIGN);
+
+                c = require_cbuf();
+
+                store_val((int_t)c);
+
+                return NULL;
+            }
+
+            c = 1 + toupper(c) - 'A';   // Change ^x to equivalent control chr.
+
+            if (c <= NUL || c >= SPACE)
+            {
+                throw(E_IUC, c);        // Invalid character following ^
+            }
+
+            cmd->c1 = (char)c;
+
+            entry = &cmd_table[c];
+
+            if (entry->exec == NULL && entry->scan == NULL)
+            {
+                throw(E_ILL, cmd->c1);  // Illegal command
+            }
+
+            break;
+
+        case 'E':                       // E commands
+        case 'e':                       // E commands
+            c = require_cbuf();
+
+            if ((uint)c > countof(e_table) || (e_table[c].scan == NULL &&
+                                               e_table[c].exec == NULL))
+            {
+                throw(E_IEC, c);        // Invalid E character
+            }
+
+            cmd->c2 = (char)c;
+
+            entry = &e_table[c];
+
+            break;
+
+        case 'F':                       // F commands
+        case 'f':                       // f commands
+            c = require_cbuf();
+
+            if ((uint)c > countof(f_table) || (f_table[c].scan == NULL &&
+                                               f_table[c].exec == NULL))
+            {
+                throw(E_IFC, c);        // Invalid F character
+            }
+
+            cmd->c2 = (char)c;
+
+            entry = &f_table[c];
+
+            break;
+
+        default:
+            return NULL;
+    }
+
+    if (!f.trace)                       // Tracing always scans everything
+    {
+        struct token *token = store_token(pos, TOKEN_CMD);
+
+        token->next      = cbuf->pos;
+        token->lines     = 0;
+        token->cmd.entry = entry;
+        token->cmd.c1    = cmd->c1;
+        token->cmd.c2    = cmd->c2;
+    }
+
+    return entry;
+}
+
+
+///
+///  @brief    Compile text string arguments following a command. Note that
+///            the delimiter passed to us is the default closing delimiter.
+///
+///  @returns  No. of LFs in text strings.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t compile_texts(struct cmd *cmd, int ntexts, int delim)
+{
+    assert(cmd != NULL);
+
+    // If the user specified the at-sign modifier, then skip any whitespace
+    // between the command and the delimiter.
+
+    if (cmd->atsign)                    // @ modifier?
+    {
+        cmd->atsign = false;
+
+        int c;
+
+        while ((c = peek_cbuf()) != TAB && isspace(c))
+        {
+            next_cbuf();                // Skip the whitespace character
+        }
+
+        c = require_cbuf();             // Get text string delimiter
+
+        //  The n@O/list/ command expects a comma-separated list, so a comma
+        //  as a delimiter for the text string isn't allowed.
+
+        if (c == ',' && toupper(cmd->c1) == 'O')
+        {
+            throw(E_TXT, c);            // Invalid text delimiter
+        }
+        else if (isgraph(c) || (c >= CTRL_A && c <= CTRL_Z))
+        {
+            delim = (char)c;
+        }
+        else
+        {
+            throw(E_TXT, c);            // Invalid text delimiter
+        }
+    }
+
+    // If we are allowing paired text delimiters, then the first delimiter
+    // cannot be a closing parenthesis, bracket, or brace.
+
+    if (strchr(")>]}", delim) != NULL && f.e1.text)
+    {
+        throw(E_TXT, delim);            // Invalid text delimiter
+    }
+
+    uint_t lines;
+
+    if (strchr("(<[{", delim) == NULL || !f.e1.text)
+    {
+        lines = scan_text(delim, &cmd->text1);
+
+        if (ntexts == 2)
+        {
+            lines += scan_text(delim, &cmd->text2);
+        }
+
+        return lines;
+    }
+
+    // Here if user wants to delimit text string(s) with paired parentheses,
+    // brackets, or braces. This means the text strings may be of the form
+    // (xxx), <xxx>, [xxx], or {xxx}, and may include leading or trailing
+    // whitespace, allowing commands such as @S {foo}, @FS [foo] [baz],
+    // @S<foobaz>, or @^A (foo). Note that if a command allows two text
+    // arguments, the second must be delimited by the same character pair
+    // as the first.
+
+    const char *end = strchr("()<>[]{}", delim);
+
+    assert(end != NULL);
+
+    // Point to closing parenthesis, bracket, or brace
+
+    ++end;
+
+    lines = scan_text(*end, &cmd->text1);
+
+    if (ntexts != 2)
+    {
+        return lines;
+    }
+
+    // Skip any whitespace after ')', '>', ']', or '}'
+
+    int c;
+
+    while ((c = peek_cbuf()) != TAB && isspace(c))
+    {
+        next_cbuf();                    // Skip the whitespace character
+    }
+
+    c = require_cbuf();                 // Get text string delimiter
+
+    if (c != delim)                     // Must be same delimiter
+    {
+        throw(E_TXT, c);                // Invalid text delimiter
+    }
+
+    lines += scan_text(*end, &cmd->text2);
+
+    return lines;
+}
 
 
 ///
@@ -184,7 +410,7 @@ void exec_cmd(struct cmd *cmd)
 
     // Loop for all commands in command string.
 
-    while (f.e0.exec && (c = fetch_cbuf()) != EOF)
+    while (f.e0.exec && (c = fetch_cmd()) != EOF)
     {
         cmd->c1 = (char)c;
 
@@ -259,10 +485,61 @@ void exec_str(const char *str)
 
     exec_macro(&buf, NULL);
 
+    discard_tokens(text);               // Buffer is about to go away
+
     f.e0.exec = exec;                   // Restore previous state
 }
 
 
+///
+///  @brief    Fetch next command character, skipping any whitespace characters
+///            (unless we're tracing, in which case each character has to be
+///            echoed). This has the same effect as scanning each character as
+///            a command, but a run of two or more whitespace characters is
+///            skipped in one step, using the token compiled for it.
+///
+///  @returns  Next character, or EOF if at end of string.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static INLINE int fetch_cmd(void)
+{
+    int c = fetch_cbuf();
+
+    if (f.trace)
+    {
+        return c;
+    }
+
+    while (c != EOF && (uint)c < countof(cmd_table)
+           && cmd_table[c].scan == scan_white)
+    {
+        int next = peek_cbuf();
+
+        if (next != EOF && (uint)next < countof(cmd_table)
+            && cmd_table[next].scan == scan_white)
+        {
+            const struct token *token = get_white(cbuf->pos - 1);
+
+            if (cmd_line != 0)
+            {
+                cmd_line += token->lines;
+            }
+
+            cbuf->pos = token->next;
+        }
+        else if (c == LF && cmd_line != 0)
+        {
+            ++cmd_line;
+        }
+
+        c = fetch_cbuf();
+    }
+
+    return c;
+}
+
+
 ///
 ///  @brief    Scan command and see if we're finished with it.
 ///
@@ -298,6 +575,11 @@ static INLINE void scan_cmd(struct cmd *cmd)
     int c = cmd->c1;
     const struct cmd_table *entry;
 
+    if ((c == ':' || c == '@') && scan_mods(cmd))
+    {
+        return;
+    }
+
     if ((uint)c < countof(cmd_table))
     {
         entry = &cmd_table[c];
@@ -345,8 +627,23 @@ static INLINE void scan_cmd(struct cmd *cmd)
 
     assert(entry->exec != NULL);
 
+#if     defined(NTRACE)
+
     (*entry->exec)(cmd);                // Execute command
 
+#else
+
+    if (f.profile)
+    {
+        exec_prof(entry->exec, cmd);    // Execute and profile command
+    }
+    else
+    {
+        (*entry->exec)(cmd);            // Execute command
+    }
+
+#endif
+
 #if     !defined(NSTRICT)
 
     f.e0.digit = false;
@@ -388,94 +685,125 @@ static INLINE void scan_cmd(struct cmd *cmd)
 
 
 ///
-///  @brief   Scan special command. This includes E and F commands, as well
-///           as ^x and ^^x commands, and whitespace characters.
+///  @brief    Scan a run of colon and at-sign modifiers, using the token
+///            compiled for the run if we've seen it before. Runs that need
+///            more than a simple count (e.g., ones that would elicit an error
+///            about too many modifiers) are left to scan_colon() and
+///            scan_atsign().
 ///
-///  Returns: Pointer to command table, or NULL if need to keep scanning.
+///  @returns  true if modifiers were processed, else false.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-static INLINE const struct cmd_table *scan_special(struct cmd *cmd)
+static bool scan_mods(struct cmd *cmd)
 {
     assert(cmd != NULL);
 
-    int c;
-
-    switch (cmd->c1)
+    if (f.trace || cmd->colon || cmd->dcolon || cmd->atsign)
     {
-        case '^':                       // ^x and ^^x commands
-            c = require_cbuf();
+        return false;
+    }
 
-            if (c == '^')
-            {
-                scan_x(cmd);
-                confirm(cmd, NO_M, NO_N, NO_COLON, NO_DCOLON, NO_ATSIGN);
+    uint_t pos = cbuf->pos - 1;
+    const struct token *token = find_token(pos, TOKEN_MOD);
 
-                c = require_cbuf();
+    if (token == NULL)
+    {
+        struct token *mods = store_token(pos, TOKEN_MOD);
+        uint_t ncolons = 0;
+        uint_t natsigns = 0;
+        uint_t next = pos;
+        bool split = false;             // true if colons aren't contiguous
 
-                store_val((int_t)c);
+        for (; next < cbuf->len; ++next)
+        {
+            int c = cbuf->data[next];
 
-                return NULL;
+            if (c == ':')
+            {
+                if (ncolons++ != 0 && cbuf->data[next - 1] != ':')
+                {
+                    split = true;
+                }
             }
-
-            c = 1 + toupper(c) - 'A';   // Change ^x to equivalent control chr.
-
-            if (c <= NUL || c >= SPACE)
+            else if (c == '@')
             {
-                throw(E_IUC, c);        // Invalid character following ^
+                ++natsigns;
+            }
+            else
+            {
+                break;
             }
+        }
 
-            cmd->c1 = (char)c;
+        mods->next       = next;
+        mods->lines      = 0;
+        mods->mod.valid  = (ncolons <= 2 && natsigns <= 1 && !split);
+        mods->mod.colon  = (ncolons == 1);
+        mods->mod.dcolon = (ncolons == 2);
+        mods->mod.atsign = (natsigns == 1);
 
-            const struct cmd_table *entry = &cmd_table[c];
+        token = mods;
+    }
 
-            if (entry->exec == NULL)
-            {
-                if (entry->scan == NULL)
-                {
-                    throw(E_ILL, cmd->c1); // Illegal command
-                }
-                else
-                {
-                    (void)(*entry->scan)(cmd);
+    if (!token->mod.valid)
+    {
+        return false;
+    }
 
-                    return NULL;
-                }
-            }
+    cmd->colon  = token->mod.colon;
+    cmd->dcolon = token->mod.dcolon;
+    cmd->atsign = token->mod.atsign;
+    cbuf->pos   = token->next;
 
-            return entry;
+    return true;
+}
 
-        case 'E':                       // E commands
-        case 'e':                       // E commands
-            c = require_cbuf();
 
-            if ((uint)c > countof(e_table) || (e_table[c].scan == NULL &&
-                                               e_table[c].exec == NULL))
-            {
-                throw(E_IEC, c);        // Invalid E character
-            }
+///
+///  @brief   Scan special command. This includes E and F commands, as well
+///           as ^x and ^^x commands, using the handler compiled for the
+///           command if we've seen it before.
+///
+///  Returns: Pointer to command table, or NULL if need to keep scanning.
+///
+////////////////////////////////////////////////////////////////////////////////
 
-            cmd->c2 = (char)c;
+static INLINE const struct cmd_table *scan_special(struct cmd *cmd)
+{
+    assert(cmd != NULL);
 
-            return &e_table[c];
+    const struct token *token = NULL;
+    const struct cmd_table *entry;
 
-        case 'F':                       // F commands
-        case 'f':                       // f commands
-            c = require_cbuf();
+    if (!f.trace)
+    {
+        token = find_token(cbuf->pos - 1, TOKEN_CMD);
+    }
 
-            if ((uint)c > countof(f_table) || (f_table[c].scan == NULL &&
-                                               f_table[c].exec == NULL))
-            {
-                throw(E_IFC, c);        // Invalid F character
-            }
+    if (token != NULL)
+    {
+        cmd->c1   = token->cmd.c1;
+        cmd->c2   = token->cmd.c2;
+        cbuf->pos = token->next;
+        entry     = token->cmd.entry;
+    }
+    else if ((entry = compile_special(cmd)) == NULL)
+    {
+        return NULL;
+    }
 
-            cmd->c2 = (char)c;
+    // A ^x command that has no execute function is just an operand, so all
+    // we need to do is scan it. E and F commands are scanned by our caller.
 
-            return &f_table[c];
+    if (cmd->c2 == NUL && entry->exec == NULL)
+    {
+        (void)(*entry->scan)(cmd);
 
-        default:
-            return NULL;
+        return NULL;
     }
+
+    return entry;
 }
 
 
@@ -485,63 +813,60 @@ static INLINE const struct cmd_table *scan_special(struct cmd *cmd)
 ///            which is usually, but not always, the same as the opening
 ///            delimiter.
 ///
-///  @returns  Nothing.
+///  @returns  No. of LFs in text string (including any LF delimiter).
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-static void scan_text(int delim, tstring *text)
+static uint_t scan_text(int delim, tstring *text)
 {
     assert(text != NULL);
 
-    text->data = cbuf->data + cbuf->pos;
-
+    char *start = cbuf->data + cbuf->pos;
     size_t nbytes = cbuf->len - cbuf->pos;
-    const char *start = text->data;
-    const char *end = memchr(start, delim, (size_t)nbytes);
-    uint_t len, tail = 1;
+    char *end = memchr(start, delim, nbytes);
+    uint_t tail = 1;
 
-    if (end != NULL)
+    if (end == NULL)
     {
-        len = (uint)(end - start);
-
-        // If we're counting lines, then count any LFs in the text string.
-
-        if (cmd_line != 0)
+        if (delim != LF)                // Processing a one-line comment?
         {
-            const char *p = start;
+            throw(E_BALK);              // Unexpected end of command or macro
+        }
 
-            for (uint i = 0; i < len; ++i)
-            {
-                if (*p++ == LF)
-                {
-                    ++cmd_line;
-                }
-            }
+        end = memchr(start, ESC, nbytes);
 
-            if (delim == LF)            // Is LF the delimiter (for !! tags)?
-            {
-                ++cmd_line;             // Yes, so count that also
-            }
+        if (end == NULL)                // Did we find an ESCape?
+        {
+            end = start + nbytes;       // No, just consume remainder of line
         }
+
+        tail = 0;                       // No closing delimiter
     }
-    else if (delim == LF)               // Processing a one-line comment?
-    {
-        end = memchr(start, ESC, (size_t)nbytes);
 
-        if (end != NULL)                // Did we find an ESCape?
-        {
-            len = (uint)(end - start);
-        }
-        else                            // No, just consume remainder of line
+    text->data = start;
+    text->len  = (uint_t)(end - start);
+
+    uint_t next = cbuf->pos + text->len + tail;
+    uint_t lines = 0;
+
+    for (const char *p = start; p < end; ++p)
+    {
+        if (*p == LF)
         {
-            len = (uint)nbytes;
+            ++lines;
         }
+    }
 
-        tail = 0;                       // No closing delimiter
+    if (tail != 0 && delim == LF)       // Is LF the delimiter (for !! tags)?
+    {
+        ++lines;                        // Yes, so count that also
     }
-    else
+
+    // If we're counting lines, then count any LFs in the text string.
+
+    if (cmd_line != 0)
     {
-        throw(E_BALK);                  // Unexpected end of command or macro
+        cmd_line += lines;
     }
 
 #if     !defined(NTRACE)
@@ -550,9 +875,9 @@ static void scan_text(int delim, tstring *text)
 
     if (f.trace)
     {
-        const char *p = start;
+        const char *p = text->data;
 
-        for (uint i = 0; i < len + tail; ++i)
+        for (uint_t i = cbuf->pos; i < next; ++i)
         {
             echo_in(*p++);
         }
@@ -560,13 +885,15 @@ static void scan_text(int delim, tstring *text)
 
 #endif
 
-    cbuf->pos += len + tail;
-    text->len = len;
+    cbuf->pos = next;
+
+    return lines;
 }
 
 
 ///
-///  @brief    Scan for text strings following command.
+///  @brief    Scan for text strings following command, using the token
+///            compiled for them if we've seen them before.
 ///
 ///  @returns  Nothing.
 ///
@@ -576,99 +903,56 @@ void scan_texts(struct cmd *cmd, int ntexts, int delim)
 {
     assert(cmd != NULL);
 
-    // If the user specified the at-sign modifier, then skip any whitespace
-    // between the command and the delimiter.
+    uint_t pos = cbuf->pos;
+    const struct token *token = NULL;
 
-    if (cmd->atsign)                    // @ modifier?
+    if (!f.trace)
     {
-        cmd->atsign = false;
-
-        int c;
-
-        while ((c = peek_cbuf()) != TAB && isspace(c))
-        {
-            next_cbuf();                // Skip the whitespace character
-        }
-
-        c = require_cbuf();             // Get text string delimiter
-
-        //  The n@O/list/ command expects a comma-separated list, so a comma
-        //  as a delimiter for the text string isn't allowed.
-
-        if (c == ',' && toupper(cmd->c1) == 'O')
-        {
-            throw(E_TXT, c);            // Invalid text delimiter
-        }
-        else if (isgraph(c) || (c >= CTRL_A && c <= CTRL_Z))
-        {
-            delim = (char)c;
-        }
-        else
-        {
-            throw(E_TXT, c);            // Invalid text delimiter
-        }
+        token = find_token(pos, TOKEN_TEXT);
     }
 
-    // If we are allowing paired text delimiters, then the first delimiter
-    // cannot be a closing parenthesis, bracket, or brace.
+    // The token can only be used if the command it was compiled for scanned
+    // its text strings the same way, and if we haven't since changed whether
+    // paired delimiters are allowed.
 
-    if (strchr(")>]}", delim) != NULL && f.e1.text)
+    if (token == NULL || token->text.delim != delim
+        || token->text.ntexts != ntexts || token->text.atsign != cmd->atsign
+        || token->text.paired != (bool)f.e1.text)
     {
-        throw(E_TXT, delim);            // Invalid text delimiter
-    }
+        bool atsign = cmd->atsign;
+        uint_t lines = compile_texts(cmd, ntexts, delim);
 
-    if (strchr("(<[{", delim) == NULL || !f.e1.text)
-    {
-        scan_text(delim, &cmd->text1);
-
-        if (ntexts == 2)
+        if (!f.trace)                   // Tracing always scans everything
         {
-            scan_text(delim, &cmd->text2);
+            struct token *text = store_token(pos, TOKEN_TEXT);
+
+            text->next        = cbuf->pos;
+            text->lines       = lines;
+            text->text.delim  = delim;
+            text->text.ntexts = ntexts;
+            text->text.atsign = atsign;
+            text->text.paired = (bool)f.e1.text;
+            text->text.text1  = cmd->text1;
+            text->text.text2  = cmd->text2;
         }
 
         return;
     }
 
-    // Here if user wants to delimit text string(s) with paired parentheses,
-    // brackets, or braces. This means the text strings may be of the form
-    // (xxx), <xxx>, [xxx], or {xxx}, and may include leading or trailing
-    // whitespace, allowing commands such as @S {foo}, @FS [foo] [baz],
-    // @S<foobaz>, or @^A (foo). Note that if a command allows two text
-    // arguments, the second must be delimited by the same character pair
-    // as the first.
-
-    const char *end = strchr("()<>[]{}", delim);
-
-    assert(end != NULL);
-
-    // Point to closing parenthesis, bracket, or brace
-
-    ++end;
-
-    scan_text(*end, &cmd->text1);
-
-    if (ntexts != 2)
-    {
-        return;
-    }
-
-    // Skip any whitespace after ')', '>', ']', or '}'
-
-    int c;
+    cmd->atsign = false;
+    cmd->text1  = token->text.text1;
 
-    while ((c = peek_cbuf()) != TAB && isspace(c))
+    if (ntexts == 2)
     {
-        next_cbuf();                    // Skip the whitespace character
+        cmd->text2 = token->text.text2;
     }
 
-    c = require_cbuf();                 // Get text string delimiter
-
-    if (c != delim)                     // Must be same delimiter
+    if (cmd_line != 0)
     {
-        throw(E_TXT, c);                // Invalid text delimiter
+        cmd_line += token->lines;
     }
 
-    scan_text(*end, &cmd->text2);
+    cbuf->pos = token->next;
 }
 
 
@@ -681,13 +965,15 @@ void scan_texts(struct cmd *cmd, int ntexts, int delim)
 ///            The skip parameter determines whether we just ignore commands
 ///            until we find one that matches one of the characters in the
 ///            string, at which time we return to the caller. This is used for
-///            branch and loop commands such as ", F>, and O.
+///            branch and loop commands such as ", F>, and O. If the empty
+///            parameter isn't NULL, we also say whether anything was left on
+///            the expression stack when we found the match.
 ///
 ///  @returns  true if found a match, false if we reached end of command string.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-bool skip_cmd(struct cmd *cmd, const char *skip)
+bool skip_cmd(struct cmd *cmd, const char *skip, bool *empty)
 {
     assert(cmd != NULL);
     assert(skip != NULL);
@@ -708,7 +994,7 @@ bool skip_cmd(struct cmd *cmd, const char *skip)
     f.e0.skip = true;
     f.trace = false;
 
-    while ((c = fetch_cbuf()) != EOF)
+    while ((c = fetch_cmd()) != EOF)
     {
 
 #if     !defined(NSTRICT)
@@ -739,6 +1025,11 @@ bool skip_cmd(struct cmd *cmd, const char *skip)
     f.trace = trace;
     f.e0.skip = false;
 
+    if (empty != NULL)
+    {
+        *empty = empty_x();
+    }
+
     delete_x();                         // Restore previous expression stack
 
     return match;
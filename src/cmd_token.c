@@ -0,0 +1,805 @@
+///
+///  @file    cmd_token.c
+///  @brief   Cache of compiled tokens for command strings and macros.
+///
+///  @copyright 2019-2023 Franklin P. Johnston / Nowwith Treble Software
+///
+///  Permission is hereby granted, free of charge, to any person obtaining a
+///  copy of this software and associated documentation files (the "Software"),
+///  to deal in the Software without restriction, including without limitation
+///  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+///  and/or sell copies of the Software, and to permit persons to whom the
+///  Software is furnished to do so, subject to the following conditions:
+///
+///  The above copyright notice and this permission notice shall be included in
+///  all copies or substantial portions of the Software.
+///
+///  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIA-
+///  BILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///  THE SOFTWARE.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "teco.h"
+#include "ascii.h"
+#include "cmdbuf.h"
+#include "eflags.h"
+#include "errors.h"
+#include "estack.h"
+#include "exec.h"
+
+
+///  @def    TOKEN_SETS
+///  @brief  No. of command strings for which we cache tokens.
+
+#define TOKEN_SETS  16
+
+///  @def    TOKEN_MIN
+///  @brief  Initial no. of token slots for a command string.
+
+#define TOKEN_MIN   64
+
+///  @def    FLOW_MIN
+///  @brief  Initial no. of flow control commands for a command string.
+
+#define FLOW_MIN    64
+
+///  @def    FLOW_CMDS
+///  @brief  Commands entered in index of flow control commands. This includes
+///          all of the commands that can cause us to skip forward, so that the
+///          positions we skip from can be found in the index.
+
+#define FLOW_CMDS   "<>\"'!Oo|;Ff"
+
+///  @struct  tokens
+///  @brief   Tokens compiled for a command string or macro. These are kept in
+///           a hash table indexed by the position of each token in the string.
+///           The table is tied to the text storage for the string, and must be
+///           discarded whenever that storage is modified or deallocated.
+
+struct tokens
+{
+    const char *data;               ///< Command string (NULL if set unused)
+    uint_t len;                     ///< Length of command string
+    uint_t size;                    ///< No. of token slots (a power of 2)
+    uint_t count;                   ///< No. of token slots in use
+    struct token *token;            ///< Token slots
+    struct flows *flows;            ///< Flow control index (or NULL)
+};
+
+static struct tokens token_sets[TOKEN_SETS]; ///< Cached token sets
+
+static struct tokens *tokens = NULL;    ///< Token set for current string
+
+static uint next_set = 0;           ///< Next token set to replace
+
+
+// Local functions
+
+static void add_flow(struct flows *flows, const struct cmd *cmd);
+
+static void build_labels(struct flows *flows);
+
+static void free_flows(struct tokens *set);
+
+static uint_t hash_label(const char *text, uint_t len);
+
+static struct token *find_slot(uint_t pos);
+
+static struct tokens *find_tokens(void);
+
+static void free_tokens(struct tokens *set);
+
+static void grow_tokens(struct tokens *set);
+
+static inline bool is_white(int c);
+
+static bool scan_flows(struct flows *flows);
+
+
+///
+///  @brief    Add flow control command to index.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void add_flow(struct flows *flows, const struct cmd *cmd)
+{
+    assert(flows != NULL);
+    assert(cmd != NULL);
+
+    if (flows->count == flows->size)
+    {
+        uint_t delta = flows->size * (uint_t)sizeof(struct flow);
+
+        flows->flow = expand_mem(flows->flow, delta, delta);
+        flows->size *= 2;
+    }
+
+    struct flow *flow = &flows->flow[flows->count++];
+
+    flow->pos     = cbuf->pos;
+    flow->lines   = cmd_line - 1;
+    flow->text    = NULL;
+    flow->len     = 0;
+    flow->c1      = toupper(cmd->c1);
+    flow->comment = false;
+    flow->dup     = false;
+
+    flow->end_loop  = 0;
+    flow->end_if    = 0;
+    flow->end_else  = 0;
+    flow->depth     = 0;
+    flow->min_depth = 0;
+
+    if (flow->c1 == '!')
+    {
+        flow->text    = cmd->text1.data;
+        flow->len     = cmd->text1.len;
+        flow->comment = (cmd->c2 == '!');
+    }
+}
+
+
+///
+///  @brief    Build hash table of tags in index of flow control commands. Any
+///            duplicate tags are flagged, so that the error can be reported if
+///            they're used.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void build_labels(struct flows *flows)
+{
+    assert(flows != NULL);
+    assert(flows->done);
+
+    uint_t ntags = 0;
+
+    for (uint_t i = 0; i < flows->count; ++i)
+    {
+        if (flows->flow[i].c1 == '!' && !flows->flow[i].comment)
+        {
+            ++ntags;
+        }
+    }
+
+    // Keep the hash table no more than half full.
+
+    flows->nslots = FLOW_MIN;
+
+    while (flows->nslots < ntags * 2)
+    {
+        flows->nslots *= 2;
+    }
+
+    flows->slot = alloc_type(flows->nslots * (uint_t)sizeof(*flows->slot),
+                             MEM_CMD);
+
+    uint_t mask = flows->nslots - 1;
+
+    for (uint_t i = 0; i < flows->count; ++i)
+    {
+        struct flow *flow = &flows->flow[i];
+
+        if (flow->c1 != '!' || flow->comment)
+        {
+            continue;
+        }
+
+        uint_t slot = hash_label(flow->text, flow->len) & mask;
+
+        while (flows->slot[slot] != 0)
+        {
+            struct flow *first = &flows->flow[flows->slot[slot] - 1];
+
+            if (first->len == flow->len
+                && !memcmp(first->text, flow->text, (size_t)flow->len))
+            {
+                first->dup = true;
+
+                break;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+
+        if (flows->slot[slot] == 0)
+        {
+            flows->slot[slot] = i + 1;
+        }
+    }
+}
+
+
+///
+///  @brief    Discard any tokens compiled for a command string. This must be
+///            called before the text storage for a string that may have been
+///            executed is modified or deallocated.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void discard_tokens(const char *data)
+{
+    if (data == NULL)
+    {
+        return;
+    }
+
+    for (uint i = 0; i < TOKEN_SETS; ++i)
+    {
+        if (token_sets[i].data == data)
+        {
+            free_tokens(&token_sets[i]);
+        }
+    }
+}
+
+
+///
+///  @brief    Find flow control command that ends at specified position,
+///            extending the index as far as that if necessary.
+///
+///  @returns  Command found, or NULL if none.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+struct flow *find_flow(struct flows *flows, uint_t pos)
+{
+    assert(flows != NULL);
+
+    while (flows->scanned < pos && scan_flows(flows))
+    {
+        ;
+    }
+
+    uint_t low = 0;
+    uint_t high = flows->count;
+
+    while (low < high)
+    {
+        uint_t mid = low + (high - low) / 2;
+
+        if (flows->flow[mid].pos < pos)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    if (low < flows->count && flows->flow[low].pos == pos)
+    {
+        return &flows->flow[low];
+    }
+
+    return NULL;
+}
+
+
+///
+///  @brief    Find tag in index of flow control commands. Since tags have to
+///            be unique, this requires that the entire string be indexed.
+///
+///  @returns  First occurrence of tag, or NULL if not found (or if the string
+///            couldn't be indexed).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+const struct flow *find_label(struct flows *flows, const char *text,
+                              uint_t len)
+{
+    assert(flows != NULL);
+    assert(text != NULL);
+
+    if (flows->slot == NULL)
+    {
+        while (scan_flows(flows))
+        {
+            ;
+        }
+
+        if (flows->failed)
+        {
+            return NULL;
+        }
+
+        build_labels(flows);
+    }
+
+    uint_t mask = flows->nslots - 1;
+    uint_t slot = hash_label(text, len) & mask;
+
+    while (flows->slot[slot] != 0)
+    {
+        const struct flow *flow = &flows->flow[flows->slot[slot] - 1];
+
+        if (flow->len == len && !memcmp(flow->text, text, (size_t)len))
+        {
+            return flow;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return NULL;
+}
+
+
+///
+///  @brief    Find slot for token at specified position in current command
+///            string, adding a new slot if it's not already there.
+///
+///  @returns  Token slot (pos is 0 if token is new).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct token *find_slot(uint_t pos)
+{
+    struct tokens *set = find_tokens();
+    uint_t mask = set->size - 1;
+    uint_t i = pos & mask;
+
+    ++pos;                              // Slots store position + 1
+
+    while (set->token[i].pos != 0)
+    {
+        if (set->token[i].pos == pos)
+        {
+            return &set->token[i];
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    // Here if new token. Keep the table no more than half full, so that our
+    // linear probes stay short.
+
+    if (++set->count * 2 > set->size)
+    {
+        grow_tokens(set);
+
+        mask = set->size - 1;
+        i = (pos - 1) & mask;
+
+        while (set->token[i].pos != 0)
+        {
+            i = (i + 1) & mask;
+        }
+    }
+
+    return &set->token[i];
+}
+
+
+///
+///  @brief    Find compiled token of specified type at position in current
+///            command string.
+///
+///  @returns  Token, or NULL if no such token has been compiled.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+const struct token *find_token(uint_t pos, enum token_type type)
+{
+    struct tokens *set = find_tokens();
+    uint_t mask = set->size - 1;
+    uint_t i = pos & mask;
+
+    ++pos;                              // Slots store position + 1
+
+    while (set->token[i].pos != 0)
+    {
+        if (set->token[i].pos == pos)
+        {
+            return set->token[i].type == type ? &set->token[i] : NULL;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    return NULL;
+}
+
+
+///
+///  @brief    Find token set for current command string, creating a new one
+///            (and replacing the oldest) if needed.
+///
+///  @returns  Token set.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct tokens *find_tokens(void)
+{
+    assert(cbuf != NULL);
+    assert(cbuf->data != NULL);
+
+    if (tokens != NULL && tokens->data == cbuf->data && tokens->len == cbuf->len)
+    {
+        return tokens;
+    }
+
+    for (uint i = 0; i < TOKEN_SETS; ++i)
+    {
+        tokens = &token_sets[i];
+
+        if (tokens->data == cbuf->data && tokens->len == cbuf->len)
+        {
+            return tokens;
+        }
+    }
+
+    tokens = &token_sets[next_set++];
+    next_set %= TOKEN_SETS;
+
+    free_tokens(tokens);
+
+    tokens->data  = cbuf->data;
+    tokens->len   = cbuf->len;
+    tokens->size  = TOKEN_MIN;
+    tokens->count = 0;
+    tokens->token = alloc_type(tokens->size * (uint_t)sizeof(struct token),
+                               MEM_CMD);
+
+    return tokens;
+}
+
+
+///
+///  @brief    Deallocate index of flow control commands.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_flows(struct tokens *set)
+{
+    assert(set != NULL);
+
+    if (set->flows != NULL)
+    {
+        free_mem(&set->flows->flow);
+        free_mem(&set->flows->slot);
+        free_mem(&set->flows);
+    }
+}
+
+
+///
+///  @brief    Deallocate token set.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_tokens(struct tokens *set)
+{
+    assert(set != NULL);
+
+    free_flows(set);
+    free_mem(&set->token);
+
+    set->data  = NULL;
+    set->len   = 0;
+    set->size  = 0;
+    set->count = 0;
+}
+
+
+///
+///  @brief    Get specified command in index of flow control commands,
+///            extending the index if necessary. Note that extending the index
+///            may move it, so callers should not keep pointers across calls.
+///
+///  @returns  Command, or NULL if no more commands in string (or if we found
+///            an error before the next one).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+struct flow *get_flow(struct flows *flows, uint_t n)
+{
+    assert(flows != NULL);
+
+    while (n >= flows->count)
+    {
+        if (!scan_flows(flows))
+        {
+            return NULL;
+        }
+    }
+
+    return &flows->flow[n];
+}
+
+
+///
+///  @brief    Get index of flow control commands for current command string,
+///            starting a new one if necessary.
+///
+///  @returns  Index.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+struct flows *get_flows(void)
+{
+    struct tokens *set = find_tokens();
+
+    if (set->flows != NULL)
+    {
+        if (set->flows->e1 == f.e1.flag && set->flows->e2 == f.e2.flag)
+        {
+            return set->flows;
+        }
+
+        free_flows(set);
+    }
+
+    // Note that the index is attached to the token set as soon as we create
+    // it, so that it will be deallocated by reset_tokens() if we get an error
+    // while extending it.
+
+    struct flows *flows = alloc_type((uint_t)sizeof(*flows), MEM_CMD);
+
+    set->flows = flows;
+
+    flows->e1      = f.e1.flag;
+    flows->e2      = f.e2.flag;
+    flows->size    = FLOW_MIN;
+    flows->flow    = alloc_type(flows->size * (uint_t)sizeof(struct flow),
+                                MEM_CMD);
+    flows->scanned = 0;
+    flows->lines   = 0;
+    flows->done    = false;
+    flows->failed  = false;
+
+    return flows;
+}
+
+
+///
+///  @brief    Get token for run of whitespace characters starting at specified
+///            position in command string, compiling it if necessary.
+///
+///  @returns  Token.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+const struct token *get_white(uint_t pos)
+{
+    const struct token *token = find_token(pos, TOKEN_WHITE);
+
+    if (token != NULL)
+    {
+        return token;
+    }
+
+    uint_t next = pos;
+    uint_t lines = 0;
+
+    while (next < cbuf->len && is_white(cbuf->data[next]))
+    {
+        if (cbuf->data[next++] == LF)
+        {
+            ++lines;
+        }
+    }
+
+    struct token *white = store_token(pos, TOKEN_WHITE);
+
+    white->next  = next;
+    white->lines = lines;
+
+    return white;
+}
+
+
+///
+///  @brief    Double the size of the hash table for a token set.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void grow_tokens(struct tokens *set)
+{
+    assert(set != NULL);
+
+    struct token *old = set->token;
+    uint_t oldsize = set->size;
+
+    set->size *= 2;
+    set->token = alloc_type(set->size * (uint_t)sizeof(struct token), MEM_CMD);
+
+    uint_t mask = set->size - 1;
+
+    for (uint_t i = 0; i < oldsize; ++i)
+    {
+        if (old[i].pos != 0)
+        {
+            uint_t j = (old[i].pos - 1) & mask;
+
+            while (set->token[j].pos != 0)
+            {
+                j = (j + 1) & mask;
+            }
+
+            set->token[j] = old[i];
+        }
+    }
+
+    free_mem(&old);
+}
+
+
+///
+///  @brief    Hash tag text (FNV-1a).
+///
+///  @returns  Hash value.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t hash_label(const char *text, uint_t len)
+{
+    assert(text != NULL);
+
+    uint hash = 2166136261u;
+
+    for (uint_t i = 0; i < len; ++i)
+    {
+        hash ^= (uchar)text[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+///
+///  @brief    Check for whitespace command character. These are the same
+///            characters that are handled by scan_white() in the command
+///            table.
+///
+///  @returns  true if whitespace, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static inline bool is_white(int c)
+{
+    return (c == SPACE || c == LF || c == CR || c == FF || c == NUL);
+}
+
+
+///
+///  @brief    Extend index of flow control commands by skipping forward to the
+///            next such command in the current command string, the same way
+///            that we would if we were executing a branch.
+///
+///  @returns  true if command found, false if at end of string (or if we
+///            found an error).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool scan_flows(struct flows *flows)
+{
+    assert(flows != NULL);
+
+    if (flows->done)
+    {
+        return false;
+    }
+
+    struct cmd cmd;                     // Dummy command block for skip_cmd()
+    uint_t saved_pos = cbuf->pos;
+    uint_t saved_line = cmd_line;
+    bool saved_trace = f.trace;
+    jmp_buf jump;
+
+    cbuf->pos = flows->scanned;
+    cmd_line = flows->lines + 1;
+
+    //  We may be scanning further than a serial scan would have gone, so any
+    //  error we find here is not reported. Instead, we stop indexing, so that
+    //  our callers scan the string themselves, and find the same error (or an
+    //  earlier one) in the same order that they would have without the index.
+
+    if (setjmp(jump) == 0)
+    {
+        jump_scan = &jump;
+
+        bool empty;
+
+        if (skip_cmd(&cmd, FLOW_CMDS, &empty))
+        {
+            add_flow(flows, &cmd);
+
+            //  Serial scans only stop at some of the commands we index, and
+            //  keep anything left on the expression stack when they don't, so
+            //  if that happens here, they might parse what follows differently.
+
+            if (!empty)
+            {
+                flows->done = true;
+                flows->failed = true;
+            }
+        }
+        else
+        {
+            flows->done = true;
+        }
+
+        flows->scanned = cbuf->pos;
+        flows->lines = cmd_line - 1;
+    }
+    else
+    {
+        f.trace = saved_trace;          // Undo what skip_cmd() did
+        f.e0.skip = false;
+
+        delete_x();
+
+        flows->done = true;
+        flows->failed = true;
+    }
+
+    jump_scan = NULL;
+
+    cbuf->pos = saved_pos;
+    cmd_line = saved_line;
+
+    return !flows->done;
+}
+
+
+///
+///  @brief    Discard all compiled tokens. This is called after an error, since
+///            we may then have lost track of temporary command strings.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void reset_tokens(void)
+{
+    for (uint i = 0; i < TOKEN_SETS; ++i)
+    {
+        free_tokens(&token_sets[i]);
+    }
+
+    tokens = NULL;
+}
+
+
+///
+///  @brief    Store compiled token of specified type at position in current
+///            command string, replacing any token already there. The caller
+///            fills in everything but the position and type.
+///
+///  @returns  Token.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+struct token *store_token(uint_t pos, enum token_type type)
+{
+    struct token *token = find_slot(pos);
+
+    token->pos  = pos + 1;
+    token->type = type;
+
+    return token;
+}
@@ -65,11 +65,9 @@ void exec_ctrl_U(struct cmd *cmd)
     {
         if (cmd->colon)                 // :^Utext`
         {
-            const char *p = cmd->text1.data;
-
-            for (uint_t i = 0; i < cmd->text1.len; ++i)
+            if (cmd->text1.len != 0)
             {
-                append_qchr(cmd->qindex, *p++);
+                append_qtext(cmd->qindex, cmd->text1.data, cmd->text1.len);
             }
         }
         else if (cmd->text1.len == 0)   // ^Uq`
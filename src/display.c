@@ -54,6 +54,10 @@
 
 #define MIN_ROWS            10      ///< Minimum no. of rows for edit window
 
+#define COL_LINES           16      ///< No. of lines with cached columns
+
+#define COL_STEP            64      ///< Bytes between cached columns
+
 
 ///
 ///  @var     d
@@ -84,6 +88,74 @@ struct display d =
     .ncols   = 0,
 };
 
+///
+///  @var     dirty
+///
+///  @brief   Range of text in edit buffer that has changed since the edit
+///           window was last painted, and the net no. of lines added to or
+///           deleted from it. 'start' is -1 if nothing has changed.
+///
+
+static struct
+{
+    int_t start;                        ///< Start of changed text
+    int_t end;                          ///< End of changed text
+    int nlines;                         ///< Net no. of lines added or deleted
+} dirty =
+{
+    .start  = -1,
+    .end    = -1,
+    .nlines = 0,
+};
+
+///  @struct  colmap
+///  @brief   Display columns for a line in the edit buffer, cached at every
+///           COL_STEP bytes from the start of the line, so that the column
+///           of any position in the line can be found by reading at most
+///           COL_STEP - 1 characters. The cache is built as far as needed
+///           each time it is used, and is discarded if the line changes.
+
+struct colmap
+{
+    int_t start;                        ///< Start of line (-1 if unused)
+    int_t len;                          ///< Length of line (-1 if unknown)
+    int_t cr;                           ///< Offset of first CR (-1 if none)
+    int *col;                           ///< Column at every COL_STEP bytes
+    uint_t size;                        ///< Allocated no. of columns
+    uint_t count;                       ///< No. of columns cached
+    uint_t used;                        ///< When cache was last used
+};
+
+///
+///  @var     cols
+///
+///  @brief   Cached columns for the lines most recently used.
+///
+
+static struct
+{
+    struct colmap line[COL_LINES];      ///< Cached lines
+    int_t end;                          ///< End of last cached line
+    uint_t clock;                       ///< Incremented for each use
+    int tabsize;                        ///< Tab size for cached columns
+    bool seeall;                        ///< SEEALL mode for cached columns
+} cols =
+{
+    .end     = -1,
+    .clock   = 0,
+    .tabsize = 0,
+    .seeall  = false,
+};
+
+///
+///  @var     wrapped
+///
+///  @brief   true if any line was wider than the edit window when it was last
+///           painted, so that rows no longer correspond to lines.
+///
+
+static bool wrapped = false;
+
 /// @def    check(cond)
 /// @brief  Wrapper to force Boolean value for check() parameter.
 
@@ -98,12 +170,28 @@ struct display d =
 
 static INLINE void (check)(bool cond);
 
+static INLINE int chr_width(int c, int col);
+
+static void extend_cols(struct colmap *map, int_t end, int maxcol);
+
+static struct colmap *find_cols(int_t start);
+
 static void init_window(WINDOW **win, int pair, int top, int bot, int col, int width);
 
 static void init_windows(void);
 
+static int_t next_row(int_t pos);
+
+static void paint_chr(int c);
+
+static bool paint_rows(int_t *pos, int_t *prev, int row, int last);
+
 static void refresh_edit(void);
 
+static bool repaint_edit(void);
+
+static void reset_cols(int_t pos);
+
 static void reset_cursor(void);
 
 static void set_cursor(void);
@@ -133,6 +221,26 @@ static INLINE void (check)(bool cond)
 }
 
 
+///
+///  @brief    Get the width of a character on the display.
+///
+///  @returns  No. of columns.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static INLINE int chr_width(int c, int col)
+{
+    if (c == HT && !w.seeall)
+    {
+        return TABSIZE - (col % TABSIZE);
+    }
+    else
+    {
+        return keysize[c];
+    }
+}
+
+
 ///
 ///  @brief    Clear to end of line.
 ///
@@ -171,45 +279,187 @@ void exit_dpy(void)
         endwin();
         init_term();
     }
+
+    for (int i = 0; i < COL_LINES; ++i)
+    {
+        struct colmap *map = &cols.line[i];
+
+        if (map->col != NULL)
+        {
+            free_mem(&map->col);
+
+            map->size = map->count = 0;
+        }
+    }
+
+    reset_cols((int_t)0);
 }
 
 
 ///
-///  @brief    Find the column required for the current 'dot'.
+///  @brief    Extend cached columns for line until we reach a specified
+///            position, or a specified column, or the end of the line.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void extend_cols(struct colmap *map, int_t end, int maxcol)
+{
+    assert(map != NULL);
+
+    while (map->len == -1)
+    {
+        int_t pos = map->start + (int_t)(map->count - 1) * COL_STEP;
+        int col = map->col[map->count - 1];
+        int c;
+
+        if (pos >= end || col > maxcol)
+        {
+            break;
+        }
+
+        for (int i = 0; i < COL_STEP; ++i, ++pos)
+        {
+            if ((c = read_edit(pos - t->dot)) == EOF || isdelim(c))
+            {
+                map->len = pos - map->start;
+
+                break;
+            }
+            else if (c == CR && map->cr == -1)
+            {
+                map->cr = pos - map->start;
+            }
+
+            col += chr_width(c, col);
+        }
+
+        if (map->len != -1)
+        {
+            break;
+        }
+
+        if (map->count == map->size)
+        {
+            uint_t size  = map->size * sizeof(int);
+            uint_t delta = size;
+
+            map->col   = expand_mem(map->col, size, delta);
+            map->size *= 2;
+        }
+
+        map->col[map->count++] = col;
+    }
+
+    int_t mapped = map->len;
+
+    if (mapped == -1)
+    {
+        mapped = (int_t)map->count * COL_STEP;
+    }
+
+    if (cols.end < map->start + mapped)
+    {
+        cols.end = map->start + mapped;
+    }
+}
+
+
+///
+///  @brief    Count the number of characters required to get from the start of
+///            a line to a specified column, stopping at the end of the line or
+///            at the first CR.
 ///
 ///  @returns  No. of bytes to adjust 'dot'.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-int_t find_column(void)
+int_t count_chrs(int_t pos, int maxcol)
 {
-    int_t pos = -t->pos;                // Get no. of chrs. to start of line
-    int col = 0;                        // Current column in line
-    int c;
+    struct colmap *map = find_cols(t->dot + pos);
 
-    // Read characters from the start of the current line, summing the width
-    // of each one, in order to calculate what column the cursor should be in.
-    // We have to do this one character at a time since the widths can vary.
+    extend_cols(map, t->Z, maxcol);
 
-    while ((c = read_edit(pos)) != EOF)
+    // Start at the last cached column that is before both the specified
+    // column and any CR, and then count characters from there.
+
+    uint_t lo = 0;
+    uint_t hi = map->count;
+
+    while (hi - lo > 1)
     {
-        int width;
+        uint_t mid = (lo + hi) / 2;
 
-        if (c == HT && !w.seeall)
+        if (map->col[mid] <= maxcol)
         {
-            width = TABSIZE - (col % TABSIZE);
+            lo = mid;
         }
         else
         {
-            width = keysize[c];
+            hi = mid;
         }
+    }
+
+    if (map->cr != -1 && (int_t)lo * COL_STEP > map->cr)
+    {
+        lo = (uint_t)(map->cr / COL_STEP);
+    }
 
-        if (isdelim(c) || pos == 0)
+    int col = map->col[lo];
+    int c;
+
+    pos += (int_t)lo * COL_STEP;
+
+    while ((c = read_edit(pos)) != EOF)
+    {
+        int width = chr_width(c, col);
+
+        if (isdelim(c) || c == CR || col + width > maxcol)
         {
             break;
         }
 
         col += width;
+        ++pos;
+    }
+
+    return pos;
+}
+
+
+///
+///  @brief    Find the column required for the current 'dot'.
+///
+///  @returns  No. of bytes to adjust 'dot'.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+int_t find_column(void)
+{
+    struct colmap *map = find_cols(t->dot - t->pos);
+
+    extend_cols(map, t->dot, INT_MAX);
+
+    uint_t n = (uint_t)(t->pos / COL_STEP);
+
+    if (n >= map->count)
+    {
+        n = map->count - 1;
+    }
+
+    int_t pos = (int_t)n * COL_STEP - t->pos;
+    int col = map->col[n];
+    int c;
+
+    // Read characters from the last cached column before dot, summing the
+    // width of each one, in order to calculate what column the cursor should
+    // be in. We have to do this one character at a time since the widths can
+    // vary.
+
+    while (pos < 0 && (c = read_edit(pos)) != EOF && !isdelim(c))
+    {
+        col += chr_width(c, col);
 
         ++pos;
     }
@@ -218,6 +468,60 @@ int_t find_column(void)
 }
 
 
+///
+///  @brief    Find the cached columns for the line that starts at a specified
+///            position, or start a new cache for it, replacing the line least
+///            recently used.
+///
+///  @returns  Cached columns for line.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct colmap *find_cols(int_t start)
+{
+    if (cols.tabsize != TABSIZE || cols.seeall != w.seeall)
+    {
+        cols.tabsize = TABSIZE;
+        cols.seeall  = w.seeall;
+
+        reset_cols((int_t)0);           // Widths have changed
+    }
+
+    struct colmap *map = &cols.line[0];
+
+    for (int i = 0; i < COL_LINES; ++i)
+    {
+        if (cols.line[i].count != 0 && cols.line[i].start == start)
+        {
+            map = &cols.line[i];
+
+            map->used = ++cols.clock;
+
+            return map;
+        }
+        else if (cols.line[i].used < map->used)
+        {
+            map = &cols.line[i];
+        }
+    }
+
+    if (map->col == NULL)
+    {
+        map->size = COL_STEP;
+        map->col  = alloc_mem(map->size * sizeof(int));
+    }
+
+    map->start  = start;
+    map->len    = -1;
+    map->cr     = -1;
+    map->count  = 1;
+    map->col[0] = 0;
+    map->used   = ++cols.clock;
+
+    return map;
+}
+
+
 ///
 ///  @brief    Read next character without wait (non-blocking I/O).
 ///
@@ -435,6 +739,227 @@ static void init_windows(void)
 }
 
 
+///
+///  @brief    Record text in edit buffer that has been inserted, deleted, or
+///            changed, so that we can repaint just the rows that contain it.
+///            This is called with the range of text after the change, the
+///            no. of bytes added (or deleted, if negative), and the no. of
+///            lines added (or deleted, if negative).
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void mark_dpy(int_t start, int_t end, int_t nbytes, int nlines)
+{
+    assert(start <= end);
+
+    if (start <= cols.end)              // Discard any columns that changed
+    {
+        reset_cols(start);
+    }
+
+    if (!f.e0.display || f.e0.window)   // Nothing to do if full repaint needed
+    {
+        return;
+    }
+
+    if (start < w.topdot)               // Change before start of window?
+    {
+        f.e0.window = true;             // Yes, so repaint all of it
+
+        return;
+    }
+
+    if (dirty.start == -1)              // First change since last refresh?
+    {
+        dirty.start  = start;
+        dirty.end    = end;
+        dirty.nlines = nlines;
+
+        return;
+    }
+
+    // Any text inserted or deleted before the end of the previous change moves
+    // that end, and also moves the text after it, so the two changes can be
+    // merged into one range that covers both.
+
+    if (dirty.end > start)
+    {
+        dirty.end += nbytes;
+
+        if (dirty.end < start)
+        {
+            dirty.end = start;
+        }
+    }
+
+    if (dirty.start > start)
+    {
+        dirty.start = start;
+    }
+
+    if (dirty.end < end)
+    {
+        dirty.end = end;
+    }
+
+    dirty.nlines += nlines;
+}
+
+
+///
+///  @brief    Find the start of the row following the one that starts at a
+///            specified position.
+///
+///  @returns  Absolute position of next row (or Z if at end of buffer).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int_t next_row(int_t pos)
+{
+    int c;
+
+    while ((c = read_edit(pos - t->dot)) != EOF)
+    {
+        ++pos;
+
+        if (isdelim(c))
+        {
+            break;
+        }
+    }
+
+    return pos;
+}
+
+
+///
+///  @brief    Paint character in edit window.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void paint_chr(int c)
+{
+    chtype ch = (chtype)c;
+
+    ++w.painted;
+
+    if (isprint(c))                     // Printing chr. [32-126]
+    {
+        waddch(d.edit, ch);
+    }
+    else if (iscntrl(c))                // Control chr. [0-31, 127]
+    {
+        switch (c)
+        {
+            case HT:
+                if (w.seeall)
+                {
+                    waddstr(d.edit, unctrl(ch));
+                }
+                else
+                {
+                    waddch(d.edit, ch);
+                }
+
+                break;
+
+            case BS:
+            case VT:
+            case FF:
+            case LF:
+            case CR:
+                if (w.seeall)
+                {
+                    waddstr(d.edit, unctrl(ch));
+                }
+
+                break;
+
+            default:
+                waddch(d.edit, ch);
+
+                break;
+        }
+    }
+    else                                // 8-bit chr. [128-255]
+    {
+        if (w.seeall)
+        {
+            waddstr(d.edit, table_8bit[c & 0x7f]);
+        }
+        else
+        {
+            waddstr(d.edit, unctrl(ch));
+        }
+    }
+}
+
+
+///
+///  @brief    Paint a range of rows in edit window, starting at a specified
+///            position, and also given the start of the previous row so we
+///            know where to put the EOF marker.
+///
+///  @returns  true if rows painted, false if a line was too wide for window.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool paint_rows(int_t *pos, int_t *prev, int row, int last)
+{
+    assert(pos != NULL);
+    assert(prev != NULL);
+
+    for (; row <= last; ++row)
+    {
+        wmove(d.edit, row, 0);
+        wclrtoeol(d.edit);
+
+        if (*pos == t->Z)               // At end of buffer?
+        {
+            if (*prev < t->Z)           // Yes, print EOF marker if first row
+            {
+                waddch(d.edit, ACS_DIAMOND);
+            }
+
+            *prev = *pos;
+
+            continue;
+        }
+
+        *prev = *pos;
+
+        int c;
+
+        while ((c = read_edit(*pos - t->dot)) != EOF)
+        {
+            ++*pos;
+
+            paint_chr(c);
+
+            if (isdelim(c))
+            {
+                break;
+            }
+        }
+
+        int y, x __attribute__((unused));
+
+        getyx(d.edit, y, x);
+
+        if (y != row)                   // Did line wrap?
+        {
+            return false;
+        }
+    }
+
+    return true;
+}                                       //lint !e438 !e550
+
+
 ///
 ///  @brief    Output character to command window. We do not output CR because
 ///            ncurses does the following when processing LF:
@@ -472,12 +997,15 @@ void refresh_dpy(void)
         return;
     }
 
-    if (t->dot < w.topdot || t->dot > w.botdot)
+    // If text has changed, then 'botdot' may be out of date, but any change
+    // that moves dot out of the window will be caught by update_window().
+
+    if (t->dot < w.topdot || (t->dot > w.botdot && dirty.start == -1))
     {
         f.e0.window = true;             // Force repaint if too much changed
     }
 
-    if (f.e0.window || f.e0.cursor)
+    if (f.e0.window || f.e0.cursor || dirty.start != -1)
     {
         if (!f.e0.updown)               // Was last command up or down key?
         {
@@ -489,6 +1017,11 @@ void refresh_dpy(void)
         reset_cursor();                 // Un-mark the old cursor
         update_window();
 
+        if (!f.e0.window && dirty.start != -1 && !repaint_edit())
+        {
+            f.e0.window = true;         // Couldn't repaint just what changed
+        }
+
         if (f.e0.window)
         {
             f.e0.window = false;
@@ -496,6 +1029,8 @@ void refresh_dpy(void)
             refresh_edit();
         }
 
+        dirty.start = -1;
+
         set_cursor();                   // Mark the new cursor
 
         prefresh(d.edit, 0, d.xbias, d.minrow, d.mincol, d.maxrow, d.maxcol);
@@ -516,6 +1051,7 @@ void refresh_dpy(void)
 static void refresh_edit(void)
 {
     int_t pos = len_edit((int_t)-d.ybias);
+    int line = 0;                       // No. of lines output
     int row = -1;
     int col __attribute__((unused));
     int c;
@@ -523,6 +1059,7 @@ static void refresh_edit(void)
     wclear(d.edit);
 
     w.topdot = t->dot + pos;            // First character output in window
+    wrapped = false;
 
     while ((c = read_edit(pos)) != EOF)
     {
@@ -530,76 +1067,185 @@ static void refresh_edit(void)
 
         getyx(d.edit, row, col);
 
-        chtype ch = (chtype)c;
-
-        if (isprint(c))                 // Printing chr. [32-126]
+        if (row != line)                // Did previous line wrap?
         {
-            waddch(d.edit, ch);
+            wrapped = true;
         }
-        else if (iscntrl(c))            // Control chr. [0-31, 127]
+
+        paint_chr(c);
+
+        if (isdelim(c))                 // Found a delimiter (LF, VT, FF)?
         {
-            switch (c)
+            if (row == d.nrows - 1)     // If at end of last row, then done
             {
-                case HT:
-                    if (w.seeall)
-                    {
-                        waddstr(d.edit, unctrl(ch));
-                    }
-                    else
-                    {
-                        waddch(d.edit, ch);
-                    }
-
-                    break;
-
-                case BS:
-                case VT:
-                case FF:
-                case LF:
-                case CR:
-                    if (w.seeall)
-                    {
-                        waddstr(d.edit, unctrl(ch));
-                    }
-
-                    break;
-
-                default:
-                    waddch(d.edit, ch);
-
-                    break;
+                break;
             }
+
+            waddch(d.edit, '\n');       // Else output newline
+
+            ++line;
+        }
+    }
+
+    w.botdot = t->dot + pos;            // Last character output in window
+
+    if (row < d.nrows - 1)              // Should we print EOF marker?
+    {
+        mvwaddch(d.edit, row + 1, 0, ACS_DIAMOND);
+    }
+}                                       //lint !e438 !e550
+
+
+///
+///  @brief    Repaint only those rows in edit window that contain text that has
+///            changed since the window was last painted. If lines were added
+///            or deleted, then the rows following the change are scrolled up
+///            or down instead of being repainted.
+///
+///  @returns  true if window repainted, false if it must be repainted in full.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool repaint_edit(void)
+{
+    // We can only repaint part of the window if the top row would be the
+    // same after a full repaint.
+
+    if (wrapped || dirty.start < w.topdot
+        || t->dot + len_edit((int_t)-d.ybias) != w.topdot)
+    {
+        return false;
+    }
+
+    int last = d.nrows - 1;             // Last row in window
+    int_t pos = w.topdot;               // Start of row containing change
+    int_t prev = -1;                    // Start of previous row
+    int row = 0;
+
+    while (pos < dirty.start)           // Find row containing start of change
+    {
+        int_t next = next_row(pos);
+
+        // A change at the end of a last line that has no delimiter is on the
+        // same row as that line, not on the row after it.
+
+        if (next > dirty.start
+            || (next == t->Z && !isdelim(read_edit(next - 1 - t->dot))))
+        {
+            break;
         }
-        else                            // 8-bit chr. [128-255]
+
+        prev = pos;
+        pos  = next;
+
+        if (++row > last)               // Change is below window
         {
-            if (w.seeall)
-            {
-                waddstr(d.edit, table_8bit[c & 0x7f]);
-            }
-            else
+            return true;
+        }
+    }
+
+    // If the change extends to the end of the buffer, then there is nothing
+    // after it to scroll, so just repaint everything from the change down.
+    // Otherwise, find the row containing the end of the change.
+
+    int first = row;                    // First row to repaint
+    int_t end = pos;
+
+    if (dirty.end < t->Z)
+    {
+        while (row < last)
+        {
+            int_t next = next_row(end);
+
+            if (next > dirty.end)
             {
-                waddstr(d.edit, unctrl(ch));
+                break;
             }
+
+            end = next;
+            ++row;
         }
+    }
+    else
+    {
+        row = last;
+    }
 
-        if (isdelim(c))                 // Found a delimiter (LF, VT, FF)?
+    if (dirty.nlines != 0 && row < last)
+    {
+        wmove(d.edit, first + 1, 0);
+        winsdelln(d.edit, dirty.nlines);
+    }
+
+    if (!paint_rows(&pos, &prev, first, row))
+    {
+        return false;
+    }
+
+    // If we deleted lines, then repaint the rows vacated at the bottom.
+
+    for (++row; row <= last; ++row)
+    {
+        if (dirty.nlines < 0 && row > last + dirty.nlines)
         {
-            if (row == d.maxrow)        // If at end of last row, then done
+            if (!paint_rows(&pos, &prev, row, last))
             {
-                break;
+                return false;
             }
 
-            waddch(d.edit, '\n');       // Else output newline
+            break;
         }
+
+        prev = pos;
+        pos  = next_row(pos);
     }
 
-    w.botdot = t->dot + pos;            // Last character output in window
+    w.botdot = pos;
+
+    return true;
+}
 
-    if (row < d.maxrow)                 // Should we print EOF marker?
+
+///
+///  @brief    Discard cached columns for any lines that end at or after a
+///            specified position.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void reset_cols(int_t pos)
+{
+    cols.end = -1;
+
+    for (int i = 0; i < COL_LINES; ++i)
     {
-        mvwaddch(d.edit, row + 1, 0, ACS_DIAMOND);
+        struct colmap *map = &cols.line[i];
+
+        if (map->count == 0)
+        {
+            continue;
+        }
+
+        int_t mapped = map->len;
+
+        if (mapped == -1)
+        {
+            mapped = (int_t)map->count * COL_STEP;
+        }
+
+        if (map->start + mapped >= pos)
+        {
+            map->start = -1;
+            map->count = 0;
+            map->used  = 0;
+        }
+        else if (cols.end < map->start + mapped)
+        {
+            cols.end = map->start + mapped;
+        }
     }
-}                                       //lint !e438 !e550
+}
 
 
 ///
@@ -0,0 +1,497 @@
+///
+///  @file    e_quest_cmd.c
+///  @brief   Execute E? command, and profile commands.
+///
+///  @copyright 2019-2023 Franklin P. Johnston / Nowwith Treble Software
+///
+///  Permission is hereby granted, free of charge, to any person obtaining a
+///  copy of this software and associated documentation files (the "Software"),
+///  to deal in the Software without restriction, including without limitation
+///  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+///  and/or sell copies of the Software, and to permit persons to whom the
+///  Software is furnished to do so, subject to the following conditions:
+///
+///  The above copyright notice and this permission notice shall be included in
+///  all copies or substantial portions of the Software.
+///
+///  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIA-
+///  BILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///  THE SOFTWARE.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "teco.h"
+#include "errors.h"
+#include "estack.h"
+#include "exec.h"
+#include "profile.h"
+
+
+#if     defined(NTRACE)
+
+// E? command does not work if tracing is disabled in this build.
+
+void exec_E_quest(struct cmd *unused)
+{
+    throw(E_NYI);                       // Not yet implemented
+}
+
+bool scan_E_quest(struct cmd *unused)
+{
+    return false;
+}
+
+void exit_prof(void)
+{
+}
+
+#else
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ascii.h"
+#include "eflags.h"
+
+
+#define PROF_MIN    256                 ///< Initial size of profile table
+
+#define PROF_EI     1                   ///< Profiling EI command file
+
+#define PROF_STR    2                   ///< Profiling internal command string
+
+#define PROF_LOCAL  0x100               ///< Flag for local Q-register macro
+
+///  @struct  prof
+///
+///  @brief   Profile of a command, identified by the macro it is in, the line
+///           in the macro, and the command characters.
+
+struct prof
+{
+    uint     macro;                     ///< Macro ID (see set_prof())
+    uint_t   line;                      ///< Line no. in macro
+    char     c1;                        ///< 1st command character
+    char     c2;                        ///< 2nd command character (or NUL)
+    uint64_t count;                     ///< No. of times executed (0 if unused)
+    uint64_t nsecs;                     ///< Total execution time
+    uint64_t inserted;                  ///< Total bytes inserted
+    uint64_t deleted;                   ///< Total bytes deleted
+    uint64_t read;                      ///< Total bytes read
+    uint64_t written;                   ///< Total bytes written
+};
+
+struct prof_count prof_count;           ///< Running totals for edit buffer/files
+
+///  @var     prof
+///
+///  @brief   Hash table of command profiles, using linear probing.
+
+static struct
+{
+    struct prof *table;                 ///< Table of command profiles
+    uint size;                          ///< Size of table (a power of 2)
+    uint count;                         ///< No. of entries used
+    uint macro;                         ///< ID of macro being executed
+    bool report;                        ///< Type profile when exiting
+} prof =
+{
+    .table  = NULL,
+    .size   = 0,
+    .count  = 0,
+    .macro  = PROF_CMD,
+    .report = false,
+};
+
+
+// Local functions
+
+static int compare_prof(const void *p1, const void *p2);
+
+static struct prof *find_prof(uint macro, uint_t line, char c1, char c2);
+
+static uint64_t get_nsecs(void);
+
+static void grow_prof(void);
+
+static void print_prof(void);
+
+
+///
+///  @brief    Compare two profiles for qsort(), so that the most expensive
+///            commands are listed first.
+///
+///  @returns  -1, 0, or 1.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int compare_prof(const void *p1, const void *p2)
+{
+    const struct prof *a = *(const struct prof * const *)p1;
+    const struct prof *b = *(const struct prof * const *)p2;
+
+    if (a->nsecs != b->nsecs)
+    {
+        return (a->nsecs > b->nsecs) ? -1 : 1;
+    }
+    else if (a->count != b->count)
+    {
+        return (a->count > b->count) ? -1 : 1;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+
+///
+///  @brief    Execute E? command: profile commands.
+///
+///             E? -> Type profile of commands executed.
+///            nE? -> Clear profile and start profiling if n is non-zero, and
+///                   also type profile at exit if n is negative.
+///            0E? -> Stop profiling.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void exec_E_quest(struct cmd *cmd)
+{
+    assert(cmd != NULL);
+
+    if (!cmd->n_set)
+    {
+        print_prof();
+    }
+    else if (cmd->n_arg == 0)
+    {
+        f.profile = false;
+    }
+    else
+    {
+        if (prof.table != NULL)
+        {
+            memset(prof.table, NUL, prof.size * sizeof(*prof.table));
+        }
+
+        prof.count  = 0;
+        prof.report = (cmd->n_arg < 0);
+        f.profile   = true;
+    }
+}
+
+
+///
+///  @brief    Execute command and add its cost to its profile.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void exec_prof(void (*exec)(struct cmd *cmd), struct cmd *cmd)
+{
+    assert(exec != NULL);
+    assert(cmd != NULL);
+
+    // Save everything we need before executing the command, since it can
+    // change the line number (e.g., for loops) or the command block.
+
+    struct prof_count start = prof_count;
+    uint macro  = prof.macro;
+    uint_t line = cmd_line;
+    char c1     = cmd->c1;
+    char c2     = cmd->c2;
+    uint64_t nsecs = get_nsecs();
+
+    (*exec)(cmd);
+
+    nsecs = get_nsecs() - nsecs;
+
+    struct prof *p = find_prof(macro, line, c1, c2);
+
+    ++p->count;
+
+    p->nsecs    += nsecs;
+    p->inserted += (uint_t)(prof_count.inserted - start.inserted);
+    p->deleted  += (uint_t)(prof_count.deleted  - start.deleted);
+    p->read     += (uint_t)(prof_count.read     - start.read);
+    p->written  += (uint_t)(prof_count.written  - start.written);
+}
+
+
+///
+///  @brief    Type profile if requested, and free profile table.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void exit_prof(void)
+{
+    if (prof.report)
+    {
+        print_prof();
+    }
+
+    free_mem(&prof.table);
+
+    prof.size  = 0;
+    prof.count = 0;
+    f.profile  = false;
+}
+
+
+///
+///  @brief    Find profile for command, adding it to the table if necessary.
+///
+///  @returns  Pointer to profile.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct prof *find_prof(uint macro, uint_t line, char c1, char c2)
+{
+    if ((prof.count + 1) * 2 > prof.size)
+    {
+        grow_prof();
+    }
+
+    // Command characters are treated as case-insensitive.
+
+    c1 = (char)toupper(c1);
+    c2 = (char)toupper(c2);
+
+    uint mask = prof.size - 1;
+    uint i = (macro * 31 + (uint)line * 131 + (uchar)c1 * 7 + (uchar)c2) & mask;
+    struct prof *p;
+
+    while ((p = &prof.table[i])->count != 0)
+    {
+        if (p->macro == macro && p->line == line && p->c1 == c1 && p->c2 == c2)
+        {
+            return p;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    p->macro = macro;
+    p->line  = line;
+    p->c1    = c1;
+    p->c2    = c2;
+
+    ++prof.count;
+
+    return p;
+}
+
+
+///
+///  @brief    Get current time from a monotonic clock.
+///
+///  @returns  Time in nanoseconds.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t get_nsecs(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+///
+///  @brief    Double the size of the profile table.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void grow_prof(void)
+{
+    struct prof *old = prof.table;
+    uint oldsize = prof.size;
+
+    prof.size  = (oldsize == 0) ? PROF_MIN : oldsize * 2;
+    prof.table = alloc_mem((uint_t)(prof.size * sizeof(*prof.table)));
+    prof.count = 0;
+
+    for (uint i = 0; i < oldsize; ++i)
+    {
+        if (old[i].count != 0)
+        {
+            struct prof *p = find_prof(old[i].macro, old[i].line, old[i].c1,
+                                       old[i].c2);
+
+            *p = old[i];
+        }
+    }
+
+    if (old != NULL)
+    {
+        free_mem(&old);
+    }
+}
+
+
+///
+///  @brief    Type profile of commands executed, most expensive first. Time
+///            for M and EI commands includes the commands in the macro.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void print_prof(void)
+{
+    if (prof.count == 0)
+    {
+        return;
+    }
+
+    struct prof **list = alloc_mem((uint_t)(prof.count * sizeof(*list)));
+    uint n = 0;
+
+    for (uint i = 0; i < prof.size; ++i)
+    {
+        if (prof.table[i].count != 0)
+        {
+            list[n++] = &prof.table[i];
+        }
+    }
+
+    qsort(list, (size_t)n, sizeof(*list), compare_prof);
+
+    tprint("%-8s %6s %-4s %12s %12s %12s %12s %12s %12s\n", "Macro", "Line",
+           "Cmd", "Count", "Time (ms)", "Inserted", "Deleted", "Read",
+           "Written");
+
+    for (uint i = 0; i < n; ++i)
+    {
+        const struct prof *p = list[i];
+        char macro[4] = { NUL };
+        char name[4] = { NUL };
+
+        if (p->macro == PROF_CMD)
+        {
+            strcpy(macro, "cmd");
+        }
+        else if (p->macro == PROF_EI)
+        {
+            strcpy(macro, "EI");
+        }
+        else if (p->macro == PROF_STR)
+        {
+            strcpy(macro, "str");
+        }
+        else if (p->macro & PROF_LOCAL)
+        {
+            sprintf(macro, "M.%c", (char)p->macro);
+        }
+        else
+        {
+            sprintf(macro, "M%c", (char)p->macro);
+        }
+
+        if (iscntrl(p->c1))
+        {
+            sprintf(name, "^%c", p->c1 + 'A' - 1);
+        }
+        else
+        {
+            sprintf(name, "%c%c", p->c1, p->c2);
+        }
+
+        tprint("%-8s %6lu %-4s %12llu %12.3f %12llu %12llu %12llu %12llu\n",
+               macro, (ulong)p->line, name, (unsigned long long)p->count,
+               (double)p->nsecs / 1e6, (unsigned long long)p->inserted,
+               (unsigned long long)p->deleted, (unsigned long long)p->read,
+               (unsigned long long)p->written);
+    }
+
+    free_mem(&list);
+}
+
+
+///
+///  @brief    Restore ID of macro being executed.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void reset_prof(uint macro)
+{
+    prof.macro = macro;
+}
+
+
+///
+///  @brief    Scan E? command.
+///
+///  @returns  false (command is not an operand or operator).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool scan_E_quest(struct cmd *cmd)
+{
+    assert(cmd != NULL);
+
+    scan_x(cmd);
+    confirm(cmd, NO_M, NO_COLON, NO_DCOLON, NO_ATSIGN);
+
+    return false;
+}
+
+
+///
+///  @brief    Set ID of macro about to be executed, which is PROF_CMD for the
+///            command string, PROF_EI for an EI command file, PROF_STR for an
+///            internal command string (e.g., for a mapped key), or else the
+///            name of the Q-register being executed, OR'd with PROF_LOCAL if
+///            it is a local Q-register.
+///
+///  @returns  ID of previous macro (to be restored with reset_prof()).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+uint set_prof(const struct cmd *cmd)
+{
+    uint macro = prof.macro;
+
+    if (cmd == NULL)
+    {
+        prof.macro = PROF_STR;
+    }
+    else if (toupper(cmd->c1) == 'M')
+    {
+        prof.macro = (uchar)toupper(cmd->qname);
+
+        if (cmd->qlocal)
+        {
+            prof.macro |= PROF_LOCAL;
+        }
+    }
+    else
+    {
+        prof.macro = PROF_EI;
+    }
+
+    return macro;
+}
+
+#endif
@@ -29,6 +29,7 @@
 
 #include "teco.h"
 #include "eflags.h"                 // Needed for confirm()
+#include "errors.h"
 #include "exec.h"
 #include "file.h"
 
@@ -54,6 +55,14 @@ void exec_EF(struct cmd *cmd)
 
     struct ofile *ofile = &ofiles[ostream];
 
+    // Output is buffered, so this is where we find out about any errors that
+    // occurred while writing the file.
+
+    if (ofile->fp != NULL && (fflush(ofile->fp) != 0 || ferror(ofile->fp)))
+    {
+        throw(E_ERR, ofile->name);      // General error
+    }
+
     rename_output(ofile);               // Handle any required file renaming
 
     close_output(ostream);
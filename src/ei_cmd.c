@@ -112,6 +112,8 @@ void exec_EI(struct cmd *cmd)
                 if (ei_macro.size != 0)
                 {
                     exec_macro(&ei_macro, cmd);
+
+                    discard_tokens(ei_data);
                 }
 
                 return;
@@ -129,6 +131,7 @@ void exec_EI(struct cmd *cmd)
         {
             ei_command = (ei_command == &ei_secondary) ? &ei_primary : &ei_secondary;
 
+            discard_tokens(ei_command->data);
             free_mem(&ei_command->data); // Free up previous data
 
             if ((ifile = open_command(name, stream, cmd->colon, &ei_command->size)) != NULL)
@@ -173,6 +176,7 @@ bool read_EI(void)
             reset_cbuf();
         }
 
+        discard_tokens(ei_command->data);
         free_mem(&ei_command->data);    // Yes, free it up
 
         ei_command = (ei_command == &ei_secondary) ? &ei_primary : &ei_secondary;
@@ -200,6 +204,9 @@ bool read_EI(void)
 
 void reset_indirect(void)
 {
+    discard_tokens(ei_primary.data);
+    discard_tokens(ei_secondary.data);
+
     free_mem(&ei_primary.data);
     free_mem(&ei_secondary.data);
 
@@ -136,6 +136,8 @@ void exec_EM(struct cmd *cmd)
 
     squish_cmd(cmd->m_arg);             // Squish the command string
 
+    discard_tokens(qreg->text.data);    // Q-register isn't being executed
+
     qreg->text.pos = saved_pos;
     cbuf = saved_cbuf;                  // Restore previous command string
 }
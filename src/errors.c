@@ -377,6 +377,15 @@ noreturn void (throw)(int error, ...)
 #endif
 
 {
+    // If we're scanning ahead of where we're executing commands, then the
+    // caller just needs to know that there was an error, which we will then
+    // report if and when we execute the command that caused it.
+
+    if (jump_scan != NULL)
+    {
+        longjmp(*jump_scan, 1);
+    }
+
     const char *file_str = NULL;
     const char *err_str;
     char err_buf[ERR_BUF_SIZE];
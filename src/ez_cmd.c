@@ -29,6 +29,7 @@
 #include <stdio.h>
 
 #include "teco.h"
+#include "editbuf.h"
 #include "errors.h"
 #include "estack.h"
 #include "exec.h"
@@ -112,6 +113,8 @@ void exec_EZ(struct cmd *cmd)
 
     ez.len = pos;                       // Length = total bytes read
 
+    check_edit();                       // Command may have changed input file
+
     if (cmd->colon)
     {
         store_val(SUCCESS);
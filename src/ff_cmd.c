@@ -31,6 +31,7 @@
 
 #include "teco.h"
 #include "ascii.h"
+#include "cmdbuf.h"
 #include "eflags.h"
 #include "errors.h"
 #include "estack.h"
@@ -75,6 +76,8 @@ void exec_ctrl_F(uint i)
 
         exec_macro(&buf, NULL);
 
+        discard_tokens(buf.data);
+
         f.e0.exec = exec;
     }
 }
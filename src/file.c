@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>                  // for posix_fadvise()
 #include <limits.h>                 //lint !e451
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,6 +42,7 @@
 #include "errors.h"
 #include "file.h"
 #include "page.h"
+#include "profile.h"
 
 
 struct ifile ifiles[IFILE_MAX];         ///< Input file descriptors
@@ -53,10 +55,14 @@ uint ostream = OFILE_PRIMARY;           ///< Current output stream
 
 char last_file[PATH_MAX] = { NUL };     ///< Last opened file
 
+#define OUTPUT_BUF  (KB * 64)           ///< Buffer size for output files
+
 // Local functions
 
 static char *make_canonical(const char *name);
 
+static noreturn void write_error(FILE *fp);
+
 
 ///
 ///  @brief    Close input file.
@@ -363,12 +369,23 @@ struct ifile *open_input(const char *name, uint stream, bool colon)
         throw(E_ERR, name);             // General error
     }
 
-    ifile->name = alloc_mem((uint_t)strlen(name) + 1);
-    ifile->size = (uint_t)file_stat.st_size;
-    ifile->LF   = false;                // No LF characters read yet
+    ifile->name  = alloc_mem((uint_t)strlen(name) + 1);
+    ifile->size  = (uint_t)file_stat.st_size;
+    ifile->LF    = false;               // No LF characters read yet
+    ifile->ahead = 0;                   // Nothing read ahead yet
 
     strcpy(ifile->name, name);
 
+#if     defined(POSIX_FADV_SEQUENTIAL)
+
+    // Tell the OS that we read files from start to end, so that it can use a
+    // larger read-ahead window.
+
+    (void)posix_fadvise(fileno(ifile->fp), (off_t)0, (off_t)0,
+                        POSIX_FADV_SEQUENTIAL);
+
+#endif
+
     if (stream == IFILE_PRIMARY || stream == IFILE_SECONDARY)
     {
         write_memory(ifile->name);
@@ -462,12 +479,19 @@ struct ofile *open_output(const char *name, uint stream, bool colon, int c)
         ofile->backup = true;           //  and say we want a backup file
     }
 
-    if (f.ed.nobuffer || c == 'L')
+    if (f.ed.nobuffer)
     {
         // Write output immediately and do not buffer.
 
         setvbuf(ofile->fp, NULL, _IONBF, 0uL);
     }
+    else
+    {
+        // Use a large buffer, so that pages are written with few system calls.
+        // Log files are flushed along with terminal output.
+
+        setvbuf(ofile->fp, NULL, _IOFBF, (size_t)OUTPUT_BUF);
+    }
 
     return ofile;
 }
@@ -537,3 +561,93 @@ void set_last(const char *name)
         }
     }
 }
+
+
+///
+///  @brief    Issue error for output file that we couldn't write to.
+///
+///  @returns  n/a (throws error).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static noreturn void write_error(FILE *fp)
+{
+    assert(fp != NULL);
+
+    for (uint i = 0; i < OFILE_MAX; ++i)
+    {
+        if (ofiles[i].fp == fp)
+        {
+            throw(E_ERR, ofiles[i].name); // General error
+        }
+    }
+
+    throw(E_ERR, NULL);                 // General error
+}
+
+
+///
+///  @brief    Write text to output file, adding a CR before any LF that isn't
+///            already preceded by one if CR_out is set. Rather than writing
+///            one character at a time, we write each run of text between the
+///            added CRs directly from the caller's buffer, so no copy of the
+///            text is needed. Since the text may be written in pieces, the
+///            caller supplies the last character written by any previous call
+///            (or NUL for the first call). Any write error is reported right
+///            away, so that we don't discard text that wasn't written.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void write_text(FILE *fp, const char *text, uint_t nbytes, bool CR_out,
+                char *last)
+{
+    assert(fp != NULL);
+    assert(text != NULL || nbytes == 0);
+    assert(last != NULL);
+
+    if (nbytes == 0)
+    {
+        return;
+    }
+
+    const char *start = text;           // Start of next run to write
+    const char *end   = text + nbytes;
+
+    if (CR_out)
+    {
+        const char *p = text;
+
+        while ((p = memchr(p, LF, (size_t)(end - p))) != NULL)
+        {
+            char prev = (p == text) ? *last : p[-1];
+
+            if (prev != CR)
+            {
+                size_t len = (size_t)(p - start);
+
+                if (fwrite(start, 1uL, len, fp) != len || fputc(CR, fp) == EOF)
+                {
+                    write_error(fp);
+                }
+
+                start = p;              // LF starts next run
+            }
+
+            ++p;
+        }
+    }
+
+    size_t len = (size_t)(end - start);
+
+    if (fwrite(start, 1uL, len, fp) != len)
+    {
+        write_error(fp);
+    }
+
+    *last = end[-1];
+
+    count_prof(written, nbytes);
+}
+
@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>                  // for posix_fadvise()
 #include <glob.h>                   // for glob()
 #include <limits.h>                 //lint !e451
 #include <stdio.h>
@@ -43,6 +44,8 @@
 #define TEC_TYPE    ".tec"              ///< Command file extension ("source")
 #define TCO_TYPE    ".tco"              ///< Command file extension ("compiled")
 
+#define READ_AHEAD_MIN  (KB * 256)      ///< Minimum read-ahead for input files
+
 static glob_t pglob;                    ///< Saved list of wildcard files
 
 static char **next_file;                ///< Next file in pglob
@@ -315,6 +318,55 @@ static uint_t parse_file(const char *file, char *dir, char *base)
 }
 
 
+///
+///  @brief    Ask the operating system to start reading the next page of an
+///            input file in the background, so that it is already in memory
+///            when we need it. Since the next page is likely to be about the
+///            same size as the one just read, we ask for that much (but not
+///            less than a minimum size). This lets P, Y, and N commands scan
+///            or edit one page while the next one is being read. We ask for
+///            two pages at a time, and don't ask again until the next page
+///            goes past what we already asked for, so that files with many
+///            small pages don't need a system call for each page. The request
+///            is only advisory, so any errors are ignored.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void read_ahead(struct ifile *ifile, uint_t nbytes)
+{
+    assert(ifile != NULL);
+
+#if     defined(POSIX_FADV_WILLNEED)
+
+    if (ifile->fp == NULL || feof(ifile->fp))
+    {
+        return;
+    }
+
+    off_t pos = ftello(ifile->fp);
+
+    if (nbytes < READ_AHEAD_MIN)
+    {
+        nbytes = READ_AHEAD_MIN;
+    }
+
+    if (pos != -1 && pos + (off_t)nbytes > ifile->ahead)
+    {
+        off_t start = pos > ifile->ahead ? pos : ifile->ahead;
+
+        ifile->ahead = pos + (off_t)nbytes * 2;
+
+        (void)posix_fadvise(fileno(ifile->fp), start, ifile->ahead - start,
+                            POSIX_FADV_WILLNEED);
+    }
+
+#endif
+
+}
+
+
 ///
 ///  @brief    Read file specification from memory file.
 ///
@@ -37,6 +37,7 @@
 #include "estack.h"
 #include "exec.h"
 #include "file.h"
+#include "search.h"
 
 
 // Local functions
@@ -226,6 +227,7 @@ void exec_E3(struct cmd *cmd)
     f.e3.utf8    = e3.utf8;
     f.e3.keepNUL = e3.keepNUL;
     f.e3.CR_type = e3.CR_type;
+    f.e3.mmap    = e3.mmap;
 }
 
 
@@ -473,9 +475,45 @@ bool scan_EJ(struct cmd *cmd)
         n = (int)cmd->n_arg;            // Get whatever operand we can
     }
 
-    n = teco_env(n, cmd->colon);        // Do the system-dependent part
+    if (n == -6)                        // m,-6EJ - memory statistics
+    {
+        int_t type = cmd->m_set ? cmd->m_arg : MEM_ALL;
+
+        if (f.e0.skip)                  // m may not be valid if skipping
+        {
+            type = MEM_ALL;
+        }
+        else if (type < MEM_ALL || type >= MEM_MAX)
+        {
+            throw(E_NYI);               // No such memory type
+        }
+
+        store_val((int_t)stat_mem((enum mem_type)type, cmd->colon));
+
+        cmd->m_set = false;
+    }
+    else if (n == -7)                   // m,-7EJ - no. of search threads
+    {
+        if (cmd->m_set && !f.e0.skip)
+        {
+            if (cmd->m_arg < 0)
+            {
+                throw(E_NYI);           // Can't have negative threads
+            }
+
+            set_threads((uint)cmd->m_arg);
+        }
 
-    store_val((int_t)n);                // Now return the result
+        cmd->m_set = false;
+
+        store_val((int_t)get_threads());
+    }
+    else
+    {
+        n = teco_env(n, cmd->colon);    // Do the system-dependent part
+
+        store_val((int_t)n);            // Now return the result
+    }
 
     cmd->colon = false;
 
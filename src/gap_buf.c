@@ -32,15 +32,25 @@
 
 #endif
 
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "teco.h"
 #include "ascii.h"
+#include "display.h"
 #include "editbuf.h"
 #include "eflags.h"
+#include "errors.h"
 #include "page.h"
+#include "profile.h"
 
 
 #if     !defined(EDIT_MAX)
@@ -88,8 +98,41 @@
 #endif
 #endif
 
+//  With virtual memory paging and a 64-bit address space, we reserve address
+//  space for the maximum buffer size, so that the buffer never has to be
+//  reallocated (and copied) as it grows: only the text after the gap has to
+//  be moved. The kernel only allocates memory for the pages that we use.
+
+#if     defined(PAGE_VM) && SIZE_MAX > UINT32_MAX
+
+#define EDIT_RESERVE                ///< Reserve address space for buffer
+
+#endif
+
 #define EDIT_MIN    (KB)            ///< Minimum size is 1 KB
 
+#define APPEND_LINE (256)           ///< Initial read size for single line
+
+#define APPEND_MIN  (KB * 4)        ///< Initial read size for page
+
+#define APPEND_MAX  (KB * 256)      ///< Maximum read size
+
+#define LINE_BLOCK  (KB * 4)        ///< Block size for line index
+
+///  @struct  scan
+///
+///  @brief   Characters that need special handling when appending a file,
+///           along with the position of the next occurrence of each one.
+
+struct scan
+{
+    bool single;                ///< true if reading a single line
+    bool valid;                 ///< true if positions below are valid
+    uint count;                 ///< No. of special characters
+    uchar chr[5];               ///< Special characters
+    uint_t next[5];             ///< Position of next occurrence
+};
+
 
 ///  @var     eb
 ///
@@ -103,10 +146,24 @@ static struct
     uint_t gap;                 ///< No. of bytes in gap
     const uint_t min;           ///< Minimum buffer size (fixed)
     const uint_t max;           ///< Maximum buffer size (fixed)
+    bool mapped;                ///< Buffer is a private file mapping
+    bool reserved;              ///< Buffer is in reserved address space
+    uint_t heap;                ///< Size to use when mapping is released
+    uint_t *delims;             ///< No. of delimiters in each block
+    uint_t *lines;              ///< Line index (see build_lines())
+    uint_t nblocks;             ///< No. of blocks in line index
+    uint_t stale_start;         ///< First block with out-of-date count
+    uint_t stale_end;           ///< Block after last out-of-date count
+    bool indexed;               ///< true if line index is up to date
     struct edit t;              ///< Read/write copies of public variables
 } eb =
 {
     .buf    = NULL,
+    .delims = NULL,
+    .lines  = NULL,
+    .mapped = false,
+    .reserved = false,
+    .heap   = EDIT_INIT,
     .min    = EDIT_MIN,
     .max    = EDIT_MAX,
     .left   = 0,
@@ -130,27 +187,189 @@ static struct
 
 const struct edit *t = &eb.t;       ///< Read-only pointers to public variables
 
+///  @var     map
+///
+///  @brief   Information about file mapped into edit buffer. Since a private
+///           mapping only copies the pages that we modify, the buffer would
+///           change if another process wrote to the file, and accessing any
+///           part of it that was truncated would raise SIGBUS. So we keep
+///           enough information to detect either of those changes.
+
+static struct
+{
+    int fd;                     ///< Duplicate descriptor for file
+    char *name;                 ///< File name
+    off_t size;                 ///< File size when mapped
+    struct timespec mtime;      ///< File modification time when mapped
+    long pagesize;              ///< System page size
+    volatile sig_atomic_t lost; ///< true if we couldn't read part of file
+    struct sigaction old_act;   ///< Saved action for SIGBUS signal
+} map =
+{
+    .fd   = -1,
+    .name = NULL,
+    .lost = false,
+};
+
 
 // Local functions
 
+static int add_lines(uint_t start, uint_t nbytes, int sign);
+
+static uchar *alloc_edit(uint_t size);
+
+static void build_lines(void);
+
+static void bus_handler(int signum, siginfo_t *info, void *context);
+
+static void check_lines(void);
+
+static uint_t count_blocks(uint_t block);
+
+static int count_delims(const uchar *p, uint_t nbytes);
+
+static uint_t count_lines(int_t pos);
+
+static void count_stale(uint_t start, uint_t end);
+
+static uint_t count_text(uint_t start, uint_t end);
+
 static void end_insert(uint_t nbytes);
 
+static void end_map(void);
+
+static int_t find_line(uint_t n);
+
+static void first_LF(struct scan *scan, struct ifile *ifile, bool crlf);
+
+static void free_edit(void);
+
+static bool grow_gap(void);
+
+static void init_scan(struct scan *scan, const struct ifile *ifile, bool single);
+
+static bool map_edit(struct ifile *ifile);
+
+static void move_text(uint_t dst, uint_t src, uint_t nbytes);
+
 static int_t next_line(uint_t nlines);
 
+static uint_t next_special(struct scan *scan, const uchar *buf, uint_t pos,
+                           uint_t end);
+
 static int_t prev_line(uint_t nlines);
 
 static void reset_edit(void);
 
+#if     defined(EDIT_RESERVE)
+
+static void resize_edit(uint_t size);
+
+#endif
+
 static void shift_left(uint_t nbytes);
 
 static void shift_right(uint_t nbytes);
 
 static bool start_insert(uint_t size);
 
+static uint_t sum_lines(uint_t block);
+
+static void unmap_edit(uint_t size);
+
+
+///
+///  @brief    Add or subtract delimiters in a range of the buffer from the line
+///            index. This is called whenever text is stored in the gap, or is
+///            removed from the buffer. Blocks whose counts are already out of
+///            date are skipped, since they will be counted again anyway.
+///
+///  @returns  No. of delimiters in range.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int add_lines(uint_t start, uint_t nbytes, int sign)
+{
+    if (eb.delims == NULL)              // Index being rebuilt?
+    {
+        return count_delims(eb.buf + start, nbytes);
+    }
+
+    uint_t end = start + nbytes;
+    int ndelims = 0;
+
+    while (start < end)
+    {
+        uint_t block = start / LINE_BLOCK;
+        uint_t next = (block + 1) * LINE_BLOCK;
+
+        if (next > end)
+        {
+            next = end;
+        }
+
+        int n = count_delims(eb.buf + start, next - start);
+
+        if (block < eb.stale_start || block >= eb.stale_end)
+        {
+            eb.delims[block] += (uint_t)(sign * n);
+        }
+
+        ndelims += n;
+
+        start = next;
+    }
+
+    if (ndelims != 0)
+    {
+        eb.indexed = false;
+    }
+
+    return ndelims;
+}
+
+
+///
+///  @brief    Allocate memory for edit buffer, reserving address space for the
+///            maximum buffer size if we can.
+///
+///  @returns  Pointer to buffer.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uchar *alloc_edit(uint_t size)
+{
+
+#if     defined(EDIT_RESERVE)
+
+    uchar *buf = mmap(NULL, (size_t)eb.max, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (buf != MAP_FAILED)
+    {
+        eb.reserved = true;
+
+        track_mem(MEM_EDIT, (uint_t)0, size);
+
+        return buf;
+    }
+
+#endif
+
+    eb.reserved = false;
+
+    return alloc_type(size, MEM_EDIT);
+}
+
 
 ///
 ///  @brief    Append to edit buffer. Similar to insert_edit(), but adds an
-///            entire file to the buffer.
+///            entire file to the buffer. Rather than reading the file one
+///            character at a time, we read blocks directly into the gap, and
+///            then compact them in place, using memchr() to locate the few
+///            characters (CR, FF, NUL, and possibly LF and VT) that need any
+///            special handling. Any data we read past the end of the page or
+///            line is returned to the input stream before we return.
 ///
 ///  @returns  true if we can continue reading lines, else false (because we
 ///            encountered either an EOF or a FF).
@@ -160,93 +379,316 @@ static bool start_insert(uint_t size);
 bool append_edit(struct ifile *ifile, bool single)
 {
     assert(ifile != NULL);
+    assert(eb.t.dot == eb.t.Z);         // We only ever append at end of buffer
 
-    int c;
-    int next;
-    uchar *p = eb.buf + eb.left;
-    int ndelims = 0;
+    if (f.e3.mmap && !single && eb.t.Z == 0 && map_edit(ifile))
+    {
+        return false;                   // We mapped the entire file
+    }
+
+    if (eb.right != 0)                  // Make sure gap is at end of buffer
+    {
+        shift_left(eb.right);
+    }
 
-    // Read characters until end of file or end of page
+    struct scan scan;
+    uint_t block = single ? APPEND_LINE : APPEND_MIN;
+    uint_t out   = 0;                   // No. of bytes stored in gap
+    uint_t in    = 0;                   // Offset of next input byte in gap
+    uint_t end   = 0;                   // Offset after last input byte in gap
+    bool eof     = false;               // true if we've seen end of file
+    bool more    = false;               // true if we stopped before EOF
 
-    while ((c = fgetc(ifile->fp)) != EOF)
+    init_scan(&scan, ifile, single);
+
+    for (;;)
     {
-        if (c == LF)
+        // Read the next block of data, after first moving any unprocessed
+        // input (which can only be a CR waiting for the following character)
+        // down to the end of the data we've already stored.
+
+        if (in == end || (in == end - 1 && eb.buf[eb.left + in] == CR && !eof))
         {
-            if (!ifile->LF)             // First LF?
+            if (in != out)
+            {
+                memmove(eb.buf + eb.left + out, eb.buf + eb.left + in,
+                        (size_t)(end - in));
+
+                end -= in - out;
+                in   = out;
+            }
+
+            scan.valid = false;         // Discard previous memchr() results
+
+            if (!eof && eb.gap == end)  // Any room left in gap?
+            {
+                int c = fgetc(ifile->fp);
+
+                if (c == EOF)
+                {
+                    eof = true;
+                }
+                else
+                {
+                    ungetc(c, ifile->fp);
+
+                    if (!grow_gap())
+                    {
+                        more = true;    // Can't expand, so leave data unread
+
+                        break;
+                    }
+                }
+            }
+
+            if (!eof)
             {
-                ifile->LF = true;
+                uint_t room = eb.gap - end;
+                size_t nbytes;
+
+                if (room > block)
+                {
+                    room = block;
+                }
+
+                nbytes = fread(eb.buf + eb.left + end, 1uL, (size_t)room,
+                               ifile->fp);
+
+                if (nbytes == 0)
+                {
+                    eof = true;
+                }
 
-                if (f.e3.smart)         // In smart mode?
+                end += (uint_t)nbytes;
+
+                // Start with small reads, so that we don't read too much past
+                // a short line or page, but increase the read size for large
+                // pages so that we make as few calls as possible.
+
+                if (block < APPEND_MAX)
                 {
-                    f.e3.CR_in  = false; // Terminate input lines with LF
-                    f.e3.CR_out = false; // Terminate output lines with LF
+                    block *= 2;
                 }
             }
+
+            if (in == end)              // No data left?
+            {
+                break;
+            }
+        }
+
+        uchar *buf = eb.buf + eb.left;
+        uint_t pos = next_special(&scan, buf, in, end);
+
+        // Store ordinary characters up to the next special character.
+
+        if (pos != in)
+        {
+            if (out != in)
+            {
+                memmove(buf + out, buf + in, (size_t)(pos - in));
+            }
+
+            out += pos - in;
+            in   = pos;
+        }
+
+        if (in == end)                  // Need more data?
+        {
+            continue;
         }
-        else if (c == CR)               // Check for CR followed by LF
+
+        int c = buf[in];
+
+        if (c == CR)                    // Check for CR followed by LF
         {
-            if ((next = fgetc(ifile->fp)) != LF)
+            if (in == end - 1 && !eof)  // Wait until we have next character
             {
-                ungetc(next, ifile->fp); // Save non-LF for next read
+                continue;
             }
-            else if (!ifile->LF)        // First LF?
+
+            if (in + 1 < end && buf[in + 1] == LF)
             {
-                ifile->LF = true;
+                ++in;                   // Skip over the CR
 
-                if (f.e3.smart)         // In smart mode?
+                if (!ifile->LF)         // First LF?
                 {
-                    f.e3.CR_in  = true; // Terminate input lines with CR/LF
-                    f.e3.CR_out = true; // Terminate output lines with CR/LF
+                    first_LF(&scan, ifile, (bool)true);
                 }
             }
 
+            ++in;                       // Skip over the LF (or lone CR)
+
             // If input lines can be terminated with CR/LF, then we save
             // both characters; if they can only be terminated with LF,
             // then we ignore the CR.
 
             if (f.e3.CR_in)             // If CR/LF is okay, save CR here
             {
-                *p++ = (uchar)c;
+                if (out + 1 == in)      // No room to store extra byte?
+                {
+                    if (end == eb.gap && !grow_gap())
+                    {
+                        in -= 1;        // Leave CR for next time
+
+                        more = true;
+
+                        break;
+                    }
+
+                    buf = eb.buf + eb.left;
+
+                    memmove(buf + in + 1, buf + in, (size_t)(end - in));
+
+                    ++in;
+                    ++end;
+
+                    scan.valid = false;
+                }
+
+                buf[out++] = CR;
             }
 
-            c = LF;                     // Now save the LF
+            buf[out++] = LF;            // Now save the LF
+
+            if (single)                 // If just appending single line,
+            {
+                more = true;            //  then we're done
+
+                break;
+            }
         }
         else if (c == FF && !f.e3.nopage)
         {
-            ++ndelims;
+            ++in;
 
+            more = true;
             f.ctrl_e = true;            // Flag FF, but don't store it
 
             break;
         }
         else if (c == NUL && !f.e3.keepNUL)
         {
-            continue;
+            ++in;                       // Discard NUL
         }
+        else                            // Must be LF, VT, or FF
+        {
+            if (c == LF && !ifile->LF)  // First LF?
+            {
+                first_LF(&scan, ifile, (bool)false);
+            }
 
-        *p++ = (uchar)c;
+            buf[out++] = (uchar)c;
 
-        if (isdelim(c))
-        {
-            ++ndelims;
+            ++in;
 
-            if (single)                 // If just appending single line,
+            if (single && isdelim(c))   // If just appending single line,
             {
-                break;                  //  then we're done
+                more = true;            //  then we're done
+
+                break;
             }
         }
     }
 
-    eb.t.nlines += ndelims;
+    // If we stopped before reaching the end of the file, then return any
+    // data we read but didn't use to the input stream.
+
+    if (more && fseeko(ifile->fp, -(off_t)(end - in), SEEK_CUR) != 0)
+    {
+        throw(E_ERR, ifile->name);      // General error
+    }
+
+    if (out != 0)
+    {
+        end_insert(out);
+    }
+
+    return more;
+}
+
+
+///
+///  @brief    Set up line index for edit buffer. We keep a count of the line
+///            delimiters in each fixed-size block of the buffer. Since the
+///            blocks are physical rather than logical, inserting or deleting
+///            text only changes the counts for the blocks that are affected.
+///            Moving the gap changes the counts for the blocks that the text
+///            is moved from and to, but we just mark those blocks as stale,
+///            and count them again when we next need the index, so that
+///            moving the gap costs no more than the memmove(). When we need
+///            to find the no. of lines before a position, or the start of a
+///            line, we build a Fenwick tree from the counts, which is then
+///            kept until the next time that the counts change. This allows
+///            those lookups to take logarithmic time, without slowing down
+///            any editing.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void build_lines(void)
+{
+    free_mem(&eb.delims);
+    free_mem(&eb.lines);
+
+    eb.nblocks = (eb.t.size + LINE_BLOCK - 1) / LINE_BLOCK;
+    eb.delims  = alloc_type(eb.nblocks * (uint_t)sizeof(*eb.delims), MEM_EDIT);
+    eb.lines   = alloc_type((eb.nblocks + 1) * (uint_t)sizeof(*eb.lines),
+                            MEM_EDIT);
+    eb.indexed = false;
+    eb.stale_start = eb.stale_end = 0;
+
+    int nlines = 0;
 
-    uint_t nbytes = (uint_t)(p - (eb.buf + eb.left));
+    for (uint_t i = 0; i < eb.nblocks; ++i)
+    {
+        uint_t start = i * LINE_BLOCK;
+        uint_t end = start + LINE_BLOCK;
+
+        if (end > eb.t.size)
+        {
+            end = eb.t.size;
+        }
+
+        eb.delims[i] = count_text(start, end);
+
+        nlines += (int)eb.delims[i];
+    }
+
+    eb.t.nlines = nlines;
+}
+
+
+///
+///  @brief    Handle SIGBUS signal, which we get if we access a part of a
+///            mapped file that another process has truncated. The page we
+///            couldn't read is replaced with an empty one so that the access
+///            can complete, and the loss is reported by check_edit(). Any
+///            other SIGBUS gets its previous action.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
 
-    if (nbytes != 0)
+static void bus_handler(int signum, siginfo_t *info, void *context)
+{
+    uchar *addr = info->si_addr;
+
+    if (eb.mapped && addr >= eb.buf && addr < eb.buf + map.size)
     {
-        end_insert(nbytes);
+        uintptr_t page = (uintptr_t)addr & ~(uintptr_t)(map.pagesize - 1);
+
+        if (mmap((void *)page, (size_t)map.pagesize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+        {
+            map.lost = true;
+
+            return;
+        }
     }
 
-    return (c == EOF) ? false : true;
+    (void)sigaction(SIGBUS, &map.old_act, NULL); // Retry with old action
 }
 
 
@@ -272,72 +714,336 @@ void change_dot(int c)
 
     eb.buf[i] = eb.t.c = (uchar)c;
 
-    f.e0.window = true;                 // Window refresh needed
+    mark_dpy(eb.t.dot, eb.t.dot + 1, (int_t)0, 0);
 }
 
 
 ///
-///  @brief    Delete n chars relative to current position.
+///  @brief    Change text between two absolute positions in place, by calling
+///            a function for the text before the gap and the text after it.
+///            The function may not add or remove any line delimiters, so that
+///            our line counts are not affected.
 ///
 ///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-void delete_edit(int_t nbytes)
+void change_edit(int_t start, int_t end, void (*change)(uchar *text,
+                                                          uint_t nbytes))
 {
-    if (nbytes == 0)
+    assert(change != NULL);
+    assert(start >= eb.t.B && end <= eb.t.Z);
+
+    if (start >= end)
     {
         return;
     }
 
-    if (eb.t.dot == 0 && nbytes == eb.t.Z)    // Killing entire buffer?
+    if ((uint_t)start < eb.left)        // Text before gap
     {
-        kill_edit();
+        uint_t stop = (uint_t)end < eb.left ? (uint_t)end : eb.left;
+
+        (*change)(eb.buf + start, stop - (uint_t)start);
     }
-    else
+
+    if ((uint_t)end > eb.left)          // Text after gap
     {
-        // Buffer is: [left][gap][right], with dot somewhere in [left] or
-        // [right]. We shift things so that dot ends up immediately preceding
-        // [gap]. Then any positive deletion is at the beginning of [right],
-        // and any negative deletion is at the end of [left], which makes it
-        // easy to do the required deletion.
+        uint_t pos = (uint_t)start > eb.left ? (uint_t)start : eb.left;
 
-        if ((uint_t)eb.t.dot < eb.left)
-        {
-            shift_right(eb.left - (uint_t)eb.t.dot);
-        }
-        else if ((uint_t)eb.t.dot > eb.left)
-        {
-            shift_left((uint_t)eb.t.dot - eb.left);
-        }
+        (*change)(eb.buf + eb.gap + pos, (uint_t)end - pos);
+    }
 
-        if (nbytes < 0)                 // Deleting backwards in [left]
-        {
-            nbytes = -nbytes;
+    eb.t.lastc = read_edit(-1);
+    eb.t.c     = read_edit(0);
+    eb.t.nextc = read_edit(1);
 
-            assert(nbytes <= eb.t.dot);
+    mark_dpy(start, end, (int_t)0, 0);
+}
 
-            if (f.e0.display)
-            {
-                int ndelims = 0;
-                uchar *p = eb.buf + eb.left;
 
-                for (int i = 0; i < nbytes; ++i)
-                {
-                    int c = *--p;
+///
+///  @brief    Check that a file mapped into the edit buffer hasn't been changed
+///            or truncated by another process since we mapped it. If it has,
+///            we copy what we have into our own memory, so that the buffer
+///            won't change any further, and issue an error.
+///
+///  @returns  Nothing (error thrown if file changed).
+///
+////////////////////////////////////////////////////////////////////////////////
 
-                    if (isdelim(c))
-                    {
-                        ++ndelims;
-                    }
-                }
+void check_edit(void)
+{
+    if (!eb.mapped)
+    {
+        return;
+    }
 
-                eb.t.nlines -= ndelims;
-                eb.t.line -= ndelims;
-            }
+    struct stat file_stat;
+
+    if (!map.lost && fstat(map.fd, &file_stat) == 0
+        && file_stat.st_size == map.size
+        && file_stat.st_mtim.tv_sec == map.mtime.tv_sec
+        && file_stat.st_mtim.tv_nsec == map.mtime.tv_nsec)
+    {
+        return;
+    }
+
+    char name[PATH_MAX];
+
+    snprintf(name, sizeof(name), "%s", map.name);
+
+    unmap_edit(eb.t.size);
+
+    errno = ESTALE;
+
+    throw(E_ERR, name);                 // File changed while mapped
+}
+
+
+///
+///  @brief    Make sure line index is up to date, rebuilding the Fenwick tree
+///            from the block counts if necessary.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void check_lines(void)
+{
+    if (eb.indexed)
+    {
+        return;
+    }
+
+    for (uint_t i = 1; i <= eb.nblocks; ++i)
+    {
+        eb.lines[i] = eb.delims[i - 1];
+    }
+
+    for (uint_t i = 1; i <= eb.nblocks; ++i)
+    {
+        uint_t parent = i + (i & -i);
+
+        if (parent <= eb.nblocks)
+        {
+            eb.lines[parent] += eb.lines[i];
+        }
+    }
+
+    eb.indexed = true;
+}
+
+
+///
+///  @brief    Count line delimiters in the blocks preceding a given block.
+///            Blocks before any stale blocks are summed from the index, and
+///            blocks after them are found by subtracting the blocks that
+///            follow from the total. Only if the given block is in the middle
+///            of the stale blocks do we have to count any of them again, and
+///            then just the ones on whichever side is shorter.
+///
+///  @returns  No. of delimiters found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t count_blocks(uint_t block)
+{
+    assert(block <= eb.nblocks);
+
+    if (block > eb.stale_start && block < eb.stale_end)
+    {
+        if (block - eb.stale_start <= eb.stale_end - block)
+        {
+            count_stale(eb.stale_start, block);
+        }
+        else
+        {
+            count_stale(block, eb.stale_end);
+        }
+    }
+
+    check_lines();
+
+    uint_t n = sum_lines(block);
+
+    if (eb.stale_start != eb.stale_end && block >= eb.stale_end)
+    {
+        n = (uint_t)eb.t.nlines - (sum_lines(eb.nblocks) - n);
+    }
+
+    return n;
+}
+
+
+///
+///  @brief    Count line delimiters in a block of text. This is written so
+///            that the compiler can vectorize it.
+///
+///  @returns  No. of delimiters found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int count_delims(const uchar *p, uint_t nbytes)
+{
+    uint_t ndelims = 0;
+
+    for (uint_t i = 0; i < nbytes; ++i)
+    {
+        ndelims += (p[i] == LF) | (p[i] == VT) | (p[i] == FF);
+    }
+
+    return (int)ndelims;
+}
+
+
+///
+///  @brief    Count line delimiters preceding a position in the buffer.
+///
+///  @returns  No. of delimiters found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t count_lines(int_t pos)
+{
+    assert(pos >= 0 && pos <= eb.t.Z);
+
+    uint_t end = (uint_t)pos;
+
+    if (end >= eb.left)                 // Is position on right side of gap?
+    {
+        end += eb.gap;                  // Yes, so add bias
+    }
+
+    uint_t block = end / LINE_BLOCK;
+
+    return count_blocks(block) + count_text(block * LINE_BLOCK, end);
+}
+
+
+///
+///  @brief    Count line delimiters again in a range of stale blocks, which
+///            must be at the start or end of the stale blocks.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void count_stale(uint_t start, uint_t end)
+{
+    assert(start == eb.stale_start || end == eb.stale_end);
+
+    for (uint_t i = start; i < end; ++i)
+    {
+        uint_t pos = i * LINE_BLOCK;
+        uint_t next = pos + LINE_BLOCK;
+
+        if (next > eb.t.size)
+        {
+            next = eb.t.size;
+        }
+
+        eb.delims[i] = count_text(pos, next);
+    }
+
+    if (start == eb.stale_start)
+    {
+        eb.stale_start = end;
+    }
+    else
+    {
+        eb.stale_end = start;
+    }
+
+    if (eb.stale_start == eb.stale_end)
+    {
+        eb.stale_start = eb.stale_end = 0;
+    }
+
+    eb.indexed = false;
+}
+
+
+///
+///  @brief    Count line delimiters in a range of the buffer, skipping any part
+///            of the range that is in the gap.
+///
+///  @returns  No. of delimiters found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t count_text(uint_t start, uint_t end)
+{
+    uint_t gap_end = eb.left + eb.gap;
+    int n = 0;
+
+    if (start < eb.left)
+    {
+        uint_t left_end = end < eb.left ? end : eb.left;
+
+        n += count_delims(eb.buf + start, left_end - start);
+    }
+
+    if (end > gap_end)
+    {
+        uint_t right_start = start > gap_end ? start : gap_end;
+
+        n += count_delims(eb.buf + right_start, end - right_start);
+    }
+
+    return (uint_t)n;
+}
+
+
+///
+///  @brief    Delete n chars relative to current position.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void delete_edit(int_t nbytes)
+{
+    if (nbytes == 0)
+    {
+        return;
+    }
+
+    if (eb.t.dot == 0 && nbytes == eb.t.Z)    // Killing entire buffer?
+    {
+        kill_edit();
+    }
+    else
+    {
+        // Buffer is: [left][gap][right], with dot somewhere in [left] or
+        // [right]. We shift things so that dot ends up immediately preceding
+        // [gap]. Then any positive deletion is at the beginning of [right],
+        // and any negative deletion is at the end of [left], which makes it
+        // easy to do the required deletion.
+
+        if ((uint_t)eb.t.dot < eb.left)
+        {
+            shift_right(eb.left - (uint_t)eb.t.dot);
+        }
+        else if ((uint_t)eb.t.dot > eb.left)
+        {
+            shift_left((uint_t)eb.t.dot - eb.left);
+        }
+
+        int ndelims;                    // No. of line delimiters deleted
+
+        if (nbytes < 0)                 // Deleting backwards in [left]
+        {
+            nbytes = -nbytes;
+
+            assert(nbytes <= eb.t.dot);
 
             assert((uint_t)nbytes <= eb.left);
 
+            ndelims = add_lines(eb.left - (uint_t)nbytes, (uint_t)nbytes, -1);
+
+            eb.t.nlines -= ndelims;
+            eb.t.line -= ndelims;
+
             eb.left -= (uint_t)nbytes;
             eb.t.dot -= nbytes;         // Backwards delete affects dot
 
@@ -347,41 +1053,29 @@ void delete_edit(int_t nbytes)
         {
             assert(nbytes <= eb.t.Z - eb.t.dot);
 
-            if (f.e0.display)
-            {
-                int ndelims = 0;
-                uchar *p = eb.buf + eb.left + eb.gap;
-
-                for (int i = 0; i < nbytes; ++i)
-                {
-                    int c = *p++;
-
-                    if (isdelim(c))
-                    {
-                        ++ndelims;
-                    }
-                }
+            assert((uint_t)nbytes <= eb.right);
 
-                eb.t.nlines -= ndelims;
-            }
+            ndelims = add_lines(eb.left + eb.gap, (uint_t)nbytes, -1);
 
-            assert((uint_t)nbytes <= eb.right);
+            eb.t.nlines -= ndelims;
 
             eb.right -= (uint_t)nbytes;
-
-            eb.t.c     = read_edit(0);
-            eb.t.nextc = read_edit(1);
         }
 
         eb.gap += (uint_t)nbytes;       // Increase the gap
         eb.t.Z -= nbytes;               //  and decrease the total
 
+        eb.t.c     = read_edit(0);      // Read these after gap is updated
+        eb.t.nextc = read_edit(1);
+
         int_t prev = prev_line(0);      // Position of start of line
 
         eb.t.pos = eb.t.dot - prev;
         eb.t.len = next_line(1) - prev;
 
-        f.e0.window = true;             // Window refresh needed
+        mark_dpy(eb.t.dot, eb.t.dot, -nbytes, -ndelims);
+
+        count_prof(deleted, nbytes);
     }
 }
 
@@ -397,6 +1091,11 @@ static void end_insert(uint_t nbytes)
 {
     assert(nbytes != 0);
 
+    int ndelims = add_lines(eb.left, nbytes, +1);
+
+    eb.t.nlines += ndelims;
+    eb.t.line   += ndelims;
+
     // Now fix up some variables
 
     eb.left  += nbytes;
@@ -413,184 +1112,700 @@ static void end_insert(uint_t nbytes)
     {
         eb.t.lastc = EOF;
     }
-    else
+    else
+    {
+        eb.t.lastc = eb.buf[eb.left - 1];
+    }
+
+    eb.t.c = read_edit(0);              // Gap may be empty here
+
+    //eb.t.nextc = ...                  // Next character doesn't change
+
+    if (eb.t.Z != 0 && page_count() == 0)
+    {
+        set_page(1);
+    }
+
+    mark_dpy(eb.t.dot - (int_t)nbytes, eb.t.dot, (int_t)nbytes, ndelims);
+
+    count_prof(inserted, nbytes);
+}
+
+
+///
+///  @brief    Release the resources we kept for a mapped file, after it has
+///            been unmapped.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void end_map(void)
+{
+    (void)close(map.fd);
+    (void)sigaction(SIGBUS, &map.old_act, NULL);
+
+    free_mem(&map.name);
+
+    map.fd    = -1;
+    map.lost  = false;
+    eb.mapped = false;
+}
+
+
+///
+///  @brief    Clean up memory before we exit from TECO.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void exit_edit(void)
+{
+    free_mem(&eb.delims);
+    free_mem(&eb.lines);
+
+    if (eb.mapped)
+    {
+        (void)munmap(eb.buf, (size_t)eb.t.size);
+
+        eb.buf = NULL;
+
+        end_map();
+    }
+    else
+    {
+        free_edit();
+    }
+}
+
+
+///
+///  @brief    Find the nth line delimiter in the buffer, using the line index to
+///            find the block that it's in.
+///
+///  @returns  Position following delimiter, or Z if there aren't n delimiters.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int_t find_line(uint_t n)
+{
+    assert(n != 0);
+
+    if (n > (uint_t)eb.t.nlines)
+    {
+        return eb.t.Z;
+    }
+
+    // If there are stale blocks, then we look up the delimiter by the no. of
+    // delimiters in the blocks that precede them, or the no. of delimiters
+    // in the blocks that follow them, unless it's in one of the stale blocks
+    // itself, in which case we have to count all of them again.
+
+    if (eb.stale_start != eb.stale_end)
+    {
+        uint_t before = count_blocks(eb.stale_start);
+        uint_t after  = count_blocks(eb.stale_end);
+
+        if (n > after)
+        {
+            n = n - after + sum_lines(eb.stale_end);
+        }
+        else if (n > before)
+        {
+            count_stale(eb.stale_start, eb.stale_end);
+        }
+    }
+
+    check_lines();
+
+    uint_t block = 0;
+    uint_t step = 1;
+
+    while (step * 2 <= eb.nblocks)
+    {
+        step *= 2;
+    }
+
+    for (; step != 0; step /= 2)
+    {
+        if (block + step <= eb.nblocks && eb.lines[block + step] < n)
+        {
+            block += step;
+            n -= eb.lines[block];
+        }
+    }
+
+    // The delimiter we want is in the block following the one we found.
+
+    uint_t start = block * LINE_BLOCK;
+    uint_t end = start + LINE_BLOCK;
+    uint_t gap_end = eb.left + eb.gap;
+
+    if (end > eb.t.size)
+    {
+        end = eb.t.size;
+    }
+
+    for (uint_t i = start; i < end; ++i)
+    {
+        if (i >= eb.left && i < gap_end) // Skip over the gap
+        {
+            i = gap_end;
+
+            if (i >= end)
+            {
+                break;
+            }
+        }
+
+        if (isdelim(eb.buf[i]) && --n == 0)
+        {
+            return (int_t)(i < eb.left ? i : i - eb.gap) + 1;
+        }
+    }
+
+    // The index can only be wrong if part of a mapped file was truncated
+    // while we were using it, in which case check_edit() issues an error.
+
+    check_edit();
+
+    assert(false);                      // Index is inconsistent
+
+    return eb.t.Z;
+}
+
+
+///
+///  @brief    Handle the first LF read from an input file, which in smart mode
+///            determines how we terminate input and output lines. Since LF
+///            then no longer needs special handling (unless we're reading a
+///            single line), we also update the list of special characters.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void first_LF(struct scan *scan, struct ifile *ifile, bool crlf)
+{
+    assert(scan != NULL);
+    assert(ifile != NULL);
+
+    ifile->LF = true;
+
+    if (f.e3.smart)                     // In smart mode?
+    {
+        f.e3.CR_in  = crlf;             // Terminate input lines w/ CR/LF or LF
+        f.e3.CR_out = crlf;             // Terminate output lines w/ CR/LF or LF
+    }
+
+    init_scan(scan, ifile, scan->single);
+}
+
+
+///
+///  @brief    Free memory for edit buffer.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_edit(void)
+{
+    if (eb.reserved)
+    {
+        (void)munmap(eb.buf, (size_t)eb.max);
+
+        track_mem(MEM_EDIT, eb.t.size, (uint_t)0);
+
+        eb.buf      = NULL;
+        eb.reserved = false;
+    }
+    else
+    {
+        free_mem(&eb.buf);
+    }
+}
+
+
+///
+///  @brief    Increase size of edit buffer by 50%, as for insertions.
+///
+///  @returns  true if buffer was expanded, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool grow_gap(void)
+{
+    uint_t size = (eb.t.size * 3) / 2;
+
+    if (size_edit(size) == 0)
+    {
+        return false;
+    }
+
+    print_size(size);
+
+    return true;
+}
+
+
+///
+///  @brief    Initialize edit buffer. All that we need to do here is allocate
+///            the memory for the buffer, since the rest of the initialization
+///            for the 'eb' and 't' structures is done statically, above.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void init_edit(void)
+{
+    assert(eb.buf == NULL);             // Double initialization is an error
+
+    eb.buf = alloc_edit(eb.t.size);
+
+    build_lines();
+    reset_edit();
+}
+
+
+///
+///  @brief    Initialize list of characters that need special handling when
+///            appending a file. Other characters are just copied.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void init_scan(struct scan *scan, const struct ifile *ifile, bool single)
+{
+    assert(scan != NULL);
+    assert(ifile != NULL);
+
+    uint n = 0;
+
+    scan->chr[n++] = CR;
+
+    if (!f.e3.nopage || single)         // FF is either end of page or line
+    {
+        scan->chr[n++] = FF;
+    }
+
+    if (!f.e3.keepNUL)
+    {
+        scan->chr[n++] = NUL;
+    }
+
+    if (!ifile->LF || single)           // Need to see first LF for smart mode
+    {
+        scan->chr[n++] = LF;
+    }
+
+    if (single)
+    {
+        scan->chr[n++] = VT;
+    }
+
+    scan->single = single;
+    scan->count  = n;
+    scan->valid = false;
+}
+
+
+///
+///  @brief    Insert string in edit buffer.
+///
+///  @returns  true if insert succeeded, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool insert_edit(const char *buf, size_t nbytes)
+{
+    assert(buf != NULL);
+    assert(eb.buf != NULL);             // Error if no edit buffer
+
+    if (!start_insert((uint_t)nbytes))
+    {
+        return false;
+    }
+
+    memcpy(eb.buf + eb.left, buf, nbytes);
+
+    end_insert((uint_t)nbytes);
+
+    return true;                        // Insertion was successful
+}
+
+
+///
+///  @brief    Kill the entire edit buffer.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void kill_edit(void)
+{
+    if (eb.t.Z != 0)                    // Anything in buffer?
+    {
+        count_prof(deleted, eb.t.Z);
+
+        reset_edit();
+
+#if     defined(EDIT_RESERVE)
+
+        // Give any memory we used for a large buffer back to the system.
+        // The buffer size doesn't change, and the kernel will provide new
+        // (zeroed) pages if we use the memory again.
+
+        if (eb.reserved && eb.t.size > EDIT_INIT)
+        {
+            (void)madvise(eb.buf + EDIT_INIT, (size_t)(eb.t.size - EDIT_INIT),
+                          MADV_DONTNEED);
+        }
+
+#endif
+
+        f.e0.window = true;             // Window refresh needed
+    }
+}
+
+
+///
+///  @brief    Return number of bytes between dot and nth line terminator.
+///
+///  @returns  Number of characters relative to dot (can be plus or minus).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+int_t len_edit(int_t n)
+{
+    if (n > 0)
+    {
+        return next_line((uint_t)n) - eb.t.dot;
+    }
+    else
+    {
+        return prev_line((uint_t)-n) - eb.t.dot;
+    }
+}
+
+
+///
+///  @brief    Map input file into memory, instead of reading it, so that it
+///            can be searched or typed out without any copying. The file is
+///            mapped privately, so the kernel copies any page we modify, and
+///            the remainder of the buffer (i.e., the gap) is anonymous memory
+///            that is only allocated when it is used. This is only possible
+///            if the file doesn't need any of the conversions that we do when
+///            reading a file: no page breaks, no NULs to discard, and no CRs
+///            unless they are all part of CR/LF pairs that we would keep.
+///
+///  @returns  true if file was mapped, else false (and nothing was changed).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool map_edit(struct ifile *ifile)
+{
+    assert(ifile != NULL);
+    assert(eb.t.Z == 0);
+
+    struct stat file_stat;
+    int fd = fileno(ifile->fp);
+
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+        file_stat.st_size == 0 || ftello(ifile->fp) != 0)
+    {
+        return false;
+    }
+
+    // Allow the gap to be as large as the file itself, since it doesn't cost
+    // anything until it's actually used.
+
+    uint_t nbytes = (uint_t)file_stat.st_size;
+    uint_t extra  = nbytes < eb.t.size ? eb.t.size : nbytes;
+
+    if ((off_t)nbytes != file_stat.st_size || nbytes >= eb.max)
+    {
+        return false;
+    }
+    else if (extra > eb.max - nbytes)
+    {
+        extra = eb.max - nbytes;
+    }
+
+    uint_t size = nbytes + extra;
+    uchar *buf = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (buf == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (mmap(buf, (size_t)nbytes, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        (void)munmap(buf, (size_t)size);
+
+        return false;
+    }
+
+    // Now verify that the file contents can be used exactly as they are.
+
+    const uchar *LF_pos = memchr(buf, LF, (size_t)nbytes);
+    const uchar *CR_pos = memchr(buf, CR, (size_t)nbytes);
+    bool CR_in = f.e3.CR_in;
+
+    if (f.e3.smart && LF_pos != NULL)
+    {
+        CR_in = (LF_pos != buf && LF_pos[-1] == CR);
+    }
+
+    bool okay = (f.e3.nopage  || memchr(buf, FF,  (size_t)nbytes) == NULL)
+             && (f.e3.keepNUL || memchr(buf, NUL, (size_t)nbytes) == NULL)
+             && (CR_pos == NULL || CR_in);
+
+    while (okay && CR_pos != NULL)
+    {
+        uint_t pos = (uint_t)(CR_pos - buf) + 1;
+
+        if (pos == nbytes || buf[pos] != LF)
+        {
+            okay = false;               // Lone CR would be translated
+        }
+        else
+        {
+            CR_pos = memchr(buf + pos, CR, (size_t)(nbytes - pos));
+        }
+    }
+
+    if (!okay)
+    {
+        (void)munmap(buf, (size_t)size);
+
+        return false;
+    }
+
+    if (LF_pos != NULL && !ifile->LF)
+    {
+        ifile->LF = true;
+
+        if (f.e3.smart)
+        {
+            f.e3.CR_in  = CR_in;
+            f.e3.CR_out = CR_in;
+        }
+    }
+
+    // Make sure a subsequent Y or A sees the end of the file, and keep our
+    // own descriptor so that we can tell if the file changes.
+
+    if (fseeko(ifile->fp, (off_t)0, SEEK_END) != 0
+        || (map.fd = dup(fd)) == -1)
     {
-        eb.t.lastc = eb.buf[eb.left - 1];
+        (void)munmap(buf, (size_t)size);
+
+        throw(E_ERR, ifile->name);      // General error
     }
 
-    eb.t.c = eb.buf[eb.left];
+    (void)fgetc(ifile->fp);
 
-    //eb.t.nextc = ...                  // Next character doesn't change
+    struct sigaction sa;
 
-    if (eb.t.Z != 0 && page_count() == 0)
-    {
-        set_page(1);
-    }
+    sa.sa_sigaction = bus_handler;
+    sa.sa_flags     = SA_SIGINFO;
 
-    f.e0.window = true;                 // Window refresh needed
-}
+    sigemptyset(&sa.sa_mask);
 
+    (void)sigaction(SIGBUS, &sa, &map.old_act);
 
-///
-///  @brief    Clean up memory before we exit from TECO.
-///
-///  @returns  Nothing.
-///
-////////////////////////////////////////////////////////////////////////////////
+    map.name     = alloc_mem((uint_t)strlen(ifile->name) + 1);
+    map.size     = file_stat.st_size;
+    map.mtime    = file_stat.st_mtim;
+    map.pagesize = sysconf(_SC_PAGESIZE);
+    map.lost     = false;
 
-void exit_edit(void)
-{
-    free_mem(&eb.buf);
+    strcpy(map.name, ifile->name);
+
+    // Replace our (empty) buffer with the mapped file.
+
+    eb.heap = eb.t.size;
+
+    free_edit();
+
+    eb.buf      = buf;
+    eb.mapped   = true;
+    eb.t.size   = size;
+    eb.left     = 0;
+    eb.right    = 0;
+    eb.gap      = size;
+
+    build_lines();
+    end_insert(nbytes);
+
+    return true;
 }
 
 
 ///
-///  @brief    Initialize edit buffer. All that we need to do here is allocate
-///            the memory for the buffer, since the rest of the initialization
-///            for the 'eb' and 't' structures is done statically, above.
+///  @brief    Move dot to a relative position.
 ///
 ///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-void init_edit(void)
+void move_dot(int_t delta)
 {
-    assert(eb.buf == NULL);             // Double initialization is an error
-
-    eb.buf = alloc_mem(eb.t.size);
-
-    reset_edit();
+    set_dot(eb.t.dot + delta);
 }
 
 
 ///
-///  @brief    Insert string in edit buffer.
+///  @brief    Move text from one side of the gap to the other, and update the
+///            line index to match.
 ///
-///  @returns  true if insert succeeded, else false.
+///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-bool insert_edit(const char *buf, size_t nbytes)
+static void move_text(uint_t dst, uint_t src, uint_t nbytes)
 {
-    assert(buf != NULL);
-    assert(eb.buf != NULL);             // Error if no edit buffer
-
-    if (!start_insert((uint_t)nbytes))
+    if (nbytes == 0)
     {
-        return false;
+        return;
     }
 
-    memcpy(eb.buf + eb.left, buf, nbytes);
+    memmove(eb.buf + dst, eb.buf + src, (size_t)nbytes);
+
+    uint_t start = (dst < src ? dst : src) / LINE_BLOCK;
+    uint_t end = ((dst > src ? dst : src) + nbytes - 1) / LINE_BLOCK + 1;
 
-    if (f.e0.display)
+    if (eb.delims == NULL || start + 1 == end) // Text stayed in same block?
     {
-        int ndelims = 0;
-        const char *p = buf;
+        return;
+    }
 
-        for (uint i = 0; i < nbytes; ++i)
-        {
-            int c = *p++;
+    // Rather than count the delimiters in the text we moved, we mark the
+    // blocks it was moved from and to (and any blocks in the gap between
+    // them) as stale, and let count_blocks() count them if and when we need
+    // to look up a line. Most moves are followed by more edits, not lookups.
 
-            if (isdelim(c))
-            {
-                ++ndelims;
-            }
+    if (eb.stale_start == eb.stale_end)
+    {
+        eb.stale_start = start;
+        eb.stale_end   = end;
+    }
+    else
+    {
+        if (eb.stale_start > start)
+        {
+            eb.stale_start = start;
         }
 
-        eb.t.nlines += ndelims;
+        if (eb.stale_end < end)
+        {
+            eb.stale_end = end;
+        }
     }
 
-    end_insert((uint_t)nbytes);
-
-    return true;                        // Insertion was successful
+    eb.indexed = false;
 }
 
 
 ///
-///  @brief    Kill the entire edit buffer.
+///  @brief    Scan forward nlines in edit buffer. Since lines are usually
+///            short, we start by scanning the buffer directly, and only use
+///            the line index if we don't find what we want nearby.
 ///
-///  @returns  Nothing.
+///  @returns  Position following line terminator (relative to dot).
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-void kill_edit(void)
+static int_t next_line(uint_t nlines)
 {
-    if (eb.t.Z != 0)                    // Anything in buffer?
-    {
-        reset_edit();
+    int_t end = eb.t.Z;
 
-        f.e0.window = true;             // Window refresh needed
+    if ((uint_t)(end - eb.t.dot) > LINE_BLOCK)
+    {
+        end = eb.t.dot + (int_t)LINE_BLOCK;
     }
-}
 
+    // Scan each side of the gap separately, so that we don't need to check
+    // for the gap at every position.
 
-///
-///  @brief    Return number of bytes between dot and nth line terminator.
-///
-///  @returns  Number of characters relative to dot (can be plus or minus).
-///
-////////////////////////////////////////////////////////////////////////////////
-
-int_t len_edit(int_t n)
-{
-    if (n > 0)
+    for (int_t pos = eb.t.dot; pos < end; )
     {
-        return next_line((uint_t)n) - eb.t.dot;
+        int_t nbytes;
+        const uchar *p = span_edit(pos, &nbytes);
+
+        if (nbytes > end - pos)
+        {
+            nbytes = end - pos;
+        }
+
+        for (int_t i = 0; i < nbytes; ++i)
+        {
+            if (isdelim(p[i]) && --nlines == 0)
+            {
+                return pos + i + 1;
+            }
+        }
+
+        pos += nbytes;
     }
-    else
+
+    if (end == eb.t.Z)
     {
-        return prev_line((uint_t)-n) - eb.t.dot;
+        return eb.t.Z;                  // Not enough lines, so return Z
     }
+
+    return find_line(count_lines(end) + nlines);
 }
 
 
 ///
-///  @brief    Move dot to a relative position.
+///  @brief    Find next character that needs special handling when appending
+///            a file. We remember where we found each character, so that we
+///            only need to search for it again once we've passed it.
 ///
-///  @returns  Nothing.
+///  @returns  Position of next special character, or end if none found.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-void move_dot(int_t delta)
+static uint_t next_special(struct scan *scan, const uchar *buf, uint_t pos,
+                           uint_t end)
 {
-    set_dot(eb.t.dot + delta);
-}
-
+    assert(scan != NULL);
+    assert(buf != NULL);
 
-///
-///  @brief    Scan forward nlines in edit buffer.
-///
-///  @returns  Position following line terminator (relative to dot).
-///
-////////////////////////////////////////////////////////////////////////////////
+    uint_t next = end;
 
-static int_t next_line(uint_t nlines)
-{
-    for (int_t pos = eb.t.dot; pos < eb.t.Z; ++pos)
+    for (uint i = 0; i < scan->count; ++i)
     {
-        int_t i = pos;
-
-        if ((uint_t)pos >= eb.left)     // Is position on right side of gap?
+        if (!scan->valid || scan->next[i] < pos)
         {
-            i += (int_t)eb.gap;         // Yes, so add bias
-        }
+            const uchar *p = memchr(buf + pos, scan->chr[i], (size_t)(end - pos));
 
-        int c = eb.buf[i];
+            scan->next[i] = (p == NULL) ? end : (uint_t)(p - buf);
+        }
 
-        if (isdelim(c) && --nlines == 0)
+        if (next > scan->next[i])
         {
-            return ++pos;
+            next = scan->next[i];
         }
     }
 
-    // There aren't n lines following the current position, so just return Z.
+    scan->valid = true;
 
-    return eb.t.Z;
+    return next;
 }
 
 
 ///
-///  @brief    Scan backward n lines in edit buffer.
+///  @brief    Scan backward n lines in edit buffer. As for next_line(), we
+///            only use the line index if we don't find what we want nearby.
 ///
 ///  @returns  Position following line terminator (relative to dot).
 ///
@@ -598,26 +1813,52 @@ static int_t next_line(uint_t nlines)
 
 static int_t prev_line(uint_t nlines)
 {
-    for (int_t pos = eb.t.dot; pos-- > 0; )
+    int_t start = 0;
+
+    if ((uint_t)eb.t.dot > LINE_BLOCK)
+    {
+        start = eb.t.dot - (int_t)LINE_BLOCK;
+    }
+
+    for (int_t pos = eb.t.dot; pos > start; )
     {
-        int_t i = pos;
+        const uchar *p = eb.buf;        // Text preceding position
+        int_t low = start;              // Start of text we can scan
 
-        if ((uint_t)pos >= eb.left)     // Is position on right side of gap?
+        if ((uint_t)pos > eb.left)      // Is position on right side of gap?
         {
-            i += (int_t)eb.gap;         // Yes, so add bias
-        }
+            p += eb.gap;                // Yes, so add bias
 
-        int c = eb.buf[i];
+            if ((uint_t)low < eb.left)
+            {
+                low = (int_t)eb.left;
+            }
+        }
 
-        if (isdelim(c) && nlines-- == 0)
+        while (pos > low)
         {
-            return ++pos;
+            --pos;
+
+            if (isdelim(p[pos]) && nlines-- == 0)
+            {
+                return pos + 1;
+            }
         }
     }
 
-    // There aren't n lines preceding the current position, so just return B.
+    if (start == 0)
+    {
+        return 0;                       // Not enough lines, so return B
+    }
+
+    uint_t ndelims = count_lines(start);
+
+    if (ndelims <= nlines)
+    {
+        return 0;                       // Not enough lines, so return B
+    }
 
-    return 0;
+    return find_line(ndelims - nlines);
 }
 
 
@@ -657,6 +1898,12 @@ static void reset_edit(void)
 {
     eb.left     = 0;
     eb.right    = 0;
+
+    if (eb.mapped)                      // Release any mapped file
+    {
+        unmap_edit(eb.heap);
+    }
+
     eb.gap      = eb.t.size;
 
     eb.t.Z      = 0;
@@ -668,8 +1915,95 @@ static void reset_edit(void)
     eb.t.pos    = 0;
     eb.t.line   = 0;
     eb.t.nlines = 0;
+
+    memset(eb.delims, 0, (size_t)eb.nblocks * sizeof(*eb.delims));
+
+    eb.indexed = false;
+    eb.stale_start = eb.stale_end = 0;
+}
+
+
+///
+///  @brief    Change size of buffer in reserved address space. The text after
+///            the gap is moved to the new end of the buffer, and the line index
+///            is extended or truncated to match, so that neither the gap nor
+///            the line index has to be rebuilt.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#if     defined(EDIT_RESERVE)
+
+static void resize_edit(uint_t size)
+{
+    assert(eb.reserved);
+    assert(size >= eb.left + eb.right);
+
+    uint_t oldsize = eb.t.size;
+    uint_t nblocks = (size + LINE_BLOCK - 1) / LINE_BLOCK;
+    uint_t delta;
+
+    if (size > oldsize)
+    {
+        if (nblocks > eb.nblocks)
+        {
+            delta = (nblocks - eb.nblocks) * (uint_t)sizeof(*eb.delims);
+
+            eb.delims = expand_mem(eb.delims, eb.nblocks *
+                                   (uint_t)sizeof(*eb.delims), delta);
+            eb.lines  = expand_mem(eb.lines, (eb.nblocks + 1) *
+                                   (uint_t)sizeof(*eb.lines), delta);
+        }
+
+        move_text(size - eb.right, oldsize - eb.right, eb.right);
+    }
+    else
+    {
+        move_text(size - eb.right, oldsize - eb.right, eb.right);
+
+        if (nblocks < eb.nblocks)
+        {
+            delta = (eb.nblocks - nblocks) * (uint_t)sizeof(*eb.delims);
+
+            eb.delims = shrink_mem(eb.delims, eb.nblocks *
+                                   (uint_t)sizeof(*eb.delims), delta);
+            eb.lines  = shrink_mem(eb.lines, (eb.nblocks + 1) *
+                                   (uint_t)sizeof(*eb.lines), delta);
+        }
+
+        // Give back any whole pages past the new end of the buffer.
+
+        uint_t page = (uint_t)sysconf(_SC_PAGESIZE);
+        uint_t end  = (size + page - 1) & ~(page - 1);
+
+        if (end < oldsize)
+        {
+            (void)madvise(eb.buf + end, (size_t)(oldsize - end),
+                          MADV_DONTNEED);
+        }
+    }
+
+    eb.nblocks = nblocks;
+    eb.indexed = false;
+    eb.t.size  = size;
+    eb.gap     = size - (eb.left + eb.right);
+
+    if (eb.stale_end > nblocks)         // Forget any blocks we truncated
+    {
+        eb.stale_end = nblocks;
+
+        if (eb.stale_start >= nblocks)
+        {
+            eb.stale_start = eb.stale_end = 0;
+        }
+    }
+
+    track_mem(MEM_EDIT, oldsize, size);
 }
 
+#endif
+
 
 ///
 ///  @brief    Move dot to an absolute position.
@@ -779,32 +2113,31 @@ void set_dot(int_t dot)
                 eb.t.pos = eb.t.dot - prev;
                 eb.t.len = next_line(1) - prev;
 
-                if (f.e0.display)
+                // Count the delimiters we moved past, unless we moved far
+                // enough that the line index will be faster.
+
+                if ((uint_t)abs(delta) > LINE_BLOCK)
+                {
+                    eb.t.line = (int)count_lines(eb.t.dot);
+                }
+                else
                 {
-                    if (delta < 0)
+                    uint_t start = (uint_t)(delta < 0 ? dot : dot - delta);
+                    uint_t end   = (uint_t)(delta < 0 ? dot - delta : dot);
+
+                    if (start >= eb.left)
                     {
-                        for (int i = 0; i < -delta; ++i)
-                        {
-                            int c = read_edit(i);
-
-                            if (isdelim(c))
-                            {
-                                --eb.t.line;
-                            }
-                        }
+                        start += eb.gap;
                     }
-                    else
+
+                    if (end >= eb.left)
                     {
-                        for (int i = -delta; i < 0; ++i)
-                        {
-                            int c = read_edit(i);
-
-                            if (isdelim(c))
-                            {
-                                ++eb.t.line;
-                            }
-                        }
+                        end += eb.gap;
                     }
+
+                    int ndelims = (int)count_text(start, end);
+
+                    eb.t.line += delta < 0 ? -ndelims : ndelims;
                 }
             }
         }
@@ -821,13 +2154,13 @@ void set_dot(int_t dot)
 
 static void shift_left(uint_t nbytes)
 {
-    uchar *src = eb.buf + eb.t.size - eb.right;
-    uchar *dst = eb.buf + eb.left;
+    uint_t src = eb.t.size - eb.right;
+    uint_t dst = eb.left;
 
     eb.left  += nbytes;
     eb.right -= nbytes;
 
-    memmove(dst, src, (size_t)nbytes);
+    move_text(dst, src, nbytes);
 }
 
 
@@ -843,10 +2176,10 @@ static void shift_right(uint_t nbytes)
     eb.left  -= nbytes;
     eb.right += nbytes;
 
-    uchar *src = eb.buf + eb.left;
-    uchar *dst = eb.buf + eb.t.size - eb.right;
+    uint_t src = eb.left;
+    uint_t dst = eb.t.size - eb.right;
 
-    memmove(dst, src, (size_t)nbytes);
+    move_text(dst, src, nbytes);
 }
 
 
@@ -882,7 +2215,29 @@ uint_t size_edit(uint_t size)
         return 0;
     }
 
+    if (eb.mapped)                      // Mapped buffers can't be resized
+    {
+        unmap_edit(size);
+
+        return size;
+    }
+
+#if     defined(EDIT_RESERVE)
+
+    if (eb.reserved)                    // Reserved buffers can grow in place
+    {
+        resize_edit(size);
+
+        return size;
+    }
+
+#endif
+
     // We need to temporarily remove the gap before changing buffer size.
+    // The line index is rebuilt afterward, since its blocks will change.
+
+    free_mem(&eb.delims);
+    free_mem(&eb.lines);
 
     shift_left(eb.right);               // Remove the gap
 
@@ -900,10 +2255,47 @@ uint_t size_edit(uint_t size)
     eb.t.size = size;
     eb.gap = eb.t.size - (eb.left + eb.right);
 
+    build_lines();
+
     return size;
 }
 
 
+///
+///  @brief    Get contiguous text starting at an absolute position, which is
+///            either the text from that position to the start of the gap, or
+///            the text from that position to the end of the buffer.
+///
+///  @returns  Pointer to text, with the no. of contiguous bytes stored in
+///            nbytes (0 if the position is outside the buffer).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+const uchar *span_edit(int_t pos, int_t *nbytes)
+{
+    assert(nbytes != NULL);
+
+    if (pos < eb.t.B || pos >= eb.t.Z)
+    {
+        *nbytes = 0;
+
+        return NULL;
+    }
+    else if ((uint_t)pos < eb.left)
+    {
+        *nbytes = (int_t)eb.left - pos;
+
+        return eb.buf + pos;
+    }
+    else
+    {
+        *nbytes = eb.t.Z - pos;
+
+        return eb.buf + eb.gap + pos;
+    }
+}
+
+
 ///
 ///  @brief    Initialize buffer for adding characters.
 ///
@@ -917,14 +2309,10 @@ static bool start_insert(uint_t nbytes)
 
     while (eb.gap < nbytes)
     {
-        uint_t size = (eb.t.size * 3) / 2;
-
-        if (size_edit(size) == 0)
+        if (!grow_gap())
         {
             return false;
         }
-
-        print_size(size);
     }
 
     // Ensure dot is at start of the gap
@@ -942,3 +2330,55 @@ static bool start_insert(uint_t nbytes)
 
     return true;
 }
+
+
+///
+///  @brief    Sum the counts in the line index for the blocks preceding a given
+///            block, including any blocks that are stale.
+///
+///  @returns  No. of delimiters found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t sum_lines(uint_t block)
+{
+    uint_t n = 0;
+
+    for (uint_t i = block; i != 0; i -= i & -i)
+    {
+        n += eb.lines[i];
+    }
+
+    return n;
+}
+
+
+///
+///  @brief    Replace mapped file with normally allocated buffer, copying any
+///            data we still have.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void unmap_edit(uint_t size)
+{
+    assert(eb.mapped);
+    assert(size >= eb.left + eb.right);
+
+    uchar *buf = alloc_edit(size);
+
+    memcpy(buf, eb.buf, (size_t)eb.left);
+    memcpy(buf + size - eb.right, eb.buf + eb.t.size - eb.right,
+           (size_t)eb.right);
+
+    (void)munmap(eb.buf, (size_t)eb.t.size);
+
+    end_map();
+
+    eb.buf    = buf;
+    eb.t.size = size;
+    eb.gap    = size - (eb.left + eb.right);
+
+    build_lines();
+}
@@ -42,6 +42,14 @@
 
 static void find_tag(const char *text, uint len);
 
+static uint_t search_tag(const tstring *tag, uint_t old_line);
+
+static void skip_flow(const struct flows *flows, const struct flow *flow,
+                      uint_t tag_pos, const tstring *tag, uint_t old_line,
+                      uint_t lines);
+
+static void skip_tag(uint_t tag_pos, const tstring *tag, uint_t old_line);
+
 static void validate_tag(tstring *tag);
 
 
@@ -125,71 +133,45 @@ static void find_tag(const char *text, uint len)
     // Check for string building characters to create tag
 
     tstring tag = build_string(text, len);
-    struct cmd cmd;                     // Dummy command block for skip_cmd()
-    uint old_pos = cbuf->pos;           // Save command buffer position
+    uint_t old_pos = cbuf->pos;         // Save command buffer position
     uint_t old_line = cmd_line;         // Save current line number
-    uint tag_pos = 0;                   // Position of tag
-    uint level = 0;                     // Loop command level
-    uint depth = 0;                     // Conditional command depth
 
     validate_tag(&tag);                 // Trim spaces and verify format
 
-    //  Start at the beginning of the command string, and search for the tag.
+    //  Look up the tag in the index of flow control commands for the command
+    //  string, which is built the first time it's needed, and then kept until
+    //  the command string is modified. If the string has an error, then we
+    //  can't index all of it, so we scan it instead, so that errors are found
+    //  in the same order as they would be without the index.
 
-    cbuf->pos = 0;
-
-    while (skip_cmd(&cmd, "!"))
-    {
-        switch (cmd.c1)
-        {
-            case '"':                   // 'if' command
-                ++depth;
-
-                break;
-
-            case '\'':                  // 'endif' command
-                --depth;
-
-                break;
-
-            case '!':                   // Tag (label or comment)
-                if (cmd.c2 != '!' && cmd.text1.len == tag.len
-                    && !memcmp(cmd.text1.data, tag.data, (size_t)tag.len))
-                {
-                    if (tag_pos != 0)
-                    {
-                        cmd_line = old_line; // Restore line number for throw()
-
-                        throw(E_DUP, tag.data); // Duplicate tag
-                    }
-                    else
-                    {
-                        tag_pos = cbuf->pos;
-                    }
-                }
-
-                break;
-
-            default:
-                break;
-        }
-    }
+    struct flows *flows = get_flows();
+    const struct flow *label = find_label(flows, tag.data, tag.len);
+    uint_t tag_pos;
 
     //  Issue error if we couldn't find the tag, or if we're in a loop and the
     //  tag was found the start of the loop. The reason for the latter error is
     //  because we cannot easily ensure that we wouldn't be jumping into a loop
     //  that we are not currently inside of.
 
-    if (tag_pos == 0)
+    if (flows->failed)
+    {
+        tag_pos = search_tag(&tag, old_line);
+    }
+    else if (label == NULL)
     {
-        cmd_line = old_line;            // Restore line number for throw()
-
         throw(E_TAG, tag.data);         // Missing tag
     }
-    else if (ctrl.level != 0 && tag_pos < ctrl.loop[ctrl.level - 1].pos)
+    else if (label->dup)
     {
-        cmd_line = old_line;            // Restore line number for throw()
+        throw(E_DUP, tag.data);         // Duplicate tag
+    }
+    else
+    {
+        tag_pos = label->pos;
+    }
 
+    if (ctrl.level != 0 && tag_pos < ctrl.loop[ctrl.level - 1].pos)
+    {
         throw(E_LOC, tag.data);         // Invalid tag location
     }
 
@@ -210,7 +192,7 @@ static void find_tag(const char *text, uint len)
     }
     else
     {
-        ctrl.depth = depth;
+        ctrl.depth = 0;
 
         if (ctrl.level == 0)
         {
@@ -224,15 +206,184 @@ static void find_tag(const char *text, uint len)
         }
     }
 
-    //  Scan command string to find the tag again. Note: when scanning for
-    //  loops, we distinguish between the loop we may be enclosed by, and
-    //  any new loops that we may find preceding our position, in order that
-    //  we not jump into the middle of any loops. We also check that we don't
-    //  jump into the middle of any loops following our position.
+    //  If we're starting at the beginning of the command string, or just after
+    //  a loop or O command, we can follow the flow control commands between
+    //  there and the tag from the index. If not, which can only happen if the
+    //  string was executed with different flags, or if we couldn't index it,
+    //  then scan it instead.
 
-    while (skip_cmd(&cmd, "<>\"'!"))
+    if (flows->failed)
     {
-        switch (cmd.c1)
+        skip_tag(tag_pos, &tag, old_line);
+    }
+    else if (cbuf->pos == 0)
+    {
+        skip_flow(flows, flows->flow, tag_pos, &tag, old_line, 0);
+    }
+    else
+    {
+        const struct flow *flow = find_flow(flows, cbuf->pos);
+
+        if (flow != NULL && (flow->c1 == '<' || flow->c1 == 'O'))
+        {
+            skip_flow(flows, flow + 1, tag_pos, &tag, old_line, flow->lines);
+        }
+        else
+        {
+            skip_tag(tag_pos, &tag, old_line);
+        }
+    }
+}
+
+
+///
+///  @brief    Scan ! command with format "m,n@X/text1/" (with special
+///            delimiters).
+///
+///  @returns  true if command is an operand or operator, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool scan_tag(struct cmd *cmd)
+{
+    assert(cmd != NULL);
+
+    if (f.e1.xoper && check_parens())   // Is it a logical NOT operator?
+    {
+        confirm(cmd, NO_M, NO_N, NO_COLON, NO_DCOLON, NO_ATSIGN);
+
+        store_oper(X_NOT);
+
+        return true;
+    }
+
+    // Here if we have either a GOTO label or a comment.
+
+    scan_x(cmd);
+    confirm(cmd, NO_M_ONLY, NO_COLON, NO_DCOLON, NO_ATSIGN);
+
+    // If feature enabled, !! starts a comment that ends with LF
+    // (but note that the LF is not counted as part of the command).
+
+    if (peek_cbuf() == '!')
+    {
+        next_cbuf();
+
+        if (!f.e1.bang)                 // Is !! enabled?
+        {
+            throw(E_EXT);
+        }
+
+        scan_texts(cmd, 1, LF);
+
+        --cmd->text1.len;               // Back off the LF
+        cmd->c2 = '!';                  // And flag it as a comment
+    }
+    else
+    {
+        scan_texts(cmd, 1, '!');
+    }
+
+    return false;
+}
+
+
+///
+///  @brief    Scan O command.
+////
+///  @returns  false (command is not an operand or operator).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool scan_O(struct cmd *cmd)
+{
+    assert(cmd != NULL);
+
+    scan_x(cmd);
+    confirm(cmd, NO_NEG_N, NO_M_ONLY, NO_COLON, NO_DCOLON);
+
+    scan_texts(cmd, 1, ESC);
+
+    return false;
+}
+
+
+///
+///  @brief    Scan command string for the tag we're going to, without using the
+///            index, and checking for duplicates.
+///
+///  @returns  Position of tag.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t search_tag(const tstring *tag, uint_t old_line)
+{
+    assert(tag != NULL);
+
+    struct cmd cmd;                     // Dummy command block for skip_cmd()
+    uint_t tag_pos = 0;                 // Position of tag
+
+    cbuf->pos = 0;
+
+    while (skip_cmd(&cmd, "!", NULL))
+    {
+        if (cmd.c2 != '!' && cmd.text1.len == tag->len
+            && !memcmp(cmd.text1.data, tag->data, (size_t)tag->len))
+        {
+            if (tag_pos != 0)
+            {
+                cmd_line = old_line;    // Restore line number for throw()
+
+                throw(E_DUP, tag->data); // Duplicate tag
+            }
+
+            tag_pos = cbuf->pos;
+        }
+    }
+
+    if (tag_pos == 0)
+    {
+        cmd_line = old_line;            // Restore line number for throw()
+
+        throw(E_TAG, tag->data);        // Missing tag
+    }
+
+    return tag_pos;
+}
+
+
+///
+///  @brief    Follow the index of flow control commands to the tag we're going
+///            to, adjusting the loop level and conditional depth as we go. We
+///            distinguish between the loop we may be enclosed by, and any new
+///            loops that we may find preceding our position, in order that we
+///            not jump into the middle of any loops. We also check that we
+///            don't jump into the middle of any loops following our position.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void skip_flow(const struct flows *flows, const struct flow *flow,
+                      uint_t tag_pos, const tstring *tag, uint_t old_line,
+                      uint_t lines)
+{
+    assert(flows != NULL);
+    assert(flow != NULL);
+    assert(tag != NULL);
+
+    const struct flow *end = flows->flow + flows->count;
+    uint_t line = cmd_line;             // Line number at starting position
+    uint level = 0;                     // Loop command level
+
+    for (; flow < end; ++flow)
+    {
+        if (line != 0)
+        {
+            cmd_line = line + flow->lines - lines;
+        }
+
+        switch (flow->c1)
         {
             case '<':                   // Start of loop
                 ++level;
@@ -250,6 +401,8 @@ static void find_tag(const char *text, uint len)
                 }
                 else
                 {
+                    cbuf->pos = flow->pos;
+
                     throw(E_BNI);       // Right angle bracket not in iteration
                 }
 
@@ -266,11 +419,11 @@ static void find_tag(const char *text, uint len)
                 break;
 
             case '!':                   // Start of tag
-                if (cbuf->pos == tag_pos && level == 0)
+                if (flow->pos == tag_pos && level == 0)
                 {
                     // The +2 is for the delimiting exclamation marks.
 
-                    cbuf->pos -= tag.len + 2;
+                    cbuf->pos = tag_pos - (tag->len + 2);
 
                     reset_x();
 
@@ -286,81 +439,87 @@ static void find_tag(const char *text, uint len)
 
     //  Here if trying to jump into the middle of a loop (other than ours).
 
+    cbuf->pos = cbuf->len;
     cmd_line = old_line;                // Restore line number for throw()
 
-    throw(E_LOC, tag.data);             // Invalid tag location
+    throw(E_LOC, tag->data);            // Invalid tag location
 }
 
 
 ///
-///  @brief    Scan ! command with format "m,n@X/text1/" (with special
-///            delimiters).
+///  @brief    Scan command string to find the tag we're going to. This does
+///            the same thing as skip_flow(), but without using the index.
 ///
-///  @returns  true if command is an operand or operator, else false.
+///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-bool scan_tag(struct cmd *cmd)
+static void skip_tag(uint_t tag_pos, const tstring *tag, uint_t old_line)
 {
-    assert(cmd != NULL);
+    assert(tag != NULL);
 
-    if (f.e1.xoper && check_parens())   // Is it a logical NOT operator?
+    struct cmd cmd;                     // Dummy command block for skip_cmd()
+    uint level = 0;                     // Loop command level
+
+    while (skip_cmd(&cmd, "<>\"'!", NULL))
     {
-        confirm(cmd, NO_M, NO_N, NO_COLON, NO_DCOLON, NO_ATSIGN);
+        switch (cmd.c1)
+        {
+            case '<':                   // Start of loop
+                ++level;
 
-        store_oper(X_NOT);
+                break;
 
-        return true;
-    }
+            case '>':                   // End of loop
+                if (level != 0)
+                {
+                    --level;
+                }
+                else if (ctrl.level != 0) // Exiting current (nested) loop?
+                {
+                    --ctrl.level;       // Yes
+                }
+                else
+                {
+                    throw(E_BNI);       // Right angle bracket not in iteration
+                }
 
-    // Here if we have either a GOTO label or a comment.
+                break;
 
-    scan_x(cmd);
-    confirm(cmd, NO_M_ONLY, NO_COLON, NO_DCOLON, NO_ATSIGN);
+            case '"':                   // 'if' command
+                ++ctrl.depth;
 
-    // If feature enabled, !! starts a comment that ends with LF
-    // (but note that the LF is not counted as part of the command).
+                break;
 
-    if (peek_cbuf() == '!')
-    {
-        next_cbuf();
+            case '\'':                  // 'endif' command
+                --ctrl.depth;
 
-        if (!f.e1.bang)                 // Is !! enabled?
-        {
-            throw(E_EXT);
-        }
+                break;
 
-        scan_texts(cmd, 1, LF);
+            case '!':                   // Start of tag
+                if (cbuf->pos == tag_pos && level == 0)
+                {
+                    // The +2 is for the delimiting exclamation marks.
 
-        --cmd->text1.len;               // Back off the LF
-        cmd->c2 = '!';                  // And flag it as a comment
-    }
-    else
-    {
-        scan_texts(cmd, 1, '!');
-    }
+                    cbuf->pos -= tag->len + 2;
 
-    return false;
-}
+                    reset_x();
 
+                    return;
+                }
 
-///
-///  @brief    Scan O command.
-////
-///  @returns  false (command is not an operand or operator).
-///
-////////////////////////////////////////////////////////////////////////////////
+                break;
 
-bool scan_O(struct cmd *cmd)
-{
-    assert(cmd != NULL);
+            default:
+                break;
+        }
+    }
 
-    scan_x(cmd);
-    confirm(cmd, NO_NEG_N, NO_M_ONLY, NO_COLON, NO_DCOLON);
+    //  Here if trying to jump into the middle of a loop (other than ours).
 
-    scan_texts(cmd, 1, ESC);
+    cmd_line = old_line;                // Restore line number for throw()
 
-    return false;
+    throw(E_LOC, tag->data);            // Invalid tag location
 }
 
 
@@ -41,6 +41,8 @@
 
 // Local functions
 
+static bool jump_if(bool else_ok);
+
 static void skip_if(bool else_ok);
 
 
@@ -304,6 +306,114 @@ void exec_if(struct cmd *cmd)
 }
 
 
+///
+///  @brief    Use index of flow control commands to skip to end of conditional
+///            statement, or to 'else' statement. The command we skip to is
+///            found the first time we skip from a given position, and is then
+///            remembered.
+///
+///  @returns  true if we skipped to end of conditional or 'else', false if we
+///            need to scan for it (which can happen if the command string has
+///            an error, or if we're not at a position found in the index).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool jump_if(bool else_ok)
+{
+    struct flows *flows = get_flows();
+    struct flow *flow = find_flow(flows, cbuf->pos);
+
+    if (flow == NULL)
+    {
+        return false;
+    }
+
+    uint_t start = (uint_t)(flow - flows->flow);
+    uint_t end = else_ok ? flow->end_else : flow->end_if;
+
+    if (end == 0)
+    {
+        const struct flow *next;
+        uint_t i = start;
+        uint level = 0;
+        uint depth = 0;
+
+        while ((next = get_flow(flows, ++i)) != NULL)
+        {
+            if (next->c1 == '<')
+            {
+                ++level;
+            }
+            else if (next->c1 == '>')
+            {
+                if (level-- == 0)
+                {
+                    return false;       // Let skip_if() issue error
+                }
+            }
+            else if (next->c1 == '"')
+            {
+                ++depth;
+            }
+            else if (next->c1 == '\'')
+            {
+                if (depth-- == 0)
+                {
+                    if (level != 0)
+                    {
+                        return false;   // Let skip_if() issue error
+                    }
+
+                    break;
+                }
+            }
+            else if (next->c1 == '|' && depth == 0 && else_ok)
+            {
+                break;
+            }
+        }
+
+        if (next == NULL)
+        {
+            return false;               // Let skip_if() issue error
+        }
+
+        flow = &flows->flow[start];     // Index may have moved
+        end = i + 1;
+
+        if (else_ok)
+        {
+            flow->end_else = end;
+        }
+        else
+        {
+            flow->end_if = end;
+        }
+    }
+
+    const struct flow *next = &flows->flow[end - 1];
+
+    if (next->c1 == '\'')
+    {
+        --ctrl.depth;
+    }
+
+    if (cmd_line != 0)
+    {
+        cmd_line += next->lines - flow->lines;
+    }
+
+    cbuf->pos = next->pos;
+
+    if (f.trace)
+    {
+        echo_in(next->c1);
+    }
+
+    return true;
+}
+
+
 ///
 ///  @brief    Scan " (quote) command.
 ///
@@ -352,11 +462,16 @@ static void skip_if(bool else_ok)
 {
     assert(ctrl.depth > 0);
 
+    if (jump_if(else_ok))
+    {
+        return;
+    }
+
     struct cmd cmd;                     // Scrap command block for skip_cmd()
     uint level = 0;
     uint start = ctrl.depth;
 
-    while (skip_cmd(&cmd, "<>\"'|"))
+    while (skip_cmd(&cmd, "<>\"'|", NULL))
     {
         switch (cmd.c1)
         {
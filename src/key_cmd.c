@@ -54,8 +54,6 @@ char keysize[UCHAR_MAX + 1];        ///< No. of chrs. required to display each k
 
 // Local functions
 
-static int_t count_chrs(int_t pos, int maxcol);
-
 static void exec_down(int key);
 
 static void exec_end(int key);
@@ -98,44 +96,6 @@ int check_key(int c)
 }
 
 
-///
-///  @brief    Count the number of characters required to get to saved column.
-///
-///  @returns  No. of bytes to adjust 'dot'.
-///
-////////////////////////////////////////////////////////////////////////////////
-
-static int_t count_chrs(int_t pos, int maxcol)
-{
-    int col = 0;                        // Current column in line
-    int c;
-
-    while ((c = read_edit(pos)) != EOF)
-    {
-        int width;
-
-        if (c == HT && !w.seeall)
-        {
-            width = TABSIZE - (col % TABSIZE);
-        }
-        else
-        {
-            width = keysize[c];
-        }
-
-        if (isdelim(c) || c == CR || col + width > maxcol)
-        {
-            break;
-        }
-
-        col += width;
-        ++pos;
-    }
-
-    return pos;
-}
-
-
 ///
 ///  @brief    Move cursor down.
 ///
@@ -210,7 +170,7 @@ static void exec_end(int key)
 
             if (col < d.maxcol)
             {
-                delta = count_chrs(t->pos, d.maxcol);
+                delta = count_chrs(-t->pos, d.maxcol);
             }
         }
 
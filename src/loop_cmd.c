@@ -25,6 +25,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 
 #include "teco.h"
@@ -40,6 +41,8 @@
 
 // Local functions
 
+static bool jump_loop(void);
+
 static void skip_loop(void);
 
 
@@ -256,6 +259,104 @@ void exit_loop(struct cmd *cmd)
 }
 
 
+///
+///  @brief    Use index of flow control commands to flow to end of loop. The
+///            end of the loop is found the first time we skip from a given
+///            position, and is then remembered, along with the net change in
+///            the depth of conditionals, and the lowest depth seen at the end
+///            of any conditional (so that we can check for a missing start of
+///            conditional without repeating the scan).
+///
+///  @returns  true if we jumped to end of loop, false if we need to scan for
+///            it (which can happen if the command string contains an error, or
+///            if we're not at a position found in the index).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool jump_loop(void)
+{
+    struct flows *flows = get_flows();
+    struct flow *flow = find_flow(flows, cbuf->pos);
+
+    if (flow == NULL)
+    {
+        return false;
+    }
+
+    uint_t start = (uint_t)(flow - flows->flow);
+
+    if (flow->end_loop == 0)
+    {
+        const struct flow *next;
+        uint_t i = start;
+        uint level = 0;
+        int depth = 0;
+        int min_depth = INT_MAX;
+
+        while ((next = get_flow(flows, ++i)) != NULL)
+        {
+            if (next->c1 == '<')
+            {
+                ++level;
+            }
+            else if (next->c1 == '>' && level-- == 0)
+            {
+                break;
+            }
+            else if (next->c1 == '"')
+            {
+                ++depth;
+            }
+            else if (next->c1 == '\'')
+            {
+                if (min_depth > depth)
+                {
+                    min_depth = depth;
+                }
+
+                --depth;
+            }
+        }
+
+        if (next == NULL)
+        {
+            return false;               // Let skip_loop() issue error
+        }
+
+        flow = &flows->flow[start];     // Index may have moved
+
+        flow->end_loop  = i + 1;
+        flow->depth     = depth;
+        flow->min_depth = min_depth;
+    }
+
+    if (flow->min_depth <= -(int)ctrl.depth)
+    {
+        return false;                   // Let skip_loop() issue error
+    }
+
+    const struct flow *end = &flows->flow[flow->end_loop - 1];
+
+    --ctrl.level;
+
+    ctrl.depth = (uint)((int)ctrl.depth + flow->depth);
+
+    if (cmd_line != 0)
+    {
+        cmd_line += end->lines - flow->lines;
+    }
+
+    cbuf->pos = end->pos;
+
+    if (f.trace)
+    {
+        echo_in(end->c1);
+    }
+
+    return true;
+}
+
+
 ///
 ///  @brief    Scan > command: relational operator.
 ///
@@ -394,10 +495,15 @@ static void skip_loop(void)
 {
     assert(ctrl.level > 0);
 
+    if (jump_loop())
+    {
+        return;
+    }
+
     struct cmd cmd;
     uint level = ctrl.level--;
 
-    while (skip_cmd(&cmd, "<>\"'"))
+    while (skip_cmd(&cmd, "<>\"'", NULL))
     {
         switch (cmd.c1)
         {
@@ -33,6 +33,7 @@
 #include "errors.h"
 #include "estack.h"
 #include "exec.h"
+#include "profile.h"
 #include "qreg.h"
 
 
@@ -94,9 +95,11 @@ void exec_M(struct cmd *cmd)
     }
 
     // We make a private copy of the Q-register, since some of the structure
-    // members can get modified while processing the macro (esp. len).
+    // members can get modified while processing the macro (esp. len). The
+    // text storage is shared with the Q-register, so that it stays intact
+    // even if the macro modifies the Q-register.
 
-    tbuffer macro = qreg->text;
+    tbuffer macro = hold_qtext(cmd->qindex);
 
     if (cmd->colon || cmd->qlocal)      // :Mq or using local Q-register?
     {
@@ -110,6 +113,8 @@ void exec_M(struct cmd *cmd)
 
         pop_qlocal();
     }
+
+    release_qtext();
 }
 
 
@@ -137,6 +142,12 @@ void exec_macro(tbuffer *macro, struct cmd *cmd)
     uint_t saved_pos       = macro->pos;
     tbuffer *saved_cbuf    = cbuf;
 
+#if     !defined(NTRACE)
+
+    uint saved_prof        = set_prof(cmd);
+
+#endif
+
     // Initialize for new command string
 
     new_x();                            // Make new expression stack
@@ -197,6 +208,12 @@ void exec_macro(tbuffer *macro, struct cmd *cmd)
     cmd_line = saved_line;
     ctrl = saved_ctrl;
 
+#if     !defined(NTRACE)
+
+    reset_prof(saved_prof);
+
+#endif
+
     delete_x();                         // Restore previous expression stack
 }
 
@@ -211,6 +228,12 @@ void exec_macro(tbuffer *macro, struct cmd *cmd)
 void reset_macro(void)
 {
     macro_depth = 0;
+
+#if     !defined(NTRACE)
+
+    reset_prof(PROF_CMD);
+
+#endif
 }
 
 
@@ -25,6 +25,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,45 +57,107 @@
 #endif
 
 
-// The following conditional code is used to check for memory leaks when we
-// exit. It is an early warning system to alert the user that there is a bug
-// that needs to be investigated and resolved, possibly with better tools such
-// as Valgrind.
+#define POOL_GRAIN  32              ///< Granularity of pool size classes
 
-#if     DEBUG >= 2
+#define POOL_MAX    2048            ///< Largest block kept in a pool
 
-#include "exec.h"
+#define POOL_COUNT  (POOL_MAX / POOL_GRAIN) ///< No. of pool size classes
 
-#define plural(x) (((x) == 1) ? "" : "s") ///< Check for plural/non-plural no.
+#define POOL_LIMIT  256             ///< Max. no. of free blocks in each pool
 
 ///  @struct mblock
 ///
-///  This structure defines a block that is used in a doubly-linked list to
-///  keep track of TECO memory allocations and deallocations. The mroot vari-
-///  able points to the first block in the list, which is also always the most
-///  recently added block. And the msize variable is the sum of the sizes of
-///  all currently allocated memory (excluding the blocks for this list). At
-///  program exit, the list should be empty, but if it is not, we will use the
-///  information in each block to print an error message with the address and
-///  size of the undeallocated memory.
+///  This structure is the header that precedes every memory block we allocate,
+///  so that we can find out the size and type of a block when it's freed or
+///  resized without having to search for it. In debug builds, it also links the
+///  block into a doubly-linked list of all current allocations. The mroot
+///  variable points to the first block in the list, which is also always the
+///  most recently added block. At program exit, the list should be empty, but
+///  if it is not, we will use the information in each block to print an error
+///  message with the address and size of the undeallocated memory.
 
 struct mblock
 {
+
+#if     DEBUG >= 2
+
     struct mblock *prev;                ///< Previous block in linked list
     struct mblock *next;                ///< Next block in linked list
-    const char *addr;                   ///< calloc'd memory block
-    uint_t size;                        ///< Size of block in bytes
     uint count;                         ///< Block count (index)
+
+#endif
+
+    uint_t size;                        ///< Size of block in bytes
+    uchar type;                         ///< Memory type (enum mem_type)
+    uchar pool;                         ///< Pool no. + 1 (or 0 if not pooled)
 };
 
-static struct mblock *mroot = NULL;     ///< Root of memory block list
+///  @union  mhead
+///
+///  Ensures that the memory following a block header is suitably aligned for
+///  any type of data.
+
+union mhead
+{
+    struct mblock mblock;               ///< Block header
+    max_align_t align;                  ///< Alignment
+};
+
+///  @def    get_data
+///  @brief  Get address of data following block header.
+
+#define get_data(p)  ((char *)(p) + sizeof(union mhead))
+
+///  @def    get_mblock
+///  @brief  Get address of header preceding data.
+
+#define get_mblock(p) ((struct mblock *)((char *)(p) - sizeof(union mhead)))
+
+///  @var    mstats
+///
+///  @brief  Memory statistics for each memory type. The first entry has the
+///          totals for all types.
+
+static struct
+{
+    uint_t size;                        ///< Total bytes allocated
+    uint_t blocks;                      ///< No. of blocks allocated
+} mstats[MEM_MAX];
+
+///  @var    pools
+///
+///  @brief  Lists of free blocks for small allocations, by size class. Blocks
+///          of up to POOL_MAX bytes are rounded up to a multiple of POOL_GRAIN
+///          bytes, and are kept here when freed instead of being returned to
+///          the C library. The first bytes of each free block point to the
+///          next free block in the list.
+
+static struct
+{
+    void *head;                         ///< First free block (or NULL)
+    uint count;                         ///< No. of free blocks
+} pools[POOL_COUNT];
+
+
+// The following conditional code is used to check for memory leaks when we
+// exit. It is an early warning system to alert the user that there is a bug
+// that needs to be investigated and resolved, possibly with better tools such
+// as Valgrind.
 
-static uint_t msize = 0;                ///< Total memory allocated, in bytes
+#if     DEBUG >= 2
+
+#include "exec.h"
+
+#define plural(x) (((x) == 1) ? "" : "s") ///< Check for plural/non-plural no.
+
+static struct mblock *mroot = NULL;     ///< Root of memory block list
 
 #if     DEBUG == 3
 
 static uint nallocs = 0;                ///< Total no. of blocks allocated
 
+static uint nreused = 0;                ///< No. of blocks reused from pools
+
 #endif
 
 static uint nblocks = 0;                ///< No. of blocks currently allocated
@@ -103,35 +166,35 @@ static uint maxblocks = 0;              ///< High-water mark for allocated block
 
 static uint mcount = 0;
 
+#endif
+
 // Local functions
 
-static void add_mblock(void *p1, uint_t size);
+#if     DEBUG >= 2
+
+static void add_mblock(struct mblock *p);
 
-static void delete_mblock(void *p1);
+static void delete_mblock(struct mblock *p);
 
-static struct mblock*find_mblock(void *p1);
+static void move_mblock(struct mblock *p);
 
 #endif
 
+static void count_mem(const struct mblock *p, int sign);
+
 
 ///
-///  @brief    Add memory block.
+///  @brief    Add memory block to list.
 ///
-///  @returns  Nothing (error if memory allocation fails).
+///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
 #if     DEBUG >= 2
 
-static void add_mblock(void *p1, uint_t size)
+static void add_mblock(struct mblock *p)
 {
-    assert(p1 != NULL);                 // Error if no memory block
-
-    // Note: We don't call alloc_mem() here, since it calls us.
-
-    struct mblock *p = calloc(1ul, sizeof(*p));
-
-    assert(p != NULL);                  // Error if calloc() failed
+    assert(p != NULL);                  // Error if no memory block
 
     p->prev = NULL;
     p->next = mroot;
@@ -141,16 +204,13 @@ static void add_mblock(void *p1, uint_t size)
         mroot->prev = p;
     }
 
-    p->addr = p1;
-    p->size = size;
     p->count = ++mcount;
-    msize += size;
     mroot = p;
 
 #if     DEBUG == 3
 
     tprint("%s(): block #%u at %p, size = %lu\n", __func__, p->count,
-           p->addr, (size_t)p->size);
+           (void *)get_data(p), (size_t)p->size);
 
     ++nallocs;
 
@@ -166,7 +226,7 @@ static void add_mblock(void *p1, uint_t size)
 
 
 ///
-///  @brief    Allocate new memory.
+///  @brief    Allocate new memory of miscellaneous type.
 ///
 ///  @returns  Pointer to new memory.
 ///
@@ -174,28 +234,7 @@ static void add_mblock(void *p1, uint_t size)
 
 void *alloc_mem(uint_t size)
 {
-    //  This assertion check exists because implementations of calloc() won't
-    //  return a NULL pointer if the product of its two arguments are equal 0,but
-    //  but will rather return a unique pointer that can be safely passed to
-    //  free(). And the reason for this check, instead of throwing an exception,
-    //  is because the argument to our function should never be 0.
-
-    assert(size != 0);
-
-    void *p1 = calloc(1uL, (size_t)size);
-
-    if (p1 == NULL)
-    {
-        throw(E_MEM);                   // Memory overflow
-    }
-
-#if     DEBUG >= 2
-
-    add_mblock(p1, size);
-
-#endif
-
-    return p1;
+    return alloc_type(size, MEM_MISC);
 }
 
 
@@ -224,76 +263,153 @@ tbuffer alloc_tbuf(uint_t size)
 
 
 ///
-///  @brief    Delete memory block.
+///  @brief    Allocate new memory, and count it against the specified type.
+///            Small blocks are taken from a pool if one is available.
 ///
-///  @returns  Nothing.
+///  @returns  Pointer to new memory.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-#if     DEBUG >= 2
-
-static void delete_mblock(void *p1)
+void *alloc_type(uint_t size, enum mem_type type)
 {
-    assert(p1 != NULL);                 // Error if NULL memory block
+    //  This assertion check exists because implementations of calloc() won't
+    //  return a NULL pointer if the product of its two arguments are equal 0,but
+    //  but will rather return a unique pointer that can be safely passed to
+    //  free(). And the reason for this check, instead of throwing an exception,
+    //  is because the argument to our function should never be 0.
 
-    struct mblock *p = mroot;
+    assert(size != 0);
+    assert(type > MEM_ALL && type < MEM_MAX);
 
-    while (p != NULL)
+    struct mblock *p;
+    uint pool = 0;
+
+    if (size <= POOL_MAX)
     {
-        if (p1 == p->addr)
-        {
-            msize -= p->size;
-
-            if (p->prev != NULL)
-            {
-                p->prev->next = p->next;
-            }
-            else
-            {
-                mroot = p->next;
-            }
-
-            if (p->next != NULL)
-            {
-                p->next->prev = p->prev;
-            }
+        pool = (uint)((size + POOL_GRAIN - 1) / POOL_GRAIN);
+    }
+
+    if (pool != 0 && pools[pool - 1].head != NULL)
+    {
+        char *data = pools[pool - 1].head;
+
+        memcpy(&pools[pool - 1].head, data, sizeof(void *));
+        --pools[pool - 1].count;
+
+        memset(data, '\0', (size_t)size);
+
+        p = get_mblock(data);
 
 #if     DEBUG == 3
 
-            tprint("%s(): block #%u at %p, size = %lu\n", __func__, p->count,
-                   p->addr, (size_t)p->size);
+        ++nreused;
 
 #endif
 
-            p->next = p->prev = NULL;
-            p->addr = NULL;
-            p->size = 0;
+    }
+    else
+    {
+        size_t nbytes = (pool != 0) ? pool * POOL_GRAIN : size;
 
-            // Note: We don't call free_mem() here, since it calls us.
+        p = calloc(1uL, sizeof(union mhead) + nbytes);
 
-            free(p);
+        if (p == NULL)
+        {
+            throw(E_MEM);               // Memory overflow
+        }
+    }
+
+    p->size = size;
+    p->type = (uchar)type;
+    p->pool = (uchar)pool;
 
-            --nblocks;
+    count_mem(p, 1);
 
-            return;
-        }
+#if     DEBUG >= 2
+
+    add_mblock(p);
+
+#endif
+
+    return get_data(p);
+}
+
+
+///
+///  @brief    Add or subtract block from memory statistics.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void count_mem(const struct mblock *p, int sign)
+{
+    assert(p != NULL);
 
-        p = p->next;
+    if (sign > 0)
+    {
+        mstats[p->type].size += p->size;
+        mstats[MEM_ALL].size += p->size;
+
+        ++mstats[p->type].blocks;
+        ++mstats[MEM_ALL].blocks;
+    }
+    else
+    {
+        mstats[p->type].size -= p->size;
+        mstats[MEM_ALL].size -= p->size;
+
+        --mstats[p->type].blocks;
+        --mstats[MEM_ALL].blocks;
+    }
+}
+
+
+///
+///  @brief    Delete memory block from list.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#if     DEBUG >= 2
+
+static void delete_mblock(struct mblock *p)
+{
+    assert(p != NULL);                  // Error if NULL memory block
+
+    if (p->prev != NULL)
+    {
+        p->prev->next = p->next;
+    }
+    else
+    {
+        mroot = p->next;
+    }
+
+    if (p->next != NULL)
+    {
+        p->next->prev = p->prev;
     }
 
 #if     DEBUG == 3
 
-    tprint("%s(): Can't find memory block: %p\n", __func__, p1);
+    tprint("%s(): block #%u at %p, size = %lu\n", __func__, p->count,
+           (void *)get_data(p), (size_t)p->size);
 
 #endif
 
+    p->next = p->prev = NULL;
+
+    --nblocks;
 }
 
 #endif
 
 
 ///
-///  @brief    Verify that all memory was deallocated before we exit from TECO.
+///  @brief    Free memory pools, and verify that all memory was deallocated
+///            before we exit from TECO.
 ///
 ///  @returns  Nothing (error if memory allocation fails).
 ///
@@ -310,15 +426,37 @@ void exit_mem(void)
 
     free_mem(&ez.data);
 
+#endif
+
+    for (uint i = 0; i < POOL_COUNT; ++i)
+    {
+        char *data;
+
+        while ((data = pools[i].head) != NULL)
+        {
+            memcpy(&pools[i].head, data, sizeof(void *));
+
+            free(get_mblock(data));
+        }
+
+        pools[i].count = 0;
+    }
+
+#if     DEBUG >= 2
+
 #if     DEBUG == 3
 
     tprint("%s(): %u block%s allocated, high water mark = %u block%s\n",
            __func__, nallocs, plural(nallocs), maxblocks, plural(maxblocks));
 
+    tprint("%s(): %u block%s reused from pools\n", __func__, nreused,
+           plural(nreused));
+
 #endif
 
     struct mblock *p = mroot;
     struct mblock *next;
+    uint_t msize = mstats[MEM_ALL].size;
 
     if (msize != 0)
     {
@@ -332,21 +470,20 @@ void exit_mem(void)
 #if     DEBUG == 3
 
         tprint("%s(): lost block #%u at %p, %lu byte%s\n", __func__, p->count,
-               p->addr, (size_t)p->size, plural(p->size));
+               (void *)get_data(p), (size_t)p->size, plural(p->size));
 
 #endif
 
         next = p->next;
-        msize -= p->size;
-        p->next = p->prev = NULL;
-        p->addr = NULL;
-        p->size = 0;
 
+        count_mem(p, -1);
         free(p);
 
         p = next;
     }
 
+    mroot = NULL;
+
 #endif
 
 }
@@ -365,54 +502,57 @@ void *expand_mem(void *p1, uint_t size, uint_t delta)
     assert(size != 0);                  // Error if old size is 0
     assert(delta > 0);                  // Error if delta is 0
 
-    char *p2;
+    struct mblock *p = get_mblock(p1);
+    size_t newsize = (size_t)size + (size_t)delta;
 
-#if     DEBUG >= 2
+    count_mem(p, -1);
 
-    struct mblock *mblock = find_mblock(p1);
+    // If the block came from a pool and still fits, then we can use it as is.
+    // Otherwise, call realloc(), after which the block can no longer be
+    // returned to a pool, since it may no longer be the right size.
 
-#endif
+    if (p->pool == 0 || newsize > (size_t)p->pool * POOL_GRAIN)
+    {
 
-    size_t newsize = (size_t)size + (size_t)delta;
+        struct mblock *p2 = realloc(p, sizeof(union mhead) + newsize);
 
-    // If realloc() fails, the old memory pointed to by p1 is still valid.
-    // Don't deallocate it here, because it may be needed by our caller
-    // for something important (for example, for the edit buffer).
+        // If realloc() fails, the old memory pointed to by p1 is still valid.
+        // Don't deallocate it here, because it may be needed by our caller
+        // for something important (for example, for the edit buffer).
 
-    if ((p2 = realloc(p1, newsize)) == NULL)
-    {
-        throw(E_MEM);                   // Memory overflow
-    }
+        if (p2 == NULL)
+        {
+            count_mem(p, 1);
 
-#if     DEBUG >= 2
+            throw(E_MEM);               // Memory overflow
+        }
 
-    if (mblock != NULL)
-    {
-        msize -= mblock->size;
-        msize += size + delta;
+        p = p2;
+        p->pool = 0;
 
-#if     DEBUG == 3
+#if     DEBUG >= 2
 
-        uint_t oldsize = mblock->size;
+        move_mblock(p);
 
 #endif
 
-        mblock->addr = p2;
-        mblock->size = size + delta;
+    }
 
 #if     DEBUG == 3
 
-        tprint("%s(): block #%u at %p increased from %lu to %lu\n", __func__,
-               mblock->count, mblock->addr, (size_t)oldsize, (size_t)mblock->size);
+    tprint("%s(): block #%u at %p increased from %lu to %lu\n", __func__,
+           p->count, (void *)get_data(p), (size_t)p->size, newsize);
 
 #endif
 
-    }
+    p->size = (uint_t)newsize;
 
-#endif
+    count_mem(p, 1);
 
     // Initialize the extra memory we just allocated.
 
+    char *p2 = get_data(p);
+
     memset(p2 + size, '\0', (size_t)delta);
 
     return p2;
@@ -420,68 +560,102 @@ void *expand_mem(void *p1, uint_t size, uint_t delta)
 
 
 ///
-///  @brief    Find memory block.
+///  @brief    Deallocate memory. Small blocks are returned to their pool
+///            unless it is already full.
 ///
 ///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-#if     DEBUG >= 2
-
-static struct mblock*find_mblock(void *p1)
+void free_mem(void *p1)
 {
-    assert(p1 != NULL);                 // Error if NULL memory block
+    assert(p1 != NULL);                 // Error if NULL pointer
 
-    struct mblock *mblock = mroot;
+    char **p2 = p1;                     // Make it something we can dereference
 
-    while (mblock != NULL)
+    if (*p2 != NULL)
     {
-        if (p1 == mblock->addr)
-        {
-            return mblock;
-        }
+        struct mblock *p = get_mblock(*p2);
 
-        mblock = mblock->next;
-    }
+        count_mem(p, -1);
 
-#if     DEBUG == 3
+#if     DEBUG >= 2
 
-    tprint("%s(): Can't find memory block: %p\n", __func__, p1);
+        delete_mblock(p);
 
 #endif
 
-    return NULL;
-}
+        uint pool = p->pool;
 
-#endif
+        if (pool != 0 && pools[pool - 1].count < POOL_LIMIT)
+        {
+            memcpy(*p2, &pools[pool - 1].head, sizeof(void *));
+
+            pools[pool - 1].head = *p2;
+            ++pools[pool - 1].count;
+        }
+        else
+        {
+            free(p);
+        }
+
+        *p2 = NULL;                     // Make sure we don't use this again
+    }
+}
 
 
 ///
-///  @brief    Deallocate memory.
+///  @brief    Update memory block list after a block has been reallocated.
 ///
 ///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-void free_mem(void *p1)
+#if     DEBUG >= 2
+
+static void move_mblock(struct mblock *p)
 {
-    assert(p1 != NULL);                 // Error if NULL pointer
+    assert(p != NULL);                  // Error if NULL memory block
 
-    char **p2 = p1;                     // Make it something we can dereference
+    if (p->prev != NULL)
+    {
+        p->prev->next = p;
+    }
+    else
+    {
+        mroot = p;
+    }
 
-    if (*p2 != NULL)
+    if (p->next != NULL)
     {
+        p->next->prev = p;
+    }
+}
 
-#if     DEBUG >= 2
+#endif
 
-        delete_mblock(*p2);
 
-#endif
+///
+///  @brief    Change the type of memory a block is counted against. This is
+///            used when a block is handed from one part of TECO to another
+///            (e.g., text read from a file and stored in a Q-register).
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
 
-        free(*p2);
+void retype_mem(void *p1, enum mem_type type)
+{
+    assert(p1 != NULL);                 // Error if NULL memory block
+    assert(type > MEM_ALL && type < MEM_MAX);
 
-        *p2 = NULL;                     // Make sure we don't use this again
-    }
+    struct mblock *p = get_mblock(p1);
+
+    count_mem(p, -1);
+
+    p->type = (uchar)type;
+
+    count_mem(p, 1);
 }
 
 
@@ -499,51 +673,95 @@ void *shrink_mem(void *p1, uint_t size, uint_t delta)
     assert(delta > 0);                  // Error if delta is 0
     assert(delta < size);               // Error if reducing block to 0
 
-    char *p2;
+    struct mblock *p = get_mblock(p1);
+    size_t newsize = (size_t)size - (size_t)delta;
 
-#if     DEBUG >= 2
+    count_mem(p, -1);
 
-    struct mblock *mblock = find_mblock(p1);
+    // A block that came from a pool keeps its size class, so there's nothing
+    // to give back to the C library.
 
-#endif
+    if (p->pool == 0)
+    {
 
-    size_t newsize = (size_t)size - (size_t)delta;
+        struct mblock *p2 = realloc(p, sizeof(union mhead) + newsize);
 
-    // If realloc() fails, the old memory pointed to by p1 is still valid.
-    // Don't deallocate it here, because it may be needed by our caller
-    // for something important (for example, for the edit buffer).
+        // If realloc() fails, the old memory pointed to by p1 is still valid.
+        // Don't deallocate it here, because it may be needed by our caller
+        // for something important (for example, for the edit buffer).
 
-    if ((p2 = realloc(p1, newsize)) == NULL)
-    {
-        throw(E_MEM);                   // Memory overflow
-    }
+        if (p2 == NULL)
+        {
+            count_mem(p, 1);
 
-#if     DEBUG >= 2
+            throw(E_MEM);               // Memory overflow
+        }
 
-    if (mblock != NULL)
-    {
-        msize -= mblock->size;
-        msize += size - delta;
+        p = p2;
 
-#if     DEBUG == 3
+#if     DEBUG >= 2
 
-        uint_t oldsize = mblock->size;
+        move_mblock(p);
 
 #endif
 
-        mblock->addr = p2;
-        mblock->size = size - delta;
+    }
 
 #if     DEBUG == 3
 
-        tprint("%s(): block #%u at %p decreased from %lu to %lu\n", __func__,
-               mblock->count, mblock->addr, (size_t)oldsize, (size_t)mblock->size);
+    tprint("%s(): block #%u at %p decreased from %lu to %lu\n", __func__,
+           p->count, (void *)get_data(p), (size_t)p->size, newsize);
 
 #endif
 
-    }
+    p->size = (uint_t)newsize;
 
-#endif
+    count_mem(p, 1);
 
-    return p2;
+    return get_data(p);
+}
+
+
+///
+///  @brief    Get memory statistics for EJ command.
+///
+///  @returns  No. of bytes (or blocks) currently allocated for specified type
+///            of memory, or for all types if MEM_ALL.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+uint_t stat_mem(enum mem_type type, bool blocks)
+{
+    assert(type < MEM_MAX);
+
+    return blocks ? mstats[type].blocks : mstats[type].size;
+}
+
+
+///
+///  @brief    Account for memory that was not allocated by us (e.g., address
+///            space obtained with mmap() for the edit buffer), so that it is
+///            included in our statistics.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void track_mem(enum mem_type type, uint_t oldsize, uint_t newsize)
+{
+    assert(type != MEM_ALL && type < MEM_MAX);
+
+    mstats[type].size    += newsize - oldsize;
+    mstats[MEM_ALL].size += newsize - oldsize;
+
+    if (oldsize == 0 && newsize != 0)
+    {
+        ++mstats[type].blocks;
+        ++mstats[MEM_ALL].blocks;
+    }
+    else if (oldsize != 0 && newsize == 0)
+    {
+        --mstats[type].blocks;
+        --mstats[MEM_ALL].blocks;
+    }
 }
@@ -197,6 +197,8 @@ bool next_page(int_t start, int_t end, bool ff, bool yank)
             {
                 return false;           // False if no more data
             }
+
+            read_ahead(ifile, (uint_t)t->Z); // Start reading following page
         }
     }
 
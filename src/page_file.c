@@ -24,91 +24,879 @@
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
+
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "teco.h"
 #include "ascii.h"
+#include "editbuf.h"
+#include "eflags.h"
+#include "errors.h"
+#include "file.h"
 #include "page.h"
 
 
+//
+//  Pages that precede or follow the current page are kept in a temporary
+//  "holding file" for each output stream, as described in The Craft of Text
+//  Editing, by Craig A. Finseth, rather than in memory. Only the description
+//  of each page is kept in memory, so the amount of memory used doesn't
+//  depend on the size of the file being edited. Pages are written to the
+//  output file only when the file is closed or a PW command is executed.
+//
+//  Space in the holding file is reused when a page is read back into the
+//  edit buffer. Free space is kept in a list of extents, sorted by position
+//  and merged with their neighbors, and new pages are written to the first
+//  extent that is large enough, or at the end of the file if none is. Free
+//  space at the end of the file is returned to it, and the holding file is
+//  emptied when all pages are gone.
+//
+
+#define HOLD_BLOCK  (KB * 64)           ///< Block size for holding file I/O
+
+///  @struct   page
+///  @brief    Description of each page stored in holding file.
+
+struct page
+{
+    struct page *next;                  ///< Next page in queue
+    struct page *prev;                  ///< Previous page in queue
+    off_t pos;                          ///< Position of page in holding file
+    uint_t size;                        ///< Size of page in bytes
+    uint_t lastff;                      ///< Offset after last FF (0 if none)
+    bool CR_out;                        ///< Copy of f.e3.CR_out
+    bool ff;                            ///< Append form feed to page
+};
+
+///  @struct   extent
+///  @brief    Description of free space in holding file.
+
+struct extent
+{
+    struct extent *next;                ///< Next extent in list
+    off_t pos;                          ///< Position in holding file
+    off_t size;                         ///< Size in bytes
+};
+
+///  @struct   page_table
+///  @brief    Description of stored pages for output streams.
+
+struct page_table
+{
+    uint count;                         ///< Current page number
+    struct page *head;                  ///< Head of page list
+    struct page *tail;                  ///< Tail of page list
+    struct page *stack;                 ///< Saved page stack
+    struct extent *free;                ///< Free space in holding file
+    FILE *fp;                           ///< Holding file (or NULL)
+    off_t end;                          ///< End of data in holding file
+};
+
+///  @var      ptable
+///  @brief    Stored data for primary and secondary output streams.
+
+static struct page_table ptable[] =
+{
+    { .count = 0, .head = NULL, .tail = NULL, .stack = NULL, .free = NULL,
+      .fp = NULL },
+    { .count = 0, .head = NULL, .tail = NULL, .stack = NULL, .free = NULL,
+      .fp = NULL },
+};
+
+///  @var      hold_buf
+///  @brief    Buffer for reading from holding file.
+
+static char hold_buf[HOLD_BLOCK];
+
+// Local functions
+
+static void add_extent(struct page_table *table, off_t pos, off_t size);
+
+static void copy_page(struct page *page);
+
+static uint_t find_ff(const struct page *page);
+
+static void free_extents(struct page_table *table);
+
+static void free_page(struct page *page);
+
+static off_t get_extent(struct page_table *table, off_t size);
+
+static void link_page(struct page *page);
+
+static struct page *make_page(int_t start, int_t end, bool ff);
+
+static bool pop_page(void);
+
+static void push_page(struct page *page);
+
+static void read_page(const struct page *page, uint_t offset, uint_t nbytes);
+
+static struct page *unlink_page(void);
+
+static void write_page(FILE *fp, struct page *page);
+
+
 ///
-///  @brief    Write out current page.
+///  @brief    Add free space to extent list, merging it with any neighboring
+///            extents, and returning it to the end of the holding file if
+///            that's where it is.
 ///
-///  @returns  true if already have buffer data, false if not.
+///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-bool page_forward(FILE *fp, int_t start, int_t end, bool ff)
+static void add_extent(struct page_table *table, off_t pos, off_t size)
 {
-    assert(fp != NULL);                 // Error if no file block
+    assert(table != NULL);
 
-    struct page page;
-    int last = NUL;
+    if (size == 0)
+    {
+        return;
+    }
 
-    page.size = 0;                      // No. of bytes in output page
+    struct extent *prev = NULL;
+    struct extent *next = table->free;
 
-    // First pass - calculate how many characters we'll need to output
+    while (next != NULL && next->pos < pos)
+    {
+        prev = next;
+        next = next->next;
+    }
 
-    for (int_t i = start; i < end; ++i)
+    if (prev != NULL && prev->pos + prev->size == pos)
+    {
+        prev->size += size;             // Merge with previous extent
+    }
+    else
     {
-        int c = read_edit(i);
+        struct extent *extent = alloc_type((uint_t)sizeof(*extent), MEM_PAGE);
+
+        extent->next = next;
+        extent->pos  = pos;
+        extent->size = size;
 
-        if (c == EOF)
+        if (prev == NULL)
         {
-            break;
+            table->free = extent;
+        }
+        else
+        {
+            prev->next = extent;
+        }
+
+        prev = extent;
+    }
+
+    if (next != NULL && prev->pos + prev->size == next->pos)
+    {
+        prev->size += next->size;       // Merge with next extent
+        prev->next = next->next;
+
+        free_mem(&next);
+    }
+
+    // Free space at the end of the holding file is the last extent.
+
+    if (prev->next == NULL && prev->pos + prev->size == table->end)
+    {
+        table->end = prev->pos;
+
+        if (table->free == prev)
+        {
+            table->free = NULL;
+        }
+        else
+        {
+            struct extent *extent = table->free;
+
+            while (extent->next != prev)
+            {
+                extent = extent->next;
+            }
+
+            extent->next = NULL;
+        }
+
+        free_mem(&prev);
+    }
+}
+
+
+///
+///  @brief    Copy data in page to edit buffer, and then delete it.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void copy_page(struct page *page)
+{
+    assert(page != NULL);
+
+    kill_edit();                        // Delete all data in edit buffer
+
+    // If there is a form feed in the page (because the user added it while
+    // editing), then we have to treat it as an end of page marker, and only
+    // return the data after the form feed. We also reduce the count for the
+    // current page and add it back onto the list.
+
+    uint_t start = 0;                   // Offset of data to copy
+
+    if (!f.e3.nopage && page->lastff != 0)
+    {
+        start = page->lastff;
+    }
+
+    // Copy page data to edit buffer. Since this data originated in the edit
+    // buffer, we assume it will fit, and therefore don't bother to check for
+    // warnings or errors.
+
+    for (uint_t offset = start; offset < page->size; )
+    {
+        uint_t nbytes = page->size - offset;
+
+        if (nbytes > HOLD_BLOCK)
+        {
+            nbytes = HOLD_BLOCK;
+        }
+
+        read_page(page, offset, nbytes);
+
+        (void)insert_edit(hold_buf, (size_t)nbytes);
+
+        offset += nbytes;
+    }
+
+    set_dot(t->B);                      // Reset to start of buffer
+
+    if (start != 0)
+    {
+        // Drop the FF and what follows it.
+
+        add_extent(&ptable[ostream], page->pos + (off_t)start - 1,
+                   (off_t)(page->size - start + 1));
+
+        page->size   = start - 1;
+        page->ff     = true;
+        page->lastff = find_ff(page);
+
+        link_page(page);
+    }
+    else
+    {
+        f.ctrl_e = page->ff;
+
+        free_page(page);
+    }
+}
+
+
+///
+///  @brief    Find the last form feed in a page stored in holding file.
+///
+///  @returns  Offset following form feed, or 0 if none found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t find_ff(const struct page *page)
+{
+    assert(page != NULL);
+
+    uint_t end = page->size;
+
+    while (end != 0)
+    {
+        uint_t nbytes = end < HOLD_BLOCK ? end : HOLD_BLOCK;
+
+        read_page(page, end - nbytes, nbytes);
+
+        for (uint_t i = nbytes; i-- > 0; )
+        {
+            if (hold_buf[i] == FF)
+            {
+                return end - nbytes + i + 1;
+            }
         }
 
-        // Translate LF to CR/LF if needed, unless last chr. was CR
+        end -= nbytes;
+    }
+
+    return 0;
+}
+
+
+///
+///  @brief    Deallocate list of free extents in holding file.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_extents(struct page_table *table)
+{
+    assert(table != NULL);
+
+    struct extent *extent;
+
+    while ((extent = table->free) != NULL)
+    {
+        table->free = extent->next;
+
+        free_mem(&extent);
+    }
+}
+
 
-        if (c == LF && last != CR && f.e3.CR_out)
+///
+///  @brief    Deallocate page, and reclaim its space in holding file.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_page(struct page *page)
+{
+    assert(page != NULL);
+
+    struct page_table *table = &ptable[ostream];
+
+    add_extent(table, page->pos, (off_t)page->size);
+
+    free_mem(&page);
+
+    if (table->head == NULL && table->stack == NULL)
+    {
+        free_extents(table);
+
+        table->end = 0;                 // Holding file is now empty
+    }
+}
+
+
+///
+///  @brief    Get space for page in holding file, using the first free extent
+///            that is large enough.
+///
+///  @returns  Position in holding file.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static off_t get_extent(struct page_table *table, off_t size)
+{
+    assert(table != NULL);
+
+    struct extent *prev = NULL;
+    struct extent *extent = table->free;
+
+    while (extent != NULL && extent->size < size)
+    {
+        prev = extent;
+        extent = extent->next;
+    }
+
+    if (extent == NULL)                 // Nothing free, so use end of file
+    {
+        off_t pos = table->end;
+
+        table->end += size;
+
+        return pos;
+    }
+
+    off_t pos = extent->pos;
+
+    extent->pos  += size;
+    extent->size -= size;
+
+    if (extent->size == 0)
+    {
+        if (prev == NULL)
+        {
+            table->free = extent->next;
+        }
+        else
         {
-            ++page.size;
+            prev->next = extent->next;
         }
 
-        ++page.size;
+        free_mem(&extent);
+    }
+
+    return pos;
+}
+
+
+///
+///  @brief    Add page to tail of linked list.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
 
-        last = c;
+static void link_page(struct page *page)
+{
+    assert(page != NULL);
+
+    if (ptable[ostream].head == NULL)
+    {
+        ptable[ostream].head = page;       // Head -> new page
     }
+    else
+    {
+        page->prev = ptable[ostream].tail; // New page -> last page
+        ptable[ostream].tail->next = page; // Last page -> new page
+    }
+
+    ptable[ostream].tail = page;           // Tail -> new page
+}
+
+
+///
+///  @brief    Create page with data from edit buffer, and store it at the end
+///            of the holding file. Note that if we're treating form feeds as a
+///            page delimiter, then we have to adjust the page count for any
+///            form feeds that the user may have added to the current page.
+///            This is to handle the situation where the user subsequently
+///            executes -P commands.
+///
+///  @returns  Pointer to page we created.
+///
+////////////////////////////////////////////////////////////////////////////////
 
-    if (ff)                             // Add a form feed if necessary
+static struct page *make_page(int_t start, int_t end, bool ff)
+{
+    struct page_table *table = &ptable[ostream];
+
+    if (table->fp == NULL && (table->fp = tmpfile()) == NULL)
     {
-        ++page.size;
+        throw(E_ERR, NULL);             // Can't create holding file
     }
 
-    // Second pass - fill page and then output it
+    struct page *page = alloc_type((uint_t)sizeof(*page), MEM_PAGE);
+
+    page->next   = page->prev = NULL;
+    page->pos    = get_extent(table, (off_t)(end - start));
+    page->size   = (uint_t)(end - start);
+    page->lastff = 0;
+    page->CR_out = f.e3.CR_out;
+    page->ff     = ff;
 
-    page.addr = alloc_mem((uint_t)page.size); // Allocate memory for page
+    if (fseeko(table->fp, page->pos, SEEK_SET) != 0)
+    {
+        free_page(page);
+
+        throw(E_ERR, NULL);
+    }
 
-    char *p = page.addr;
+    // Write the text a span at a time, so that we don't need to copy it.
 
-    for (int i = start; i < end; ++i)
+    for (int_t pos = start; pos < end; )
     {
-        int c = read_edit(i);
+        int_t nbytes;
+        const uchar *p = span_edit(pos, &nbytes);
 
-        if (c == EOF)
+        assert(p != NULL);
+
+        if (nbytes > end - pos)
+        {
+            nbytes = end - pos;
+        }
+
+        for (const uchar *q = p; (q = memchr(q, FF, (size_t)(p + nbytes - q)))
+                 != NULL; ++q)
+        {
+            page->lastff = (uint_t)(pos - start + (q - p)) + 1;
+
+            if (ff)
+            {
+                ++table->count;
+            }
+        }
+
+        if (fwrite(p, 1uL, (size_t)nbytes, table->fp) != (size_t)nbytes)
+        {
+            free_page(page);
+
+            throw(E_ERR, NULL);         // Can't write holding file
+        }
+
+        pos += nbytes;
+    }
+
+    return page;
+}
+
+
+///
+///  @brief    Read in previous page.
+///
+///  @returns  true if we have a new page, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool page_backward(int_t count, bool ff)
+{
+    assert(count < 0);
+    assert(ostream == OFILE_PRIMARY || ostream == OFILE_SECONDARY);
+
+    // Create a new page with data from edit buffer and push it on the stack.
+
+    struct page *page;
+
+    if (t->Z != 0)
+    {
+        set_dot(t->B);
+
+        page = make_page(t->B, t->Z, ff);
+
+        kill_edit();
+
+        push_page(page);
+    }
+
+    // Now unlink pages from linked list and push them on the stack, until we
+    // find the one we want (which will then be popped off the stack).
+
+    while (count++ < 0)
+    {
+        if ((page = unlink_page()) == NULL)
         {
             break;
         }
 
-        // Translate LF to CR/LF if needed, unless last chr. was CR
+        push_page(page);                // Then push it on stack
 
-        if (c == LF && last != CR && f.e3.CR_out)
+        if (count == 0)
         {
-            *p++ = CR;
+            bool havedata = pop_page();
+
+            if (havedata)
+            {
+                --ptable[ostream].count;
+            }
+
+            return havedata;
         }
+    }
 
-        *p++ = (char)c;
+    if (ptable[ostream].count > 0)
+    {
+        --ptable[ostream].count;
     }
 
-    if (ff)                             // Add a form feed if necessary
+    return f.ctrl_e = false;
+}
+
+
+///
+///  @brief    Get page count for current page.
+///
+///  @returns  Page number (0 if no data in buffer).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+uint page_count(void)
+{
+    assert(ostream == OFILE_PRIMARY || ostream == OFILE_SECONDARY);
+
+    return ptable[ostream].count;
+}
+
+
+///
+///  @brief    Flush out remaining pages.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void page_flush(FILE *fp)
+{
+    assert(fp != NULL);                 // Error if no file block
+    assert(ostream == OFILE_PRIMARY || ostream == OFILE_SECONDARY);
+
+    struct page *page;
+
+    // Write out all pages in queue.
+
+    while ((page = ptable[ostream].head) != NULL)
     {
-        *p++ = FF;
+        ptable[ostream].head = page->next;
+
+        write_page(fp, page);
     }
 
-    assert((uint)(p - page.addr) == page.size); // Verify no. of output bytes
+    ptable[ostream].tail = NULL;
+
+    while ((page = ptable[ostream].stack) != NULL)
+    {
+        ptable[ostream].stack = page->next;
+
+        write_page(fp, page);
+    }
 
-    fwrite(page.addr, (size_t)page.size, 1uL, fp);
+    free_extents(&ptable[ostream]);
 
-    free_mem(&page.addr);
+    ptable[ostream].count = 0;
+    ptable[ostream].end   = 0;
+}
+
+
+///
+///  @brief    Write out current page.
+///
+///  @returns  true if already have buffer data, false if not.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool page_forward(FILE *unused, int_t start, int_t end, bool ff)
+{
+    assert(ostream == OFILE_PRIMARY || ostream == OFILE_SECONDARY);
+
+    if (start != end)
+    {
+        struct page *page = make_page(t->dot + start, t->dot + end, ff);
+
+        link_page(page);
+    }
+
+    ++ptable[ostream].count;
+
+    return pop_page();
+}
+
+
+///
+///  @brief    Pop page from stack, and copy to edit buffer.
+///
+///  @returns  true if there was a page on stack, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool pop_page(void)
+{
+    struct page *page = ptable[ostream].stack;
+
+    if (page == NULL)
+    {
+        return false;
+    }
+
+    ptable[ostream].stack = page->next;
+
+    copy_page(page);
+
+    return true;
+}
+
+
+///
+///  @brief    Push page onto stack.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void push_page(struct page *page)
+{
+    assert(page != NULL);
+
+    page->next = ptable[ostream].stack;
+
+    ptable[ostream].stack = page;
+}
+
+
+///
+///  @brief    Read part of a page from holding file into our buffer.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void read_page(const struct page *page, uint_t offset, uint_t nbytes)
+{
+    assert(page != NULL);
+    assert(nbytes <= HOLD_BLOCK);
+
+    FILE *fp = ptable[ostream].fp;
+
+    assert(fp != NULL);
+
+    if (fseeko(fp, page->pos + (off_t)offset, SEEK_SET) != 0
+        || fread(hold_buf, 1uL, (size_t)nbytes, fp) != (size_t)nbytes)
+    {
+        throw(E_ERR, NULL);             // Can't read holding file
+    }
+}
+
+
+///
+///  @brief    Reset all pages (used by EK and EX commands).
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void reset_pages(uint stream)
+{
+    assert(stream == OFILE_PRIMARY || stream == OFILE_SECONDARY);
+
+    struct page *page;
+
+    while ((page = ptable[stream].head) != NULL)
+    {
+        ptable[stream].head = page->next;
+
+        free_mem(&page);
+    }
+
+    ptable[stream].tail = NULL;
+
+    // Free up anything on the page stack
+
+    while ((page = ptable[stream].stack) != NULL)
+    {
+        ptable[stream].stack = page->next;
+
+        free_mem(&page);
+    }
+
+    // Closing the holding file deletes it, and returns its disk space.
+
+    if (ptable[stream].fp != NULL)
+    {
+        fclose(ptable[stream].fp);
+
+        ptable[stream].fp = NULL;
+    }
+
+    free_extents(&ptable[stream]);
+
+    ptable[stream].end = 0;
+}
+
+
+///
+///  @brief    Set page count for current page.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void set_page(uint page)
+{
+    assert(ostream == OFILE_PRIMARY || ostream == OFILE_SECONDARY);
+
+    ptable[ostream].count = page;
+}
+
+
+///
+///  @brief    Unlink page from end of linked list.
+///
+///  @returns  Returned page, or NULL if list is empty.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct page *unlink_page(void)
+{
+    struct page *page;
+
+    if ((page = ptable[ostream].tail) == NULL)
+    {
+        return NULL;
+    }
+
+    assert(page->next == NULL);
+
+    if (page->prev == NULL)             // Only page in list?
+    {
+        ptable[ostream].head = NULL;
+        ptable[ostream].tail = NULL;
+    }
+    else
+    {
+        ptable[ostream].tail = page->prev;
+
+        page->prev->next = NULL;
+        page->prev       = NULL;
+        page->next       = NULL;
+    }
+
+    return page;
+}
+
+
+///
+///  @brief    Write page to file, copying it from holding file a block at a
+///            time, and adding CRs as needed.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void write_page(FILE *fp, struct page *page)
+{
+    assert(fp != NULL);
+    assert(page != NULL);
+
+    char last = NUL;
+
+    for (uint_t offset = 0; offset < page->size; )
+    {
+        uint_t nbytes = page->size - offset;
+
+        if (nbytes > HOLD_BLOCK)
+        {
+            nbytes = HOLD_BLOCK;
+        }
+
+        read_page(page, offset, nbytes);
+        write_text(fp, hold_buf, nbytes, page->CR_out, &last);
+
+        offset += nbytes;
+    }
+
+    if (page->ff)
+    {
+        fputc(FF, fp);
+    }
+
+    free_mem(&page);
+}
+
+
+///
+///  @brief    Read in previous page, discarding current page.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void yank_backward(FILE *unused)
+{
+    assert(ostream == OFILE_PRIMARY || ostream == OFILE_SECONDARY);
+
+    struct page *page;
+
+    if (!pop_page())
+    {
+        if ((page = unlink_page()) == NULL)
+        {
+            kill_edit();
+        }
+        else
+        {
+            copy_page(page);
+        }
+    }
+
+    if (ptable[ostream].count > 0)
+    {
+        --ptable[ostream].count;
+    }
 }
@@ -114,29 +114,29 @@ bool page_forward(FILE *fp, int_t start, int_t end, bool ff)
 {
     assert(fp != NULL);                 // Error if no file block
 
-    int last = NUL;
+    char last = NUL;
 
-    // First pass - calculate how many characters we'll need to output
+    // Write the text a span at a time, translating LF to CR/LF if needed.
+    // Note that start and end are relative to dot.
 
-    for (int_t i = start; i < end; ++i)
+    for (int_t pos = t->dot + start; pos < t->dot + end; )
     {
-        int c = read_edit(i);
+        int_t nbytes;
+        const uchar *p = span_edit(pos, &nbytes);
 
-        if (c == EOF)
+        if (p == NULL)
         {
             break;
         }
 
-        // Translate LF to CR/LF if needed, unless last chr. was CR
-
-        if (c == LF && last != CR && f.e3.CR_out)
+        if (nbytes > t->dot + end - pos)
         {
-            fputc(CR, fp);
+            nbytes = t->dot + end - pos;
         }
 
-        fputc(c, fp);
+        write_text(fp, (const char *)p, (uint_t)nbytes, f.e3.CR_out, &last);
 
-        last = c;
+        pos += nbytes;
     }
 
     if (ff)                             // Add a form feed if necessary
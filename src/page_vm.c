@@ -46,7 +46,6 @@ struct page
     struct page *prev;                  ///< Previous page in queue
     char *addr;                         ///< Address of page
     uint_t size;                        ///< Size of page in bytes
-    uint_t cr;                          ///< No. of added CRs in page
     bool CR_out;                        ///< Copy of f.e3.CR_out
     bool ff;                            ///< Append form feed to page
 };
@@ -182,37 +181,46 @@ static void link_page(struct page *page)
 
 static struct page *make_page(int_t start, int_t end, bool ff)
 {
-    struct page *page = alloc_mem((uint_t)sizeof(*page));
+    struct page *page = alloc_type((uint_t)sizeof(*page), MEM_PAGE);
 
     page->next   = page->prev = NULL;
     page->size   = (uint)(end - start);
-    page->cr     = 0;
     page->CR_out = f.e3.CR_out;
     page->ff     = ff;
-    page->addr   = alloc_mem(page->size);
+    page->addr   = alloc_type(page->size, MEM_PAGE);
 
-    char *p  = page->addr;
-    char last = NUL;
+    // Copy the text a span at a time. Note that start and end are relative
+    // to dot.
+
+    char *p = page->addr;
 
-    for (int_t i = start; i < end; ++i)
+    for (int_t pos = t->dot + start; pos < t->dot + end; )
     {
-        int c = read_edit(i);
+        int_t nbytes;
+        const uchar *q = span_edit(pos, &nbytes);
 
-        if (c == EOF)
-        {
-            break;
-        }
+        assert(q != NULL);
 
-        if (c == LF && last != CR && page->CR_out)
+        if (nbytes > t->dot + end - pos)
         {
-            ++page->cr;
+            nbytes = t->dot + end - pos;
         }
-        else if (ff && c == FF)
+
+        memcpy(p, q, (size_t)nbytes);
+
+        if (ff)
         {
-            ++ptable[ostream].count;
+            const char *r = p;
+
+            while ((r = memchr(r, FF, (size_t)(p + nbytes - r))) != NULL)
+            {
+                ++r;
+                ++ptable[ostream].count;
+            }
         }
 
-        *p++ = last = (char)c;
+        p   += nbytes;
+        pos += nbytes;
     }
 
     assert(p - page->addr == (ptrdiff_t)page->size);
@@ -496,32 +504,15 @@ static void write_page(FILE *fp, struct page *page)
     assert(fp != NULL);
     assert(page != NULL);
 
-    char   last   = NUL;
-    uint_t nbytes = page->size + page->cr + (page->ff ? 1 : 0);
-    char   *src   = page->addr;
-    char   *dst   = alloc_mem(nbytes);
-    char   *p     = dst;
-
-    while (page->size-- > 0)
-    {
-        char c = *src++;
-
-        if (c == LF && last != CR && page->CR_out)
-        {
-            *p++ = CR;
-        }
+    char last = NUL;
 
-        *p++ = last = c;
-    }
+    write_text(fp, page->addr, page->size, page->CR_out, &last);
 
     if (page->ff)
     {
-        *p++ = FF;
+        fputc(FF, fp);
     }
 
-    fwrite(dst, (ulong)nbytes, 1uL, fp);
-
-    free_mem(&dst);
     free_mem(&page->addr);
     free_mem(&page);
 }
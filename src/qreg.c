@@ -132,11 +132,14 @@ static uint qstack_depth = 0;       ///< Current Q-register stack depth
 static struct qreg qglobal[QCOUNT];
 
 ///  @struct qlocal
-///  @brief  Local Q-register set.
+///  @brief  Local Q-register set. Sets are recycled rather than deallocated
+///          when a macro returns, and are only cleaned up if a macro actually
+///          used any of their Q-registers, so that macro calls are cheap.
 
 struct qlocal
 {
     struct qlocal *next;                ///< Next item in list
+    bool used;                          ///< true if any Q-register used
     struct qreg qreg[QCOUNT];           ///< Local Q-register set
 };
 
@@ -150,6 +153,11 @@ static struct qlocal local_base;
 
 static struct qlocal *local_head = &local_base;
 
+///  @var    local_pool
+///  @brief  Unused local Q-register sets, all of which are empty.
+
+static struct qlocal *local_pool = NULL;
+
 ////////////////////////////////////////////////////////////////////////////////
 ///
 ///  Definitions for Q-register push-down list. This is actually implemented as
@@ -172,11 +180,47 @@ struct qlist
 
 static struct qlist *list_head = NULL;
 
+///  @var    qversion
+///  @brief  Incremented whenever the text of any Q-register may have changed,
+///          including when local Q-registers are pushed or popped. This allows
+///          compiled search strings that use ^EGq to tell if they're stale.
+
+uint_t qversion = 0;
+
+
+///  @def    QHOLD_MAX
+///  @brief  Maximum no. of Q-registers held by executing macros.
+
+#define QHOLD_MAX       64
+
+///  @var    qhold
+///  @brief  Shared copies of Q-registers held by executing macros. These are
+///          released when the macros finish, or when an error occurs.
+
+static struct qreg qhold[QHOLD_MAX];
+
+///  @var    qhold_depth
+///  @brief  No. of Q-registers currently held.
+
+static uint qhold_depth = 0;
+
 
 // Local functions
 
+static void expand_qtext(struct qreg *qreg, uint_t nbytes);
+
+static void free_qlocal(struct qlocal *qlocal);
+
+static void free_qtext(struct qreg *qreg);
+
 static INLINE struct qreg *qregister(int qindex);
 
+static void share_qtext(struct qreg *qreg);
+
+static void trim_qtext(struct qreg *qreg);
+
+static void unshare_qtext(struct qreg *qreg);
+
 
 ///
 ///  @brief    Append character to Q-register.
@@ -189,23 +233,49 @@ void append_qchr(int qindex, int c)
 {
     struct qreg *qreg = qregister(qindex);
 
-    if (qreg->text.data == NULL)
+    unshare_qtext(qreg);
+
+    if (qreg->text.data == NULL || qreg->text.len == qreg->text.size)
     {
-        qreg->text.pos  = 0;
-        qreg->text.len  = 0;
-        qreg->text.size = KB;
-        qreg->text.data = alloc_mem((uint_t)qreg->text.size);
+        expand_qtext(qreg, 1);
     }
-    else
+
+    qreg->text.data[qreg->text.len++] = (char)c;
+
+    ++qversion;
+}
+
+
+///
+///  @brief    Append text to Q-register.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void append_qtext(int qindex, const char *text, uint_t nbytes)
+{
+    assert(text != NULL);
+
+    if (nbytes == 0)
     {
-        if (qreg->text.len == qreg->text.size)
-        {
-            qreg->text.data = expand_mem(qreg->text.data, qreg->text.size, KB);
-            qreg->text.size += KB;
-        }
+        return;
     }
 
-    qreg->text.data[qreg->text.len++] = (char)c;
+    struct qreg *qreg = qregister(qindex);
+
+    unshare_qtext(qreg);
+
+    if (qreg->text.data == NULL || qreg->text.size - qreg->text.len < nbytes)
+    {
+        expand_qtext(qreg, nbytes);
+    }
+
+    memcpy(qreg->text.data + qreg->text.len, text, (size_t)nbytes);
+
+    qreg->text.len += nbytes;
+
+    ++qversion;
 }
 
 
@@ -220,11 +290,9 @@ void delete_qtext(int qindex)
 {
     struct qreg *qreg = qregister(qindex);
 
-    free_mem(&qreg->text.data);
+    free_qtext(qreg);
 
-    qreg->text.size = 0;
-    qreg->text.len  = 0;
-    qreg->text.pos  = 0;
+    ++qversion;
 }
 
 
@@ -247,7 +315,7 @@ void exit_qreg(void)
     {
         list_head = savedq->next;
 
-        free_mem(&savedq->qreg.text.data);
+        free_qtext(&savedq->qreg);
         free_mem(&savedq);
     }
 
@@ -262,21 +330,135 @@ void exit_qreg(void)
 
         for (uint i = 0; i < QCOUNT; ++i)
         {
-            if (local_head->qreg[i].text.data != NULL)
-            {
-                free_mem(&local_head->qreg[i].text.data);
-            }
+            free_qtext(&local_head->qreg[i]);
         }
     }
 
+    // Free the unused local Q-register sets
+
+    struct qlocal *qlocal;
+
+    while ((qlocal = local_pool) != NULL)
+    {
+        local_pool = qlocal->next;
+
+        free_mem(&qlocal);
+    }
+
     // Free the global Q-registers
 
     for (uint i = 0; i < QCOUNT; ++i)
     {
-        struct qreg *qreg = &qglobal[i];
+        free_qtext(&qglobal[i]);
+    }
+}
 
+
+///
+///  @brief    Expand Q-register text storage so that there is room for at least
+///            the specified no. of additional bytes. Storage grows by at least
+///            half again each time, so that building up a large Q-register one
+///            character or one string at a time doesn't take quadratic time.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void expand_qtext(struct qreg *qreg, uint_t nbytes)
+{
+    assert(qreg != NULL);
+
+    if (qreg->text.data == NULL)
+    {
+        qreg->text.pos  = 0;
+        qreg->text.len  = 0;
+        qreg->text.size = (nbytes < KB) ? KB : nbytes;
+        qreg->text.data = alloc_type(qreg->text.size, MEM_QREG);
+
+        return;
+    }
+
+    uint_t delta = qreg->text.size / 2;
+
+    if (delta < KB)
+    {
+        delta = KB;
+    }
+
+    if (delta < nbytes - (qreg->text.size - qreg->text.len))
+    {
+        delta = nbytes - (qreg->text.size - qreg->text.len);
+    }
+
+    qreg->text.data = expand_mem(qreg->text.data, qreg->text.size, delta);
+    qreg->text.size += delta;
+}
+
+
+///
+///  @brief    Free local Q-register set, by returning it to the pool of unused
+///            sets. If any of its Q-registers were used, then they are cleared
+///            first.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_qlocal(struct qlocal *qlocal)
+{
+    assert(qlocal != NULL);
+
+    if (qlocal->used)
+    {
+        for (uint i = 0; i < QCOUNT; ++i)
+        {
+            struct qreg *qreg = &qlocal->qreg[i];
+
+            if (qreg->text.data != NULL)
+            {
+                free_qtext(qreg);
+            }
+
+            qreg->n = 0;
+        }
+
+        qlocal->used = false;
+    }
+
+    qlocal->next = local_pool;
+
+    local_pool = qlocal;
+}
+
+
+///
+///  @brief    Free Q-register text storage, or if it's shared, just release
+///            our reference to it.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_qtext(struct qreg *qreg)
+{
+    assert(qreg != NULL);
+
+    if (qreg->refs != NULL && --*qreg->refs != 0)
+    {
+        qreg->text.data = NULL;         // Someone else still has it
+    }
+    else
+    {
+        discard_tokens(qreg->text.data);
+
+        free_mem(&qreg->refs);
         free_mem(&qreg->text.data);
     }
+
+    qreg->refs      = NULL;
+    qreg->text.size = 0;
+    qreg->text.len  = 0;
+    qreg->text.pos  = 0;
 }
 
 
@@ -400,6 +582,8 @@ struct qreg *get_qreg(int qindex)
 {
     if (qindex >= QCOUNT)
     {
+        local_head->used = true;
+
         return &local_head->qreg[qindex - QCOUNT];
     }
     else
@@ -424,6 +608,33 @@ uint_t get_qsize(int qindex)
 }
 
 
+///
+///  @brief    Hold shared copy of Q-register text, so that it's not changed or
+///            deallocated while a macro is executing it, even if the macro
+///            modifies the Q-register. The copy must be released by calling
+///            release_qtext() when the macro is done.
+///
+///  @returns  Q-register text.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+tbuffer hold_qtext(int qindex)
+{
+    if (qhold_depth == QHOLD_MAX)
+    {
+        throw(E_MAX);                   // Internal program limit reached
+    }
+
+    struct qreg *qreg = qregister(qindex);
+
+    share_qtext(qreg);
+
+    qhold[qhold_depth] = *qreg;
+
+    return qhold[qhold_depth++].text;
+}
+
+
 ///
 ///  @brief    Initialize Q-register storage.
 ///
@@ -450,17 +661,11 @@ void pop_qlocal(void)
 
     local_head = saved_set->next;
 
-    for (uint i = 0; i < QCOUNT; ++i)
-    {
-        if (saved_set->qreg[i].text.data != NULL)
-        {
-            free_mem(&saved_set->qreg[i].text.data);
-        }
-    }
-
-    free_mem(&saved_set);
+    free_qlocal(saved_set);
 
     --qlocal_depth;
+
+    ++qversion;
 }
 
 
@@ -484,17 +689,18 @@ bool pop_qreg(int qindex)
 
     list_head = savedq->next;
 
-    if (qreg->text.data != NULL && qreg->text.data != savedq->qreg.text.data)
-    {
-        free_mem(&qreg->text.data);
-    }
+    free_qtext(qreg);
 
     *qreg = savedq->qreg;
 
     free_mem(&savedq);
 
+    trim_qtext(qreg);
+
     --qstack_depth;
 
+    ++qversion;
+
     return true;
 }
 
@@ -540,16 +746,27 @@ void push_qlocal(void)
 
     ++qlocal_depth;
 
-    struct qlocal *qlocal = alloc_mem((uint_t)sizeof(*qlocal));
+    struct qlocal *qlocal = local_pool;
+
+    if (qlocal != NULL)
+    {
+        local_pool = qlocal->next;
+    }
+    else
+    {
+        qlocal = alloc_type((uint_t)sizeof(*qlocal), MEM_QREG);
+    }
 
     qlocal->next = local_head;
 
     local_head = qlocal;
+
+    ++qversion;
 }
 
 
 ///
-///  @brief    Push (deep) copy of Q-register onto push-down list.
+///  @brief    Push copy of Q-register onto push-down list.
 ///
 ///  @returns  true if success, false if push-down list is full.
 ///
@@ -565,24 +782,14 @@ bool push_qreg(int qindex)
     ++qstack_depth;
 
     struct qreg *qreg    = qregister(qindex);
-    struct qlist *savedq = alloc_mem((uint_t)sizeof(*savedq));
+    struct qlist *savedq = alloc_type((uint_t)sizeof(*savedq), MEM_QREG);
 
-    savedq->qreg.n         = qreg->n;
-    savedq->qreg.text.size = qreg->text.size;
-    savedq->qreg.text.pos  = qreg->text.pos;
-    savedq->qreg.text.len  = qreg->text.len;
+    // The saved copy shares the Q-register's text storage, which only gets
+    // copied if the Q-register is modified before it's popped.
 
-    if (savedq->qreg.text.size == 0)
-    {
-        savedq->qreg.text.data = NULL;
-    }
-    else
-    {
-        savedq->qreg.text.data = alloc_mem(savedq->qreg.text.size);
+    share_qtext(qreg);
 
-        memcpy(savedq->qreg.text.data, qreg->text.data,
-               (size_t)savedq->qreg.text.size);
-    }
+    savedq->qreg = *qreg;
 
     savedq->next = list_head;
 
@@ -607,11 +814,28 @@ static INLINE struct qreg *qregister(int qindex)
     }
     else
     {
+        local_head->used = true;
+
         return &local_head->qreg[qindex - QCOUNT];
     }
 }
 
 
+///
+///  @brief    Release Q-register text held by hold_qtext().
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void release_qtext(void)
+{
+    assert(qhold_depth != 0);           // Error if nothing held
+
+    free_qtext(&qhold[--qhold_depth]);
+}
+
+
 ///
 ///  @brief    Free local Q-registers.
 ///
@@ -629,19 +853,20 @@ void reset_qreg(void)
 
             local_head = saved_set->next;
 
-            for (uint i = 0; i < QCOUNT; ++i)
-            {
-                if (saved_set->qreg[i].text.data != NULL)
-                {
-                    free_mem(&saved_set->qreg[i].text.data);
-                }
-            }
-
-            free_mem(&saved_set);
+            free_qlocal(saved_set);
         }
     }
 
     qlocal_depth = 0;
+
+    // Release anything held by macros that were executing.
+
+    while (qhold_depth != 0)
+    {
+        free_qtext(&qhold[--qhold_depth]);
+    }
+
+    ++qversion;
 }
 
 
@@ -681,6 +906,33 @@ bool scan_qreg(struct cmd *cmd)
 }
 
 
+///
+///  @brief    Share Q-register text storage, by adding to its reference count.
+///            The caller is responsible for copying the Q-register structure.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void share_qtext(struct qreg *qreg)
+{
+    assert(qreg != NULL);
+
+    if (qreg->text.data == NULL)
+    {
+        return;                         // Nothing to share
+    }
+
+    if (qreg->refs == NULL)
+    {
+        qreg->refs  = alloc_type((uint_t)sizeof(*qreg->refs), MEM_QREG);
+        *qreg->refs = 1;
+    }
+
+    ++*qreg->refs;
+}
+
+
 ///
 ///  @brief    Store character in Q-register.
 ///
@@ -692,14 +944,31 @@ void store_qchr(int qindex, int c)
 {
     struct qreg *qreg = qregister(qindex);
 
-    free_mem(&qreg->text.data);
+    // Reuse any existing storage (unless it's shared), but don't keep more
+    // than we would have allocated for a new Q-register.
 
-    qreg->text.pos  = 0;
-    qreg->text.len  = 0;
-    qreg->text.size = KB;
-    qreg->text.data = alloc_mem(qreg->text.size);
+    if (qreg->refs != NULL)
+    {
+        free_qtext(qreg);
+    }
+
+    if (qreg->text.data == NULL)
+    {
+        expand_qtext(qreg, 1);
+    }
+    else if (qreg->text.size > KB)
+    {
+        qreg->text.data = shrink_mem(qreg->text.data, qreg->text.size,
+                                     qreg->text.size - KB);
+        qreg->text.size = KB;
+    }
+
+    qreg->text.pos = 0;
+    qreg->text.len = 0;
 
     qreg->text.data[qreg->text.len++] = (char)c;
+
+    ++qversion;
 }
 
 
@@ -732,7 +1001,92 @@ void store_qtext(int qindex, tbuffer *text)
 
     struct qreg *qreg = get_qreg(qindex);
 
-    free_mem(&qreg->text.data);
+    free_qtext(qreg);
 
     qreg->text = *text;
+
+    retype_mem(qreg->text.data, MEM_QREG);
+
+    ++qversion;
+}
+
+
+///
+///  @brief    Trim any unused Q-register text storage, provided that no one
+///            else is using it.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void trim_qtext(struct qreg *qreg)
+{
+    assert(qreg != NULL);
+
+    if (qreg->text.data == NULL)
+    {
+        return;                         // Nothing to trim
+    }
+    else if (qreg->refs != NULL)
+    {
+        if (*qreg->refs != 1)
+        {
+            return;                     // Still shared, so leave it alone
+        }
+
+        free_mem(&qreg->refs);          // It's all ours now
+    }
+
+    if (qreg->text.len == qreg->text.size)
+    {
+        return;                         // No unused storage
+    }
+    else if (qreg->text.len == 0)
+    {
+        free_qtext(qreg);
+
+        return;
+    }
+
+    discard_tokens(qreg->text.data);    // Storage may move
+
+    qreg->text.data = shrink_mem(qreg->text.data, qreg->text.size,
+                                 qreg->text.size - qreg->text.len);
+    qreg->text.size = qreg->text.len;
+}
+
+
+///
+///  @brief    Make private copy of Q-register text storage if it's shared, so
+///            that it can be modified. This is the "copy" in copy-on-write.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void unshare_qtext(struct qreg *qreg)
+{
+    assert(qreg != NULL);
+
+    if (qreg->refs == NULL)
+    {
+        return;                         // Not shared
+    }
+    else if (*qreg->refs == 1)          // Are we the only user left?
+    {
+        discard_tokens(qreg->text.data); // Macro tokens will be out of date
+
+        free_mem(&qreg->refs);          // Yes, so it's all ours
+
+        return;
+    }
+
+    --*qreg->refs;
+
+    char *data = alloc_type(qreg->text.size, MEM_QREG);
+
+    memcpy(data, qreg->text.data, (size_t)qreg->text.len);
+
+    qreg->text.data = data;
+    qreg->refs      = NULL;
 }
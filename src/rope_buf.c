@@ -0,0 +1,1834 @@
+///
+///  @file    rope_buf.c
+///  @brief   Text buffer functions, using a rope instead of a gap buffer.
+///
+///  @copyright 2019-2023 Franklin P. Johnston / Nowwith Treble Software
+///
+///  Permission is hereby granted, free of charge, to any person obtaining a
+///  copy of this software and associated documentation files (the "Software"),
+///  to deal in the Software without restriction, including without limitation
+///  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+///  and/or sell copies of the Software, and to permit persons to whom the
+///  Software is furnished to do so, subject to the following conditions:
+///
+///  The above copyright notice and this permission notice shall be included in
+///  all copies or substantial portions of the Software.
+///
+///  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIA-
+///  BILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///  THE SOFTWARE.
+///
+///  The text in the buffer is split into chunks of no more than CHUNK_SIZE
+///  bytes, which are kept in a treap (a binary tree that is balanced by giving
+///  each node a random priority), ordered by position. Each node also records
+///  the no. of bytes and line delimiters in its subtree, so finding a position
+///  or a line takes logarithmic time. Insertions and deletions only move text
+///  within a single chunk, or split and merge subtrees, so the cost of an edit
+///  doesn't depend on how far it is from the previous one, and the buffer never
+///  has to be reallocated or copied as it grows.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include <assert.h>
+
+#if     !defined(NDEBUG)
+
+#include <ctype.h>
+
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "teco.h"
+#include "ascii.h"
+#include "display.h"
+#include "editbuf.h"
+#include "eflags.h"
+#include "errors.h"
+#include "page.h"
+#include "profile.h"
+
+
+#if     !defined(EDIT_MAX)
+
+#if     INT_T == 64
+
+#if     defined(PAGE_VM)
+#define EDIT_MAX    (GB * 16)       ///< Maximum size is 16 GB (w/ VM)
+#else
+#define EDIT_MAX    (MB)            ///< Maximum size is 1 MB (w/o VM)
+#endif
+
+#elif   INT_T == 32
+
+#if     defined(PAGE_VM)
+#define EDIT_MAX    (GB)            ///< Maximum size is 1 GB (w/ VM)
+#else
+#define EDIT_MAX    (MB)            ///< Maximum size is 1 MB (w/o VM)
+#endif
+
+#else
+
+#error  Invalid integer size: expected 32, or 64
+
+#endif
+
+#endif
+
+#if     !defined(EDIT_INIT)
+#if     defined(PAGE_VM)
+
+#define EDIT_INIT   (KB * 64)       ///< Initial size is 64 KB
+
+#else
+
+#define EDIT_INIT   (KB * 8)        ///< Initial size is 8 KB (w/o VM)
+
+#endif
+#endif
+
+#define EDIT_MIN    (KB)            ///< Minimum size is 1 KB
+
+#define APPEND_LINE (256)           ///< Initial read size for single line
+
+#define APPEND_MIN  (KB * 4)        ///< Initial read size for page
+
+#define APPEND_MAX  (KB * 256)      ///< Maximum read size
+
+#define CHUNK_SIZE  (KB * 4)        ///< Maximum no. of bytes in each node
+
+#define LINE_BLOCK  (KB * 4)        ///< Max. bytes to scan before using index
+
+///  @struct  node
+///
+///  @brief   Chunk of text in rope.
+
+struct node
+{
+    struct node *left;          ///< Text preceding this chunk
+    struct node *right;         ///< Text following this chunk
+    uint prio;                  ///< Random priority (for balancing tree)
+    uint len;                   ///< No. of bytes in this chunk
+    uint delims;                ///< No. of delimiters in this chunk
+    uint_t nbytes;              ///< No. of bytes in subtree
+    uint_t ndelims;             ///< No. of delimiters in subtree
+    uchar text[CHUNK_SIZE];     ///< Text for this chunk
+};
+
+///  @struct  scan
+///
+///  @brief   Characters that need special handling when appending a file,
+///           along with the position of the next occurrence of each one.
+
+struct scan
+{
+    bool single;                ///< true if reading a single line
+    bool valid;                 ///< true if positions below are valid
+    uint count;                 ///< No. of special characters
+    uchar chr[5];               ///< Special characters
+    uint_t next[5];             ///< Position of next occurrence
+};
+
+
+///  @var     eb
+///
+///  @brief   Edit buffer data (internal)
+
+static struct
+{
+    struct node *root;          ///< Root of tree
+    struct node *node;          ///< Node found by last lookup (or NULL)
+    uint_t start;               ///< Position of first byte in that node
+    uchar *stage;               ///< Staging area for reading files
+    uint seed;                  ///< Seed for node priorities
+    const uint_t min;           ///< Minimum buffer size (fixed)
+    const uint_t max;           ///< Maximum buffer size (fixed)
+    struct edit t;              ///< Read/write copies of public variables
+} eb =
+{
+    .root   = NULL,
+    .node   = NULL,
+    .start  = 0,
+    .stage  = NULL,
+    .seed   = 2463534242u,
+    .min    = EDIT_MIN,
+    .max    = EDIT_MAX,
+    .t =
+    {
+        .size   = EDIT_INIT,
+        .B      = 0,
+        .Z      = 0,
+        .dot    = 0,
+        .nextc  = EOF,
+        .c      = EOF,
+        .lastc  = EOF,
+        .len    = 0,
+        .pos    = 0,
+        .line   = 0,
+        .nlines = 0,
+    },
+};
+
+const struct edit *t = &eb.t;       ///< Read-only pointers to public variables
+
+
+// Local functions
+
+static void adjust_path(uint_t pos, uint_t nbytes, uint_t ndelims);
+
+static uint_t count_delims(const uchar *p, uint_t nbytes);
+
+static uint_t count_lines(int_t pos);
+
+static uint_t count_text(int_t start, int_t end);
+
+static uint_t delete_text(uint_t pos, uint_t nbytes);
+
+static void end_insert(uint_t nbytes, uint_t ndelims);
+
+static int_t find_line(uint_t n);
+
+static struct node *find_node(uint_t pos, uint_t *start);
+
+static void first_LF(struct scan *scan, struct ifile *ifile, bool crlf);
+
+static void free_tree(struct node *node);
+
+static bool grow_size(void);
+
+static void init_scan(struct scan *scan, const struct ifile *ifile, bool single);
+
+static uint_t insert_text(uint_t pos, const uchar *p, uint_t nbytes);
+
+static struct node *merge_tree(struct node *left, struct node *right);
+
+static struct node *new_node(const uchar *p, uint_t nbytes);
+
+static int_t next_line(uint_t nlines);
+
+static uint_t next_special(struct scan *scan, const uchar *buf, uint_t pos,
+                           uint_t end);
+
+static int_t prev_line(uint_t nlines);
+
+static void reset_edit(void);
+
+static void split_tree(struct node *node, uint_t pos, struct node **left,
+                       struct node **right);
+
+static void update_node(struct node *node);
+
+
+///
+///  @brief    Update the byte and delimiter counts for every node on the path
+///            from the root to the node containing a position, before text is
+///            inserted into or deleted from that node. The counts are unsigned,
+///            so a decrease is passed as the two's complement of its size.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void adjust_path(uint_t pos, uint_t nbytes, uint_t ndelims)
+{
+    struct node *node = eb.root;
+
+    while (node != NULL)
+    {
+        node->nbytes  += nbytes;
+        node->ndelims += ndelims;
+
+        uint_t left = node->left == NULL ? 0 : node->left->nbytes;
+
+        if (pos < left)
+        {
+            node = node->left;
+        }
+        else if (pos < left + node->len)
+        {
+            return;
+        }
+        else
+        {
+            pos -= left + node->len;
+            node = node->right;
+        }
+    }
+
+    assert(false);                      // Position wasn't in tree
+}
+
+
+///
+///  @brief    Append to edit buffer. Similar to insert_edit(), but adds an
+///            entire file to the buffer. We read blocks into a staging area,
+///            compact them in place (using memchr() to locate the few
+///            characters that need any special handling), and then add the
+///            result to the end of the rope. Any data we read past the end of
+///            the page or line is returned to the input stream before we return.
+///
+///  @returns  true if we can continue reading lines, else false (because we
+///            encountered either an EOF or a FF).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool append_edit(struct ifile *ifile, bool single)
+{
+    assert(ifile != NULL);
+    assert(eb.t.dot == eb.t.Z);         // We only ever append at end of buffer
+
+    struct scan scan;
+    uchar *buf      = eb.stage;
+    uint_t block    = single ? APPEND_LINE : APPEND_MIN;
+    uint_t out      = 0;                // No. of bytes stored in stage
+    uint_t in       = 0;                // Offset of next input byte in stage
+    uint_t end      = 0;                // Offset after last input byte in stage
+    uint_t nbytes   = 0;                // No. of bytes added to rope
+    uint_t ndelims  = 0;                // No. of delimiters added to rope
+    bool eof        = false;            // true if we've seen end of file
+    bool more       = false;            // true if we stopped before EOF
+
+    init_scan(&scan, ifile, single);
+
+    for (;;)
+    {
+        // Read the next block of data, after first moving any unprocessed
+        // input (which can only be a CR waiting for the following character)
+        // down to the end of the data we've already stored.
+
+        if (in == end || (in == end - 1 && buf[in] == CR && !eof))
+        {
+            if (in != out)
+            {
+                memmove(buf + out, buf + in, (size_t)(end - in));
+
+                end -= in - out;
+                in   = out;
+            }
+
+            scan.valid = false;         // Discard previous memchr() results
+
+            if (out >= APPEND_MAX / 2)  // Flush stage if it's half full
+            {
+                ndelims += insert_text((uint_t)eb.t.Z + nbytes, buf, out);
+                nbytes  += out;
+
+                memmove(buf, buf + out, (size_t)(end - out));
+
+                end -= out;
+                in = out = 0;
+            }
+
+            uint_t used = (uint_t)eb.t.Z + nbytes + end;
+
+            if (!eof && used >= eb.t.size) // Any room left in buffer?
+            {
+                int c = fgetc(ifile->fp);
+
+                if (c == EOF)
+                {
+                    eof = true;
+                }
+                else
+                {
+                    ungetc(c, ifile->fp);
+
+                    if (!grow_size())
+                    {
+                        more = true;    // Can't expand, so leave data unread
+
+                        break;
+                    }
+                }
+            }
+
+            if (!eof)
+            {
+                uint_t room = APPEND_MAX - end;
+
+                if (room > eb.t.size - used)
+                {
+                    room = eb.t.size - used;
+                }
+
+                if (room > block)
+                {
+                    room = block;
+                }
+
+                size_t n = fread(buf + end, 1uL, (size_t)room, ifile->fp);
+
+                if (n == 0)
+                {
+                    eof = true;
+                }
+
+                end += (uint_t)n;
+
+                // Start with small reads, so that we don't read too much past
+                // a short line or page, but increase the read size for large
+                // pages so that we make as few calls as possible.
+
+                if (block < APPEND_MAX)
+                {
+                    block *= 2;
+                }
+            }
+
+            if (in == end)              // No data left?
+            {
+                break;
+            }
+        }
+
+        uint_t pos = next_special(&scan, buf, in, end);
+
+        // Store ordinary characters up to the next special character.
+
+        if (pos != in)
+        {
+            if (out != in)
+            {
+                memmove(buf + out, buf + in, (size_t)(pos - in));
+            }
+
+            out += pos - in;
+            in   = pos;
+        }
+
+        if (in == end)                  // Need more data?
+        {
+            continue;
+        }
+
+        int c = buf[in];
+
+        if (c == CR)                    // Check for CR followed by LF
+        {
+            if (in == end - 1 && !eof)  // Wait until we have next character
+            {
+                continue;
+            }
+
+            if (in + 1 < end && buf[in + 1] == LF)
+            {
+                ++in;                   // Skip over the CR
+
+                if (!ifile->LF)         // First LF?
+                {
+                    first_LF(&scan, ifile, (bool)true);
+                }
+            }
+
+            ++in;                       // Skip over the LF (or lone CR)
+
+            // If input lines can be terminated with CR/LF, then we save
+            // both characters; if they can only be terminated with LF,
+            // then we ignore the CR.
+
+            if (f.e3.CR_in)             // If CR/LF is okay, save CR here
+            {
+                if (out + 1 == in)      // No room to store extra byte?
+                {
+                    // Flush what we have, and add the CR directly.
+
+                    ndelims += insert_text((uint_t)eb.t.Z + nbytes, buf, out);
+                    nbytes  += out;
+                    out      = 0;
+
+                    (void)insert_text((uint_t)eb.t.Z + nbytes,
+                                      (const uchar *)"\r", 1);
+
+                    ++nbytes;
+                }
+                else
+                {
+                    buf[out++] = CR;
+                }
+            }
+
+            buf[out++] = LF;            // Now save the LF
+
+            if (single)                 // If just appending single line,
+            {
+                more = true;            //  then we're done
+
+                break;
+            }
+        }
+        else if (c == FF && !f.e3.nopage)
+        {
+            ++in;
+
+            more = true;
+            f.ctrl_e = true;            // Flag FF, but don't store it
+
+            break;
+        }
+        else if (c == NUL && !f.e3.keepNUL)
+        {
+            ++in;                       // Discard NUL
+        }
+        else                            // Must be LF, VT, or FF
+        {
+            if (c == LF && !ifile->LF)  // First LF?
+            {
+                first_LF(&scan, ifile, (bool)false);
+            }
+
+            buf[out++] = (uchar)c;
+
+            ++in;
+
+            if (single && isdelim(c))   // If just appending single line,
+            {
+                more = true;            //  then we're done
+
+                break;
+            }
+        }
+    }
+
+    // If we stopped before reaching the end of the file, then return any
+    // data we read but didn't use to the input stream.
+
+    if (more && fseeko(ifile->fp, -(off_t)(end - in), SEEK_CUR) != 0)
+    {
+        throw(E_ERR, ifile->name);      // General error
+    }
+
+    if (out != 0)
+    {
+        ndelims += insert_text((uint_t)eb.t.Z + nbytes, buf, out);
+        nbytes  += out;
+    }
+
+    if (nbytes != 0)
+    {
+        end_insert(nbytes, ndelims);
+    }
+
+    return more;
+}
+
+
+///
+///  @brief    Change case of character at current position of dot. Since this
+///            will never add or delete any delimiters, it won't affect our
+///            line number, or the total number of lines in the buffer.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void change_dot(int c)
+{
+    assert(isalpha(c));
+
+    uint_t start;
+    struct node *node = find_node((uint_t)eb.t.dot, &start);
+
+    node->text[(uint_t)eb.t.dot - start] = eb.t.c = (uchar)c;
+
+    mark_dpy(eb.t.dot, eb.t.dot + 1, (int_t)0, 0);
+}
+
+
+///
+///  @brief    Change text between two absolute positions in place, by calling
+///            a function for each chunk of text. The function may not add or
+///            remove any line delimiters, so that the counts stored in the
+///            tree are not affected.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void change_edit(int_t start, int_t end, void (*change)(uchar *text,
+                                                          uint_t nbytes))
+{
+    assert(change != NULL);
+    assert(start >= eb.t.B && end <= eb.t.Z);
+
+    for (uint_t pos = (uint_t)start; pos < (uint_t)end; )
+    {
+        uint_t first;
+        struct node *node = find_node(pos, &first);
+        uint_t offset = pos - first;
+        uint_t nbytes = node->len - offset;
+
+        if (nbytes > (uint_t)end - pos)
+        {
+            nbytes = (uint_t)end - pos;
+        }
+
+        (*change)(node->text + offset, nbytes);
+
+        pos += nbytes;
+    }
+
+    eb.t.lastc = read_edit(-1);
+    eb.t.c     = read_edit(0);
+    eb.t.nextc = read_edit(1);
+
+    mark_dpy(start, end, (int_t)0, 0);
+}
+
+
+///
+///  @brief    Check that the edit buffer hasn't been changed by another process.
+///            Since we never map files into a rope, there's nothing to check.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void check_edit(void)
+{
+}
+
+
+///
+///  @brief    Count line delimiters in a block of text. This is written so
+///            that the compiler can vectorize it.
+///
+///  @returns  No. of delimiters found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t count_delims(const uchar *p, uint_t nbytes)
+{
+    uint_t ndelims = 0;
+
+    for (uint_t i = 0; i < nbytes; ++i)
+    {
+        ndelims += (p[i] == LF) | (p[i] == VT) | (p[i] == FF);
+    }
+
+    return ndelims;
+}
+
+
+///
+///  @brief    Count line delimiters preceding a position in the buffer, using
+///            the counts stored in the tree.
+///
+///  @returns  No. of delimiters found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t count_lines(int_t pos)
+{
+    assert(pos >= 0 && pos <= eb.t.Z);
+
+    uint_t end = (uint_t)pos;
+    uint_t n = 0;
+
+    for (struct node *node = eb.root; node != NULL; )
+    {
+        uint_t left = node->left == NULL ? 0 : node->left->nbytes;
+
+        if (end < left)
+        {
+            node = node->left;
+
+            continue;
+        }
+
+        if (node->left != NULL)
+        {
+            n += node->left->ndelims;
+        }
+
+        end -= left;
+
+        if (end < node->len)
+        {
+            return n + count_delims(node->text, end);
+        }
+
+        n   += node->delims;
+        end -= node->len;
+        node = node->right;
+    }
+
+    return n;
+}
+
+
+///
+///  @brief    Count line delimiters in a range of the buffer.
+///
+///  @returns  No. of delimiters found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t count_text(int_t start, int_t end)
+{
+    uint_t n = 0;
+
+    while (start < end)
+    {
+        int_t nbytes;
+        const uchar *p = span_edit(start, &nbytes);
+
+        if (nbytes > end - start)
+        {
+            nbytes = end - start;
+        }
+
+        n += count_delims(p, (uint_t)nbytes);
+
+        start += nbytes;
+    }
+
+    return n;
+}
+
+
+///
+///  @brief    Delete n chars relative to current position.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void delete_edit(int_t nbytes)
+{
+    if (nbytes == 0)
+    {
+        return;
+    }
+
+    if (eb.t.dot == 0 && nbytes == eb.t.Z)    // Killing entire buffer?
+    {
+        kill_edit();
+
+        return;
+    }
+
+    int ndelims;
+
+    if (nbytes < 0)                     // Deleting backwards
+    {
+        nbytes = -nbytes;
+
+        assert(nbytes <= eb.t.dot);
+
+        ndelims = (int)delete_text((uint_t)(eb.t.dot - nbytes),
+                                   (uint_t)nbytes);
+
+        eb.t.line -= ndelims;
+        eb.t.dot  -= nbytes;            // Backwards delete affects dot
+    }
+    else                                // Deleting forward
+    {
+        assert(nbytes <= eb.t.Z - eb.t.dot);
+
+        ndelims = (int)delete_text((uint_t)eb.t.dot, (uint_t)nbytes);
+    }
+
+    eb.t.nlines -= ndelims;
+    eb.t.Z      -= nbytes;
+
+    eb.t.lastc = read_edit(-1);
+    eb.t.c     = read_edit(0);
+    eb.t.nextc = read_edit(1);
+
+    int_t prev = prev_line(0);          // Position of start of line
+
+    eb.t.pos = eb.t.dot - prev;
+    eb.t.len = next_line(1) - prev;
+
+    mark_dpy(eb.t.dot, eb.t.dot, -nbytes, -ndelims);
+
+    count_prof(deleted, nbytes);
+}
+
+
+///
+///  @brief    Delete text from the rope. Deletions within a single chunk just
+///            move the rest of the chunk down; anything larger removes the
+///            whole range from the tree.
+///
+///  @returns  No. of delimiters deleted.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t delete_text(uint_t pos, uint_t nbytes)
+{
+    uint_t start;
+    struct node *node = find_node(pos, &start);
+    uint_t offset = pos - start;
+    uint_t ndelims;
+
+    // Note that deleting text within a node doesn't change where it starts,
+    // so we only need to forget it if we change the tree.
+
+    if (offset + nbytes <= node->len && nbytes < node->len)
+    {
+        uchar *p = node->text + offset;
+
+        ndelims = count_delims(p, nbytes);
+
+        adjust_path(start, -nbytes, -ndelims);
+
+        memmove(p, p + nbytes, (size_t)(node->len - offset - nbytes));
+
+        node->len    -= (uint)nbytes;
+        node->delims -= (uint)ndelims;
+    }
+    else
+    {
+        struct node *left, *middle, *right;
+
+        eb.node = NULL;
+
+        split_tree(eb.root, pos, &left, &right);
+        split_tree(right, nbytes, &middle, &right);
+
+        assert(middle != NULL && middle->nbytes == nbytes);
+
+        ndelims = middle->ndelims;
+
+        free_tree(middle);
+
+        eb.root = merge_tree(left, right);
+    }
+
+    return ndelims;
+}
+
+
+///
+///  @brief    Finish insertion into buffer.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void end_insert(uint_t nbytes, uint_t ndelims)
+{
+    assert(nbytes != 0);
+
+    eb.t.nlines += (int)ndelims;
+    eb.t.line   += (int)ndelims;
+
+    eb.t.dot += (int_t)nbytes;
+    eb.t.Z   += (int_t)nbytes;
+
+    // Lone CRs in an input file may take us slightly over the size we set.
+
+    if ((uint_t)eb.t.Z > eb.t.size)
+    {
+        eb.t.size = ((uint_t)eb.t.Z + KB - 1) & ~(uint_t)(KB - 1);
+    }
+
+    int_t prev = prev_line(0);          // Position of start of line
+
+    eb.t.pos  = eb.t.dot - prev;
+    eb.t.len  = next_line(1) - prev;
+
+    eb.t.lastc = read_edit(-1);
+    eb.t.c     = read_edit(0);
+
+    //eb.t.nextc = ...                  // Next character doesn't change
+
+    if (eb.t.Z != 0 && page_count() == 0)
+    {
+        set_page(1);
+    }
+
+    mark_dpy(eb.t.dot - (int_t)nbytes, eb.t.dot, (int_t)nbytes, (int)ndelims);
+
+    count_prof(inserted, nbytes);
+}
+
+
+///
+///  @brief    Clean up memory before we exit from TECO.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void exit_edit(void)
+{
+    free_tree(eb.root);
+
+    eb.root = eb.node = NULL;
+
+    free_mem(&eb.stage);
+}
+
+
+///
+///  @brief    Find the nth line delimiter in the buffer, using the delimiter
+///            counts stored in the tree.
+///
+///  @returns  Position following delimiter, or Z if there aren't n delimiters.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int_t find_line(uint_t n)
+{
+    assert(n != 0);
+
+    if (n > (uint_t)eb.t.nlines)
+    {
+        return eb.t.Z;
+    }
+
+    uint_t pos = 0;
+
+    for (struct node *node = eb.root; node != NULL; )
+    {
+        uint_t left = node->left == NULL ? 0 : node->left->ndelims;
+
+        if (n <= left)
+        {
+            node = node->left;
+
+            continue;
+        }
+
+        n   -= left;
+        pos += node->left == NULL ? 0 : node->left->nbytes;
+
+        if (n <= node->delims)
+        {
+            for (uint i = 0; i < node->len; ++i)
+            {
+                if (isdelim(node->text[i]) && --n == 0)
+                {
+                    return (int_t)(pos + i + 1);
+                }
+            }
+
+            break;
+        }
+
+        n   -= node->delims;
+        pos += node->len;
+        node = node->right;
+    }
+
+    assert(false);                      // Counts are inconsistent
+
+    return eb.t.Z;
+}
+
+
+///
+///  @brief    Find the node containing a position. Since most lookups are near
+///            the previous one, we check the last node found before searching
+///            the tree.
+///
+///  @returns  Node found, with the position of its first byte in start.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct node *find_node(uint_t pos, uint_t *start)
+{
+    assert(eb.root != NULL && pos < eb.root->nbytes);
+    assert(start != NULL);
+
+    if (eb.node != NULL && pos >= eb.start && pos - eb.start < eb.node->len)
+    {
+        *start = eb.start;
+
+        return eb.node;
+    }
+
+    struct node *node = eb.root;
+    uint_t base = 0;
+
+    while (node != NULL)
+    {
+        uint_t left = node->left == NULL ? 0 : node->left->nbytes;
+
+        if (pos < left)
+        {
+            node = node->left;
+        }
+        else if (pos < left + node->len)
+        {
+            base += left;
+
+            break;
+        }
+        else
+        {
+            pos  -= left + node->len;
+            base += left + node->len;
+            node  = node->right;
+        }
+    }
+
+    assert(node != NULL);
+
+    eb.node  = node;
+    eb.start = *start = base;
+
+    return node;
+}
+
+
+///
+///  @brief    Handle the first LF read from an input file, which in smart mode
+///            determines how we terminate input and output lines. Since LF
+///            then no longer needs special handling (unless we're reading a
+///            single line), we also update the list of special characters.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void first_LF(struct scan *scan, struct ifile *ifile, bool crlf)
+{
+    assert(scan != NULL);
+    assert(ifile != NULL);
+
+    ifile->LF = true;
+
+    if (f.e3.smart)                     // In smart mode?
+    {
+        f.e3.CR_in  = crlf;             // Terminate input lines w/ CR/LF or LF
+        f.e3.CR_out = crlf;             // Terminate output lines w/ CR/LF or LF
+    }
+
+    init_scan(scan, ifile, scan->single);
+}
+
+
+///
+///  @brief    Free all of the nodes in a subtree.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_tree(struct node *node)
+{
+    while (node != NULL)
+    {
+        struct node *right = node->right;
+
+        free_tree(node->left);
+        free_mem(&node);
+
+        node = right;
+    }
+}
+
+
+///
+///  @brief    Increase size of edit buffer by 50%, as for insertions. Nothing
+///            is allocated here, since nodes are only added when needed, but
+///            this keeps the buffer size consistent with a gap buffer.
+///
+///  @returns  true if buffer was expanded, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool grow_size(void)
+{
+    uint_t size = (eb.t.size * 3) / 2;
+
+    if (size_edit(size) == 0)
+    {
+        return false;
+    }
+
+    print_size(size);
+
+    return true;
+}
+
+
+///
+///  @brief    Initialize edit buffer. All that we need to do here is allocate
+///            the staging area for reading files, since the tree is empty
+///            until text is added, and the rest of the initialization for the
+///            'eb' and 't' structures is done statically, above.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void init_edit(void)
+{
+    assert(eb.stage == NULL);           // Double initialization is an error
+
+    eb.stage = alloc_type(APPEND_MAX, MEM_EDIT);
+
+    reset_edit();
+}
+
+
+///
+///  @brief    Initialize list of characters that need special handling when
+///            appending a file. Other characters are just copied.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void init_scan(struct scan *scan, const struct ifile *ifile, bool single)
+{
+    assert(scan != NULL);
+    assert(ifile != NULL);
+
+    uint n = 0;
+
+    scan->chr[n++] = CR;
+
+    if (!f.e3.nopage || single)         // FF is either end of page or line
+    {
+        scan->chr[n++] = FF;
+    }
+
+    if (!f.e3.keepNUL)
+    {
+        scan->chr[n++] = NUL;
+    }
+
+    if (!ifile->LF || single)           // Need to see first LF for smart mode
+    {
+        scan->chr[n++] = LF;
+    }
+
+    if (single)
+    {
+        scan->chr[n++] = VT;
+    }
+
+    scan->single = single;
+    scan->count  = n;
+    scan->valid = false;
+}
+
+
+///
+///  @brief    Insert string in edit buffer.
+///
+///  @returns  true if insert succeeded, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+bool insert_edit(const char *buf, size_t nbytes)
+{
+    assert(buf != NULL);
+    assert(eb.stage != NULL);           // Error if no edit buffer
+
+    if (nbytes == 0)
+    {
+        return true;
+    }
+
+    // Make sure data can fit in the space we have. If not, increase by 50%.
+
+    while (eb.t.size - (uint_t)eb.t.Z < nbytes)
+    {
+        if (!grow_size())
+        {
+            return false;
+        }
+    }
+
+    uint_t ndelims = insert_text((uint_t)eb.t.dot, (const uchar *)buf,
+                                 (uint_t)nbytes);
+
+    end_insert((uint_t)nbytes, ndelims);
+
+    return true;                        // Insertion was successful
+}
+
+
+///
+///  @brief    Insert text in the rope. We use any room left in the chunk that
+///            precedes the insertion point, then add new chunks for whatever
+///            doesn't fit. If that chunk is full, and the insertion point is
+///            in the middle of it, we split it first, so that small inserts
+///            only ever move the text in part of one chunk.
+///
+///  @returns  No. of delimiters inserted.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t insert_text(uint_t pos, const uchar *p, uint_t nbytes)
+{
+    assert(p != NULL);
+
+    uint_t total = 0;                   // Total no. of delimiters added
+
+    while (nbytes != 0)
+    {
+        uint_t size = eb.root == NULL ? 0 : eb.root->nbytes;
+        struct node *node = NULL;
+        uint_t start = 0;
+
+        if (size != 0)
+        {
+            node = find_node(pos == 0 ? 0 : pos - 1, &start);
+        }
+
+        uint_t offset = pos - start;
+
+        if (node != NULL && node->len < CHUNK_SIZE)
+        {
+            uint_t n = CHUNK_SIZE - node->len;
+
+            if (n > nbytes)
+            {
+                n = nbytes;
+            }
+
+            uint_t ndelims = count_delims(p, n);
+            uchar *text = node->text + offset;
+
+            adjust_path(start, n, ndelims);
+
+            memmove(text + n, text, (size_t)(node->len - offset));
+            memcpy(text, p, (size_t)n);
+
+            node->len    += (uint)n;
+            node->delims += (uint)ndelims;
+
+            pos    += n;
+            p      += n;
+            nbytes -= n;
+            total  += ndelims;
+        }
+        else
+        {
+            struct node *left, *right;
+
+            eb.node = NULL;             // Positions are about to change
+
+            split_tree(eb.root, pos, &left, &right);
+
+            if (node != NULL && offset != 0 && offset != node->len)
+            {
+                eb.root = merge_tree(left, right);  // Just split the chunk
+            }
+            else
+            {
+                uint_t n = nbytes < CHUNK_SIZE ? nbytes : CHUNK_SIZE;
+                struct node *new = new_node(p, n);
+
+                eb.root = merge_tree(merge_tree(left, new), right);
+
+                pos    += n;
+                p      += n;
+                nbytes -= n;
+                total  += new->delims;
+            }
+        }
+    }
+
+    return total;
+}
+
+
+///
+///  @brief    Kill the entire edit buffer.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void kill_edit(void)
+{
+    if (eb.t.Z != 0)                    // Anything in buffer?
+    {
+        count_prof(deleted, eb.t.Z);
+
+        reset_edit();
+
+        f.e0.window = true;             // Window refresh needed
+    }
+}
+
+
+///
+///  @brief    Return number of bytes between dot and nth line terminator.
+///
+///  @returns  Number of characters relative to dot (can be plus or minus).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+int_t len_edit(int_t n)
+{
+    if (n > 0)
+    {
+        return next_line((uint_t)n) - eb.t.dot;
+    }
+    else
+    {
+        return prev_line((uint_t)-n) - eb.t.dot;
+    }
+}
+
+
+///
+///  @brief    Merge two subtrees, all of whose text in the first precedes all
+///            of the text in the second.
+///
+///  @returns  Root of merged tree.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct node *merge_tree(struct node *left, struct node *right)
+{
+    if (left == NULL)
+    {
+        return right;
+    }
+    else if (right == NULL)
+    {
+        return left;
+    }
+    else if (left->prio > right->prio)
+    {
+        left->right = merge_tree(left->right, right);
+
+        update_node(left);
+
+        return left;
+    }
+    else
+    {
+        right->left = merge_tree(left, right->left);
+
+        update_node(right);
+
+        return right;
+    }
+}
+
+
+///
+///  @brief    Move dot to a relative position.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void move_dot(int_t delta)
+{
+    set_dot(eb.t.dot + delta);
+}
+
+
+///
+///  @brief    Create new node containing text.
+///
+///  @returns  New node.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct node *new_node(const uchar *p, uint_t nbytes)
+{
+    assert(nbytes <= CHUNK_SIZE);
+
+    struct node *node = alloc_type((uint_t)sizeof(*node), MEM_EDIT);
+
+    // Use a xorshift generator for the priorities, which only need to be
+    // random enough to keep the tree balanced.
+
+    eb.seed ^= eb.seed << 13;
+    eb.seed ^= eb.seed >> 17;
+    eb.seed ^= eb.seed << 5;
+
+    node->prio   = eb.seed;
+    node->len    = (uint)nbytes;
+    node->delims = (uint)count_delims(p, nbytes);
+
+    memcpy(node->text, p, (size_t)nbytes);
+
+    update_node(node);
+
+    return node;
+}
+
+
+///
+///  @brief    Scan forward nlines in edit buffer. Since lines are usually
+///            short, we start by scanning the buffer directly, and only use
+///            the delimiter counts if we don't find what we want nearby.
+///
+///  @returns  Position following line terminator (relative to dot).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int_t next_line(uint_t nlines)
+{
+    int_t end = eb.t.Z;
+
+    if ((uint_t)(end - eb.t.dot) > LINE_BLOCK)
+    {
+        end = eb.t.dot + (int_t)LINE_BLOCK;
+    }
+
+    for (int_t pos = eb.t.dot; pos < end; )
+    {
+        int_t nbytes;
+        const uchar *p = span_edit(pos, &nbytes);
+
+        if (nbytes > end - pos)
+        {
+            nbytes = end - pos;
+        }
+
+        for (int_t i = 0; i < nbytes; ++i)
+        {
+            if (isdelim(p[i]) && --nlines == 0)
+            {
+                return pos + i + 1;
+            }
+        }
+
+        pos += nbytes;
+    }
+
+    if (end == eb.t.Z)
+    {
+        return eb.t.Z;                  // Not enough lines, so return Z
+    }
+
+    return find_line(count_lines(end) + nlines);
+}
+
+
+///
+///  @brief    Find next character that needs special handling when appending
+///            a file. We remember where we found each character, so that we
+///            only need to search for it again once we've passed it.
+///
+///  @returns  Position of next special character, or end if none found.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static uint_t next_special(struct scan *scan, const uchar *buf, uint_t pos,
+                           uint_t end)
+{
+    assert(scan != NULL);
+    assert(buf != NULL);
+
+    uint_t next = end;
+
+    for (uint i = 0; i < scan->count; ++i)
+    {
+        if (!scan->valid || scan->next[i] < pos)
+        {
+            const uchar *p = memchr(buf + pos, scan->chr[i], (size_t)(end - pos));
+
+            scan->next[i] = (p == NULL) ? end : (uint_t)(p - buf);
+        }
+
+        if (next > scan->next[i])
+        {
+            next = scan->next[i];
+        }
+    }
+
+    scan->valid = true;
+
+    return next;
+}
+
+
+///
+///  @brief    Scan backward n lines in edit buffer. As for next_line(), we
+///            only use the delimiter counts if we don't find what we want
+///            nearby.
+///
+///  @returns  Position following line terminator (relative to dot).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int_t prev_line(uint_t nlines)
+{
+    int_t start = 0;
+
+    if ((uint_t)eb.t.dot > LINE_BLOCK)
+    {
+        start = eb.t.dot - (int_t)LINE_BLOCK;
+    }
+
+    for (int_t pos = eb.t.dot; pos > start; )
+    {
+        uint_t base;
+        const struct node *node = find_node((uint_t)pos - 1, &base);
+        int_t low = (int_t)base;
+
+        if (low < start)
+        {
+            low = start;
+        }
+
+        while (pos > low)
+        {
+            --pos;
+
+            if (isdelim(node->text[(uint_t)pos - base]) && nlines-- == 0)
+            {
+                return pos + 1;
+            }
+        }
+    }
+
+    if (start == 0)
+    {
+        return 0;                       // Not enough lines, so return B
+    }
+
+    uint_t ndelims = count_lines(start);
+
+    if (ndelims <= nlines)
+    {
+        return 0;                       // Not enough lines, so return B
+    }
+
+    return find_line(ndelims - nlines);
+}
+
+
+///
+///  @brief    Get ASCII value of nth character before or after dot.
+///
+///  @returns  ASCII value, or EOF if character outside of edit buffer.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+int read_edit(int_t pos)
+{
+    uint_t i = (uint_t)(eb.t.dot + pos); // Make relative position absolute
+
+    if (i < (uint_t)eb.t.Z)
+    {
+        uint_t start;
+        const struct node *node = find_node(i, &start);
+
+        return node->text[i - start];
+    }
+
+    return EOF;
+}
+
+
+///
+///  @brief    Reset buffer variables to initial conditions.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void reset_edit(void)
+{
+    free_tree(eb.root);
+
+    eb.root     = NULL;
+    eb.node     = NULL;
+
+    eb.t.Z      = 0;
+    eb.t.dot    = 0;
+    eb.t.nextc  = EOF;
+    eb.t.c      = EOF;
+    eb.t.lastc  = EOF;
+    eb.t.len    = 0;
+    eb.t.pos    = 0;
+    eb.t.line   = 0;
+    eb.t.nlines = 0;
+}
+
+
+///
+///  @brief    Move dot to an absolute position.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void set_dot(int_t dot)
+{
+    if (dot < eb.t.B)
+    {
+        dot = eb.t.B;                   // Can't move before start of buffer
+    }
+    else if (dot > eb.t.Z)
+    {
+        dot = eb.t.Z;                   // Can't move after end of buffer
+    }
+
+    if (eb.t.dot == dot)
+    {
+        return;                         // Nothing to do if no change
+    }
+
+    // Here if position within edit buffer has changed.
+
+    f.e0.cursor = true;                 // Tell display to update cursor
+
+    if (dot == eb.t.B)                  // Moving to start of buffer
+    {
+        eb.t.dot   = dot;
+        eb.t.lastc = EOF;
+        eb.t.c     = read_edit(0);
+        eb.t.nextc = read_edit(1);
+        eb.t.pos   = 0;
+        eb.t.len   = next_line(1);
+        eb.t.line  = 0;
+    }
+    else if (dot == eb.t.Z)             // Moving to end of buffer
+    {
+        eb.t.dot   = dot;
+        eb.t.lastc = read_edit(-1);
+        eb.t.c     = EOF;
+        eb.t.nextc = EOF;
+        eb.t.pos   = eb.t.dot - prev_line(0);
+        eb.t.len   = eb.t.pos;
+        eb.t.line  = eb.t.nlines;
+    }
+    else
+    {
+        int delta = dot - eb.t.dot;     // How much are we moving?
+
+        if (delta == 1)                 // Moving one character forward?
+        {
+            ++eb.t.dot;
+
+            eb.t.lastc = eb.t.c;
+            eb.t.c     = eb.t.nextc;
+            eb.t.nextc = read_edit(1);
+
+            if (isdelim(eb.t.lastc))    // Moving to next line?
+            {
+                eb.t.pos = 0;
+                eb.t.len = next_line(1) - prev_line(0);
+
+                ++eb.t.line;
+            }
+            else
+            {
+                ++eb.t.pos;
+            }
+        }
+        else if (delta == -1)           // Moving one character backward?
+        {
+            --eb.t.dot;
+
+            eb.t.nextc = eb.t.c;
+            eb.t.c     = eb.t.lastc;
+            eb.t.lastc = read_edit(-1);
+
+            if (isdelim(eb.t.c))        // Moving to previous line?
+            {
+                eb.t.pos = eb.t.dot - prev_line(0);
+                eb.t.len = eb.t.pos + 1;
+
+                --eb.t.line;
+            }
+            else
+            {
+                --eb.t.pos;
+            }
+        }
+        else                            // Moving more than one character
+        {
+            eb.t.dot   = dot;
+            eb.t.lastc = read_edit(-1);
+            eb.t.c     = read_edit(0);
+            eb.t.nextc = read_edit(1);
+            eb.t.pos   += delta;
+
+            //  If we moved to a new line, recalculate line position and length.
+
+            if (eb.t.pos < 0 || eb.t.pos >= eb.t.len)
+            {
+                int_t prev = prev_line(0);
+
+                eb.t.pos = eb.t.dot - prev;
+                eb.t.len = next_line(1) - prev;
+
+                // Count the delimiters we moved past, unless we moved far
+                // enough that the tree will be faster.
+
+                if ((uint_t)abs(delta) > LINE_BLOCK)
+                {
+                    eb.t.line = (int)count_lines(eb.t.dot);
+                }
+                else if (delta < 0)
+                {
+                    eb.t.line -= (int)count_text(dot, dot - delta);
+                }
+                else
+                {
+                    eb.t.line += (int)count_text(dot - delta, dot);
+                }
+            }
+        }
+    }
+}
+
+
+///
+///  @brief    Set memory size for edit buffer. Since memory for the rope is
+///            only allocated as text is added, this just sets the limit on how
+///            much text the buffer can hold.
+///
+///  @returns  New size, or 0 if size didn't change.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+uint_t size_edit(uint_t size)
+{
+    if (size > eb.max)
+    {
+        size = eb.max;
+    }
+    else if (size < eb.min)
+    {
+        size = eb.min;
+    }
+
+    uint_t runt = size & (KB - 1);
+
+    if (runt != 0)                      // Partial kilobyte?
+    {
+        size += KB - runt;              // Yes, round up to next kilobyte
+    }
+
+    // Return if size is the same as, or is smaller than, the edit buffer.
+
+    if (size == eb.t.size || size <= (uint_t)eb.t.Z)
+    {
+        return 0;
+    }
+
+    eb.t.size = size;
+
+    return size;
+}
+
+
+///
+///  @brief    Get contiguous text starting at an absolute position, which is
+///            the text from that position to the end of its chunk.
+///
+///  @returns  Pointer to text, with the no. of contiguous bytes stored in
+///            nbytes (0 if the position is outside the buffer).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+const uchar *span_edit(int_t pos, int_t *nbytes)
+{
+    assert(nbytes != NULL);
+
+    if (pos < eb.t.B || pos >= eb.t.Z)
+    {
+        *nbytes = 0;
+
+        return NULL;
+    }
+
+    uint_t start;
+    const struct node *node = find_node((uint_t)pos, &start);
+    uint_t offset = (uint_t)pos - start;
+
+    *nbytes = (int_t)(node->len - offset);
+
+    return node->text + offset;
+}
+
+
+///
+///  @brief    Split a subtree at a position, so that the first pos bytes are
+///            in the left subtree, and the rest are in the right subtree. If
+///            the position is within a chunk, then that chunk is split in two.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void split_tree(struct node *node, uint_t pos, struct node **left,
+                       struct node **right)
+{
+    assert(left != NULL);
+    assert(right != NULL);
+
+    if (node == NULL)
+    {
+        *left = *right = NULL;
+
+        return;
+    }
+
+    uint_t size = node->left == NULL ? 0 : node->left->nbytes;
+
+    if (pos <= size)
+    {
+        split_tree(node->left, pos, left, &node->left);
+        update_node(node);
+
+        *right = node;
+    }
+    else if (pos >= size + node->len)
+    {
+        split_tree(node->right, pos - size - node->len, &node->right, right);
+        update_node(node);
+
+        *left = node;
+    }
+    else
+    {
+        uint_t offset = pos - size;
+        struct node *tail = new_node(node->text + offset, node->len - offset);
+
+        node->len    = (uint)offset;
+        node->delims -= tail->delims;
+
+        *right = merge_tree(tail, node->right);
+
+        node->right = NULL;
+
+        update_node(node);
+
+        *left = node;
+    }
+}
+
+
+///
+///  @brief    Update the byte and delimiter counts for a node's subtree.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void update_node(struct node *node)
+{
+    assert(node != NULL);
+
+    node->nbytes  = node->len;
+    node->ndelims = node->delims;
+
+    if (node->left != NULL)
+    {
+        node->nbytes  += node->left->nbytes;
+        node->ndelims += node->left->ndelims;
+    }
+
+    if (node->right != NULL)
+    {
+        node->nbytes  += node->right->nbytes;
+        node->ndelims += node->right->ndelims;
+    }
+}
@@ -29,6 +29,15 @@
 #include <stdio.h>
 #include <string.h>
 
+#if     !defined(NTHREADS)
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#endif
+
 #include "teco.h"
 #include "ascii.h"
 #include "editbuf.h"
@@ -41,25 +50,230 @@
 #include "qreg.h"
 #include "search.h"
 
-
 ///   @var    last_search
 ///   @brief  Last string searched for
 
 tstring last_search = { .len = 0 };
 
+///   @def    SET_SIZE
+///   @brief  No. of bytes needed for a set of characters.
+
+#define SET_SIZE        ((UCHAR_MAX + 1) / CHAR_BIT)
+
+///   @def    PATTERN_MAX
+///   @brief  No. of compiled search strings to keep.
+
+#define PATTERN_MAX     8
+
+///   @def    BACKWARD_BLOCK
+///   @brief  No. of positions to check at a time when searching backward.
+
+#define BACKWARD_BLOCK  (KB * 4)
+
+///   @def    BACKWARD_MAX
+///   @brief  Max. no. of positions to check at a time when searching backward.
+///           The block size is doubled each time no match is found, so that
+///           far matches can be searched for in parallel.
+
+#define BACKWARD_MAX    ((int_t)(KB * KB * 16))
+
+///   @def    PARALLEL_MIN
+///   @brief  Min. no. of bytes of contiguous text to search in parallel.
+
+#define PARALLEL_MIN    ((int_t)(KB * KB))
+
+///   @def    PARALLEL_CHUNK
+///   @brief  No. of positions checked by a search thread at a time.
+
+#define PARALLEL_CHUNK  ((int_t)(KB * 64))
+
+///   @def    THREADS_MAX
+///   @brief  Max. no. of search threads.
+
+#define THREADS_MAX     64
+
+///   @enum   elem_type
+///   @brief  Types of compiled search string elements.
+
+enum elem_type
+{
+    ELEM_SET,                       ///< Match any character in set
+    ELEM_BLANKS,                    ///< Match one or more blanks (^ES)
+    ELEM_ERROR                      ///< Invalid match construct
+};
+
+///   @struct element
+///   @brief  Compiled search string element, which matches one character in
+///           the edit buffer (or more, for a run of blanks).
+
+struct element
+{
+    enum elem_type type;            ///< Element type
+    int error;                      ///< Error code (for ELEM_ERROR)
+    int qname;                      ///< Q-register name (for E_IQN error)
+    uchar set[SET_SIZE];            ///< Set of characters matched
+};
+
+///   @struct pattern
+///   @brief  Compiled search string. Each match control construct is only
+///           parsed once, rather than once for every buffer position tried.
+///           Errors in a search string are only issued if a search gets as
+///           far as the invalid construct.
+
+struct pattern
+{
+    char *string;                   ///< Search string
+    uint_t len;                     ///< Length of search string
+    bool valid;                     ///< true if string has been compiled
+    bool negate;                    ///< true if string starts with ^N
+    bool qreg;                      ///< true if string uses ^EGq
+    bool simple;                    ///< true if each element matches 1 chr.
+    bool exact;                     ///< true if each element is 1 chr.
+    int_t ctrl_x;                   ///< CTRL/X flag when compiled
+    uint_t qversion;                ///< Q-register version when compiled
+    uint_t nelems;                  ///< No. of elements
+    struct element *elems;          ///< Compiled elements
+    uchar *literal;                 ///< Characters to match (if exact)
+    uint_t skip[UCHAR_MAX + 1];     ///< Horspool skip distances (if simple)
+};
+
+///   @var    patterns
+///   @brief  Cache of compiled search strings, so that searches repeated in
+///           loops and macros don't have to recompile their strings.
+
+static struct pattern patterns[PATTERN_MAX];
+
+///   @var    pattern
+///   @brief  Compiled version of last search string.
+
+static struct pattern *pattern = NULL;
+
+///   @var    next_pattern
+///   @brief  Next cache entry to replace.
+
+static uint next_pattern = 0;
+
+///   @var    nthreads
+///   @brief  No. of threads to use for searching large buffers (0 if not yet
+///           set, in which case we use one for each processor online).
+
+static uint nthreads = 0;
+
+#if     !defined(NTHREADS)
+
+///   @var    pool
+///   @brief  Worker threads for searching large buffers, and the search they
+///           are currently working on. The text is split into chunks that
+///           overlap by the length of the search string, less one, and each
+///           thread takes the next chunk that could still contain a better
+///           match than any found so far. The calling thread also searches,
+///           so there is one less worker than the no. of search threads.
+
+static struct
+{
+    pthread_mutex_t lock;           ///< Lock for everything below
+    pthread_cond_t start;           ///< Signaled when search started
+    pthread_cond_t done;            ///< Signaled when last worker done
+    pthread_t workers[THREADS_MAX]; ///< Worker threads
+    uint nworkers;                  ///< No. of worker threads
+    uint active;                    ///< No. of workers still searching
+    uint job;                       ///< Current search no.
+    bool quit;                      ///< true if workers should exit
+    bool rightmost;                 ///< true if finding last match
+    const struct pattern *p;        ///< Compiled search string
+    const uchar *text;              ///< Text to search
+    int_t npos;                     ///< No. of positions to check
+    int_t nchunks;                  ///< No. of chunks
+    int_t next;                     ///< No. of chunks already taken
+    int_t best;                     ///< Chunk with best match, or -1
+    const uchar *match;             ///< Best match found so far
+} pool =
+{
+    .lock     = PTHREAD_MUTEX_INITIALIZER,
+    .start    = PTHREAD_COND_INITIALIZER,
+    .done     = PTHREAD_COND_INITIALIZER,
+    .nworkers = 0,
+    .active   = 0,
+    .job      = 0,
+    .quit     = false,
+};
+
+#endif
+
 // Local functions
 
-static int isblankx(int c, struct search *s);
+static void cache_pattern(void);
 
-static int isctrlx(int c, int match);
+static void compile_pattern(struct pattern *p);
+
+static uint_t compile_elem(struct pattern *p, struct element *elem, uint_t pos);
+
+static bool find_simple(const struct pattern *p, int_t start, int_t last,
+                        int_t *found, bool rightmost);
+
+static bool find_simple_backward(const struct pattern *p, int_t start,
+                                 int_t first, int_t *found);
 
-static int isqreg(int c, struct search *s);
+static void free_pattern(struct pattern *p);
+
+static struct pattern *get_pattern(void);
+
+static int isctrlx(int c, int match);
 
 static int issymbol(int c);
 
-static bool match_chr(int c, struct search *s);
+static bool match_elem(int c, const struct element *elem, struct search *s);
+
+static bool match_simple(const struct pattern *p, int_t pos);
+
+static bool match_str(struct search *s, const struct pattern *p);
+
+#if     !defined(NTHREADS)
+
+static void *run_worker(void *arg);
+
+static void scan_chunks(void);
+
+#endif
+
+static const uchar *scan_last(const struct pattern *p, const uchar *text,
+                              int_t nbytes);
+
+#if     !defined(NTHREADS)
+
+static const uchar *scan_parallel(const struct pattern *p, const uchar *text,
+                                  int_t nbytes, bool rightmost);
+
+#endif
+
+static const uchar *scan_simple(const struct pattern *p, const uchar *text,
+                                int_t nbytes);
+
+static const uchar *scan_text(const struct pattern *p, const uchar *text,
+                              int_t nbytes, bool rightmost);
+
+static void set_error(struct element *elem, int error, int qname);
+
+#if     !defined(NTHREADS)
+
+static void start_workers(void);
+
+static void stop_workers(void);
+
+#endif
+
+
+///   @def    add_chr
+///   @brief  Add character to set.
+
+#define add_chr(set, c)  ((set)[(uchar)(c) / CHAR_BIT] |= \
+                          (uchar)(1u << ((uchar)(c) % CHAR_BIT)))
+
+///   @def    has_chr
+///   @brief  Check for character in set.
 
-static bool match_str(struct search *s);
+#define has_chr(set, c)  (((set)[(uchar)(c) / CHAR_BIT] & \
+                           (1u << ((uchar)(c) % CHAR_BIT))) != 0)
 
 
 ///
@@ -77,47 +291,509 @@ void build_search(const char *src, uint_t len)
 
     free_mem(&last_search.data);
 
-    last_search.data = alloc_mem(tmp.len + 1);
+    last_search.data = alloc_type(tmp.len + 1, MEM_SEARCH);
     last_search.len = tmp.len;
 
     strcpy(last_search.data, tmp.data);
+
+    cache_pattern();
 }
 
 
 ///
-///  @brief    Check for multiple blanks (spaces or tabs) at current position.
+///  @brief    Find compiled version of last search string in cache, or add it
+///            to the cache if not found (replacing the oldest entry). Note that
+///            the string is not compiled until it's actually used.
 ///
-///            Note that we return 1/0 instead of true/false for compatibility
-///            with the ANSI isxxx() functions.
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void cache_pattern(void)
+{
+    for (uint i = 0; i < PATTERN_MAX; ++i)
+    {
+        struct pattern *p = &patterns[i];
+
+        if (p->string != NULL && p->len == last_search.len &&
+            memcmp(p->string, last_search.data, (size_t)p->len) == 0)
+        {
+            pattern = p;
+
+            return;
+        }
+    }
+
+    pattern = &patterns[next_pattern++ % PATTERN_MAX];
+
+    free_pattern(pattern);
+
+    pattern->string = alloc_type(last_search.len + 1, MEM_SEARCH);
+    pattern->len    = last_search.len;
+
+    memcpy(pattern->string, last_search.data, (size_t)pattern->len);
+}
+
+
 ///
-///  @returns  1 if one or more blanks found, else 0.
+///  @brief    Compile search string element. This has to follow the same rules
+///            that matching did before search strings were compiled, so that
+///            constructs are parsed the same way.
+///
+///  @returns  Position of next element in search string.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-static int isblankx(int c, struct search *s)
+static uint_t compile_elem(struct pattern *p, struct element *elem, uint_t pos)
 {
-    assert(s != NULL);                  // Error if no search block
+    assert(p != NULL);
+    assert(elem != NULL);
+
+    const uchar *string = (const uchar *)p->string;
+    int match = string[pos++];
+
+    elem->type = ELEM_SET;
 
-    if (!isblank(c))
+    if (match == CTRL_E)
     {
-        return 0;
+        if (pos == p->len)
+        {
+            set_error(elem, E_ISS, 0);  // Invalid search string
+
+            return pos;
+        }
+
+        match = toupper(string[pos++]);
+
+        if (match == 'G')
+        {
+            int qname;
+            bool qlocal = false;
+
+            if (pos == p->len)
+            {
+                set_error(elem, E_MQN, 0); // Missing Q-register name
+
+                return pos;
+            }
+
+            if ((qname = string[pos++]) == '.')
+            {
+                qlocal = true;
+
+                if (pos == p->len)
+                {
+                    set_error(elem, E_MQN, 0); // Missing Q-register name
+
+                    return pos;
+                }
+
+                qname = string[pos++];
+            }
+
+            int qindex = get_qindex(qname, qlocal);
+
+            if (qindex == -1)
+            {
+                set_error(elem, E_IQN, qname); // Invalid Q-register name
+
+                return pos;
+            }
+
+            struct qreg *qreg = get_qreg(qindex);
+
+            for (uint_t i = 0; i < qreg->text.len; ++i)
+            {
+                add_chr(elem->set, qreg->text.data[i]);
+            }
+
+            p->qreg = true;
+        }
+        else if (match == 'S')
+        {
+            elem->type = ELEM_BLANKS;
+        }
+        else if (match >= '0' && match <= '9')
+        {
+            // <CTRL/E>nnn matches character whose decimal value is nnn.
+
+            int n = match - '0';
+
+            while (pos < p->len && isdigit(string[pos]))
+            {
+                if (n <= UCHAR_MAX)     // Ignore values that can't match
+                {
+                    n *= 10;            // Shift digit over
+                    n += string[pos] - '0'; // Add in new digit
+                }
+
+                ++pos;
+            }
+
+            if (n <= UCHAR_MAX)
+            {
+                add_chr(elem->set, n);
+            }
+        }
+        else if (match == NUL || strchr("ABCDLRVWX", match) != NULL)
+        {
+            for (int c = 0; c <= UCHAR_MAX; ++c)
+            {
+                if ((match == 'A' && isalpha(c))  ||
+                    (match == 'B' && !isalnum(c)) ||
+                    (match == 'C' && issymbol(c)) ||
+                    (match == 'D' && isdigit(c))  ||
+                    (match == 'L' && isdelim(c))  ||
+                    (match == 'R' && isalnum(c))  ||
+                    (match == 'V' && islower(c))  ||
+                    (match == 'W' && isupper(c))  ||
+                    (match == 'X'))
+                {
+                    add_chr(elem->set, c);
+                }
+            }
+        }
+        else
+        {
+            set_error(elem, E_ICE, 0);  // Invalid ^E command in search argument
+        }
+    }
+    else if (match == CTRL_N)           // ^N^N doesn't make sense
+    {
+        set_error(elem, E_ISS, 0);      // Invalid search string
     }
+    else
+    {
+        for (int c = 0; c <= UCHAR_MAX; ++c)
+        {
+            if ((match == CTRL_S && !isalnum(c)) ||
+                match == CTRL_X                  ||
+                isctrlx(c, match)                ||
+                c == match)
+            {
+                add_chr(elem->set, c);
+            }
+        }
+    }
+
+    return pos;
+}
+
+
+///
+///  @brief    Compile search string, and set up for fast searching if every
+///            element always matches a single character.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void compile_pattern(struct pattern *p)
+{
+    assert(p != NULL);
+
+    free_mem(&p->elems);
+    free_mem(&p->literal);
+
+    p->valid    = true;
+    p->negate   = false;
+    p->qreg     = false;
+    p->simple   = false;
+    p->exact    = false;
+    p->ctrl_x   = f.ctrl_x;
+    p->qversion = qversion;
+    p->nelems   = 0;
+    p->elems    = alloc_type((uint_t)sizeof(struct element) * (p->len + 1),
+                             MEM_SEARCH);
+
+    uint_t pos = 0;
 
-    while (s->text_pos < s->text_end)
+    if (p->len != 0 && p->string[0] == CTRL_N)
     {
-        if ((c = read_edit(s->text_pos++)) == EOF)
+        p->negate = true;               // Match anything except what follows
+        ++pos;
+    }
+
+    while (pos < p->len)
+    {
+        struct element *elem = &p->elems[p->nelems++];
+
+        pos = compile_elem(p, elem, pos);
+
+        if (elem->type == ELEM_ERROR)
         {
-            break;
+            break;                      // Nothing after this can be matched
         }
-        else if (!isblank(c))
+    }
+
+    if (p->negate || p->nelems == 0)
+    {
+        return;
+    }
+
+    for (uint_t i = 0; i < p->nelems; ++i)
+    {
+        if (p->elems[i].type != ELEM_SET)
         {
-            --s->text_pos;
+            return;
+        }
+    }
 
-            break;
+    // Every element matches exactly one character, so we can use a Horspool
+    // search, and if each set only contains one character, we can just look
+    // for those characters.
+
+    p->simple  = true;
+    p->exact   = true;
+    p->literal = alloc_type(p->nelems, MEM_SEARCH);
+
+    for (uint_t i = 0; i < p->nelems; ++i)
+    {
+        uint count = 0;
+
+        for (int c = 0; c <= UCHAR_MAX; ++c)
+        {
+            if (has_chr(p->elems[i].set, c))
+            {
+                p->literal[i] = (uchar)c;
+                ++count;
+            }
+        }
+
+        if (count != 1)
+        {
+            p->exact = false;
+        }
+    }
+
+    for (int c = 0; c <= UCHAR_MAX; ++c)
+    {
+        p->skip[c] = p->nelems;
+
+        for (uint_t i = 0; i < p->nelems - 1; ++i)
+        {
+            if (has_chr(p->elems[i].set, c))
+            {
+                p->skip[c] = p->nelems - 1 - i;
+            }
+        }
+    }
+}
+
+
+///
+///  @brief    Find first (or last) match for simple search string, scanning
+///            the text in the edit buffer directly. Any match that spans two
+///            pieces of the buffer is checked one position at a time.
+///
+///  @returns  true if found (with absolute position of match), else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool find_simple(const struct pattern *p, int_t start, int_t last,
+                        int_t *found, bool rightmost)
+{
+    assert(p != NULL);
+    assert(found != NULL);
+
+    int_t len = (int_t)p->nelems;
+
+    if (last > t->Z - len)
+    {
+        last = t->Z - len;              // Match can't extend past end
+    }
+
+    if (start < t->B)
+    {
+        start = t->B;
+    }
+
+    int_t pos = start;
+    bool matched = false;
+
+    while (pos <= last)
+    {
+        int_t nbytes;
+        const uchar *text = span_edit(pos, &nbytes);
+        int_t end = pos + nbytes;       // End of this piece of text
+
+        // First check all the positions where a match would fit within
+        // this piece of text.
+
+        if (pos + len <= end)
+        {
+            int_t n = (end - len < last ? end - len : last) - pos + len;
+            const uchar *match = scan_text(p, text, n, rightmost);
+
+            if (match != NULL)
+            {
+                *found  = pos + (int_t)(match - text);
+                matched = true;
+
+                if (!rightmost)
+                {
+                    return true;
+                }
+            }
+
+            pos += n - len + 1;
+        }
+
+        // Then check any positions that would span the end of the text.
+
+        for (; pos <= last && pos + len > end; ++pos)
+        {
+            if (match_simple(p, pos))
+            {
+                *found  = pos;
+                matched = true;
+
+                if (!rightmost)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return matched;
+}
+
+
+///
+///  @brief    Find last match for simple search string, by searching forward
+///            in blocks, starting with the block closest to the start. Each
+///            block is twice the size of the previous one, up to a maximum.
+///
+///  @returns  true if found (with absolute position of match), else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool find_simple_backward(const struct pattern *p, int_t start,
+                                 int_t first, int_t *found)
+{
+    assert(p != NULL);
+    assert(found != NULL);
+
+    if (first < t->B)
+    {
+        first = t->B;
+    }
+
+    int_t block = BACKWARD_BLOCK;
+    int_t last = start;
+
+    while (last >= first)
+    {
+        int_t pos = last - block + 1;
+
+        if (pos < first)
+        {
+            pos = first;
+        }
+
+        if (find_simple(p, pos, last, found, (bool)true))
+        {
+            return true;
+        }
+
+        last = pos - 1;
+
+        if (block < BACKWARD_MAX)
+        {
+            block *= 2;
         }
     }
 
-    return 1;
+    return false;
+}
+
+
+///
+///  @brief    Free compiled search string.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void free_pattern(struct pattern *p)
+{
+    assert(p != NULL);
+
+    free_mem(&p->string);
+    free_mem(&p->elems);
+    free_mem(&p->literal);
+
+    p->len   = 0;
+    p->valid = false;
+}
+
+
+///
+///  @brief    Get compiled version of last search string, recompiling it if
+///            the CTRL/X flag has changed, or if it uses a Q-register whose
+///            text may have changed.
+///
+///  @returns  Compiled search string, or NULL if no previous search.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static struct pattern *get_pattern(void)
+{
+    if (last_search.data == NULL)
+    {
+        return NULL;
+    }
+
+    assert(pattern != NULL);
+
+    if (!pattern->valid || pattern->ctrl_x != f.ctrl_x ||
+        (pattern->qreg && pattern->qversion != qversion))
+    {
+        compile_pattern(pattern);
+    }
+
+    return pattern;
+}
+
+
+///
+///  @brief    Get no. of threads to use for searching large buffers.
+///
+///  @returns  No. of threads (1 if searches are not done in parallel).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+uint get_threads(void)
+{
+
+#if     defined(NTHREADS)
+
+    nthreads = 1;
+
+#else
+
+    if (nthreads == 0)                  // Use one thread per processor
+    {
+        long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (nprocs < 1)
+        {
+            nthreads = 1;
+        }
+        else if (nprocs > THREADS_MAX)
+        {
+            nthreads = THREADS_MAX;
+        }
+        else
+        {
+            nthreads = (uint)nprocs;
+        }
+    }
+
+#endif
+
+    return nthreads;
 }
 
 
@@ -145,260 +821,499 @@ static int isblankx(int c, struct search *s)
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-static int isctrlx(int c, int match)
+static int isctrlx(int c, int match)
+{
+    if (f.ctrl_x != -1)
+    {
+        c     = toupper(c);
+        match = toupper(match);
+
+        if (!isalpha(c) && f.ctrl_x == 0)
+        {
+            if (strchr("`{|}~", c) != NULL)
+            {
+                c -= 'a' - 'A';
+            }
+
+            if (strchr("`{|}~", match) != NULL)
+            {
+                match -= 'a' - 'A';
+            }
+        }
+    }
+
+    return (c == match) ? 1 : 0;
+}
+
+
+///
+///  @brief    Check for a match on a symbol constituent: alphanumeric, period,
+///            dollar sign and underscore.
+///
+///            Note that we return 1/0 instead of true/false for compatibility
+///            with the ANSI isxxx() library functions.
+///
+///  @returns  1 if a match found, else 0.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static int issymbol(int c)
+{
+    if (isalnum(c) || c == '.' || c == '$' || c == '_')
+    {
+        return 1;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+
+///
+///  @brief    Check for a match on the current character in the edit buffer
+///            with one element of the search string.
+///
+///  @returns  true if a match found, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool match_elem(int c, const struct element *elem, struct search *s)
+{
+    assert(elem != NULL);
+    assert(s != NULL);                  // Error if no search block
+
+    if (elem->type == ELEM_SET)
+    {
+        return has_chr(elem->set, c);
+    }
+    else if (elem->type == ELEM_BLANKS)
+    {
+        if (!isblank(c))
+        {
+            return false;
+        }
+
+        // Check for multiple blanks (spaces or tabs) at current position.
+
+        while (s->text_pos < s->text_end)
+        {
+            if ((c = read_edit(s->text_pos++)) == EOF)
+            {
+                break;
+            }
+            else if (!isblank(c))
+            {
+                --s->text_pos;
+
+                break;
+            }
+        }
+
+        return true;
+    }
+    else if (elem->error == E_IQN)
+    {
+        throw(E_IQN, elem->qname);      // Invalid Q-register name
+    }
+    else
+    {
+        throw(elem->error);
+    }
+}
+
+
+///
+///  @brief    Check to see if simple search string matches at position.
+///
+///  @returns  true if match, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool match_simple(const struct pattern *p, int_t pos)
+{
+    assert(p != NULL);
+
+    pos -= t->dot;                      // Make position relative
+
+    for (uint_t i = 0; i < p->nelems; ++i)
+    {
+        int c = read_edit(pos++);
+
+        if (c == EOF || !has_chr(p->elems[i].set, c))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+///
+///  @brief    Check to see if text string matches search string.
+///
+///  @returns  true if match, else false.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static bool match_str(struct search *s, const struct pattern *p)
+{
+    assert(s != NULL);                  // Error if no search block
+    assert(p != NULL);
+
+    // If the search string started with ^N, then we have a match if any of
+    // the characters that follow don't match.
+
+    for (uint_t i = 0; i < p->nelems; ++i)
+    {
+        int c = read_edit(s->text_pos++);
+
+        if (c == EOF)
+        {
+            return false;
+        }
+        else if (!match_elem(c, &p->elems[i], s))
+        {
+            return p->negate;
+        }
+    }
+
+    return !p->negate;
+}
+
+
+///
+///  @brief    Deallocate memory for last search.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void reset_search(void)
 {
-    if (f.ctrl_x != -1)
-    {
-        c     = toupper(c);
-        match = toupper(match);
 
-        if (!isalpha(c) && f.ctrl_x == 0)
-        {
-            if (strchr("`{|}~", c) != NULL)
-            {
-                c -= 'a' - 'A';
-            }
+#if     !defined(NTHREADS)
 
-            if (strchr("`{|}~", match) != NULL)
-            {
-                match -= 'a' - 'A';
-            }
-        }
+    stop_workers();
+
+#endif
+
+    free_mem(&last_search.data);
+
+    for (uint i = 0; i < PATTERN_MAX; ++i)
+    {
+        free_pattern(&patterns[i]);
     }
 
-    return (c == match) ? 1 : 0;
+    pattern = NULL;
 }
 
 
 ///
-///  @brief    Check for a match with one of the characters in a Q-register.
-///
-///            Note that we return 1/0 instead of true/false for compatibility
-///            with the ANSI isxxx() functions.
+///  @brief    Wait for searches to be started, and help with them, until we
+///            are told to exit.
 ///
-///  @returns  1 if a match found, else 0.
+///  @returns  NULL.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-static int isqreg(int c, struct search *s)
-{
-    assert(s != NULL);                  // Error if no search block
+#if     !defined(NTHREADS)
 
-    int qname;
-    bool qlocal = false;
+static void *run_worker(void *arg)
+{
+    uint job = (uint)(uintptr_t)arg;    // Last search we saw
 
-    if (s->match_len-- == 0)
+    for (;;)
     {
-        throw(E_MQN);                   // Missing Q-register name
-    }
+        (void)pthread_mutex_lock(&pool.lock);
 
-    if ((qname = *s->match_buf++) == '.')
-    {
-        qlocal = true;
+        while (!pool.quit && pool.job == job)
+        {
+            (void)pthread_cond_wait(&pool.start, &pool.lock);
+        }
 
-        if (s->match_len-- == 0)
+        if (pool.quit)
         {
-            throw(E_MQN);               // Missing Q-register name
+            (void)pthread_mutex_unlock(&pool.lock);
+
+            return NULL;
         }
 
-        qname = *s->match_buf++;
-    }
+        job = pool.job;
 
-    int qindex = get_qindex(qname, qlocal);
+        (void)pthread_mutex_unlock(&pool.lock);
 
-    if (qindex == -1)
-    {
-        throw(E_IQN, qname);            // Invalid Q-register name
-    }
+        scan_chunks();
 
-    struct qreg *qreg = get_qreg(qindex);
+        (void)pthread_mutex_lock(&pool.lock);
 
-    for (uint_t i = 0; i < qreg->text.len; ++i)
-    {
-        if (c == qreg->text.data[i])
+        if (--pool.active == 0)
         {
-            return 1;
+            (void)pthread_cond_signal(&pool.done);
         }
-    }
 
-    return 0;
+        (void)pthread_mutex_unlock(&pool.lock);
+    }
 }
 
+#endif
+
 
 ///
-///  @brief    Check for a match on a symbol constituent: alphanumeric, period,
-///            dollar sign and underscore.
-///
-///            Note that we return 1/0 instead of true/false for compatibility
-///            with the ANSI isxxx() library functions.
+///  @brief    Scan chunks of text for current parallel search, until there
+///            are no more chunks that could contain a better match than the
+///            best one found so far. Called by all search threads.
 ///
-///  @returns  1 if a match found, else 0.
+///  @returns  Nothing.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-static int issymbol(int c)
+#if     !defined(NTHREADS)
+
+static void scan_chunks(void)
 {
-    if (isalnum(c) || c == '.' || c == '$' || c == '_')
-    {
-        return 1;
-    }
-    else
+    const struct pattern *p = pool.p;
+    int_t len = (int_t)p->nelems;
+
+    for (;;)
     {
-        return 0;
+        (void)pthread_mutex_lock(&pool.lock);
+
+        if (pool.next == pool.nchunks)
+        {
+            (void)pthread_mutex_unlock(&pool.lock);
+
+            return;
+        }
+
+        int_t n = pool.next++;
+        int_t i = pool.rightmost ? pool.nchunks - 1 - n : n;
+
+        // Chunks are taken in order, so if this one can't contain a better
+        // match than the one we have, then neither can any that follow.
+
+        if (pool.best != -1 && (pool.rightmost ? i < pool.best : i > pool.best))
+        {
+            pool.next = pool.nchunks;
+
+            (void)pthread_mutex_unlock(&pool.lock);
+
+            return;
+        }
+
+        (void)pthread_mutex_unlock(&pool.lock);
+
+        int_t pos = i * PARALLEL_CHUNK;
+        int_t npos = pool.npos - pos;
+
+        if (npos > PARALLEL_CHUNK)
+        {
+            npos = PARALLEL_CHUNK;
+        }
+
+        const uchar *text = pool.text + pos;
+        int_t nbytes = npos + len - 1;
+        const uchar *match = pool.rightmost ? scan_last(p, text, nbytes)
+                                            : scan_simple(p, text, nbytes);
+
+        if (match != NULL)
+        {
+            (void)pthread_mutex_lock(&pool.lock);
+
+            if (pool.best == -1
+                || (pool.rightmost ? i > pool.best : i < pool.best))
+            {
+                pool.best  = i;
+                pool.match = match;
+            }
+
+            (void)pthread_mutex_unlock(&pool.lock);
+        }
     }
 }
 
+#endif
+
 
 ///
-///  @brief    Check for a match on the current character in the edit buffer,
-///            allowing for the use of match control constructs in the search
-///            string. Note that we can be called recursively.
+///  @brief    Scan contiguous text for last match of simple search string.
 ///
-///  @returns  true if a match found, else false.
+///  @returns  Pointer to last match, or NULL if not found.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-static bool match_chr(int c, struct search *s)
+static const uchar *scan_last(const struct pattern *p, const uchar *text,
+                              int_t nbytes)
 {
-    assert(s != NULL);                  // Error if no search block
+    assert(p != NULL);
+    assert(text != NULL);
+
+    const uchar *end = text + nbytes;
+    const uchar *last = NULL;
+    const uchar *match;
 
-    if (s->match_len-- == 0)
+    while ((match = scan_simple(p, text, (int_t)(end - text))) != NULL)
     {
-        throw(E_ISS);                   // Invalid search string
+        last = match;
+        text = match + 1;
     }
 
-    int match = *s->match_buf++;
+    return last;
+}
 
-    if (match == CTRL_E)
-    {
-        if (s->match_len-- == 0)
-        {
-            throw(E_ISS);               // Invalid search string
-        }
 
-        match = toupper(*s->match_buf++);
+///
+///  @brief    Scan contiguous text for simple search string, using all of our
+///            search threads.
+///
+///  @returns  Pointer to first (or last) match, or NULL if not found.
+///
+////////////////////////////////////////////////////////////////////////////////
 
-        if ((match == 'A' && isalpha(c))     ||
-            (match == 'B' && !isalnum(c))    ||
-            (match == 'C' && issymbol(c))    ||
-            (match == 'D' && isdigit(c))     ||
-            (match == 'G' && isqreg(c, s))   ||
-            (match == 'L' && isdelim(c))     ||
-            (match == 'R' && isalnum(c))     ||
-            (match == 'S' && isblankx(c, s)) ||
-            (match == 'V' && islower(c))     ||
-            (match == 'W' && isupper(c))     ||
-            (match == 'X'))
-        {
-            return true;
-        }
-        else if (strchr("ABCDGLRSVWX", match) != NULL)
-        {
-            return false;               // Valid match chr., but no match
-        }
+#if     !defined(NTHREADS)
 
-        // <CTRL/E>nnn matches character whose decimal value is nnn.
+static const uchar *scan_parallel(const struct pattern *p, const uchar *text,
+                                  int_t nbytes, bool rightmost)
+{
+    assert(p != NULL);
+    assert(text != NULL);
 
-        if (match >= '0' && match <= '9')
-        {
-            int n = match - '0';
+    start_workers();
 
-            // Loop until we run out of decimal digits
+    (void)pthread_mutex_lock(&pool.lock);
 
-            while (s->match_len > 0)
-            {
-                if (!isdigit(*s->match_buf))
-                {
-                    break;
-                }
+    pool.p         = p;
+    pool.text      = text;
+    pool.rightmost = rightmost;
+    pool.npos      = nbytes - (int_t)p->nelems + 1;
+    pool.nchunks   = (pool.npos + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+    pool.next      = 0;
+    pool.best      = -1;
+    pool.match     = NULL;
+    pool.active    = pool.nworkers;
 
-                --s->match_len;
+    ++pool.job;
 
-                n *= 10;                // Shift digit over
-                n += *s->match_buf++ - '0'; // Add in new digit
-            }
+    (void)pthread_cond_broadcast(&pool.start);
+    (void)pthread_mutex_unlock(&pool.lock);
 
-            return (c == n) ? true : false;
-        }
+    scan_chunks();                      // Do our share of the work
 
-        throw(E_ICE);                   // Invalid ^E command in search argument
-    }
-    else if (match == CTRL_N)           // ^N^N doesn't make sense
-    {
-        throw(E_ISS);                   // Invalid search string
-    }
-    else if ((match == CTRL_S && !isalnum(c)) ||
-             match == CTRL_X                  ||
-             isctrlx(c, match)                ||
-             c == match)
+    // Wait until all workers are done, since the text may change as soon as
+    // we return.
+
+    (void)pthread_mutex_lock(&pool.lock);
+
+    while (pool.active != 0)
     {
-        return true;
+        (void)pthread_cond_wait(&pool.done, &pool.lock);
     }
 
-    return false;
+    const uchar *match = pool.match;
+
+    (void)pthread_mutex_unlock(&pool.lock);
+
+    return match;
 }
 
+#endif
+
 
 ///
-///  @brief    Check to see if text string matches search string.
+///  @brief    Scan contiguous text for simple search string.
 ///
-///  @returns  true if match, else false (unless the first character is CTRL/N,
-///            if which case we return false if it's a match, otherwise true).
+///  @returns  Pointer to first match, or NULL if not found.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-static bool match_str(struct search *s)
+static const uchar *scan_simple(const struct pattern *p, const uchar *text,
+                                int_t nbytes)
 {
-    assert(s != NULL);                  // Error if no search block
+    assert(p != NULL);
+    assert(text != NULL);
 
-    if (*s->match_buf == CTRL_N && s->match_len > 0)
+    size_t len = (size_t)p->nelems;
+    const uchar *last = text + nbytes - len;
+
+    if (p->exact)
     {
-        --s->match_len;
-        ++s->match_buf;
+        const uchar *literal = p->literal;
+
+        // Let memchr() find candidates for first character, since it's
+        // typically much faster than anything we can do byte by byte.
 
-        while (s->match_len > 0)
+        while (text <= last)
         {
-            int c = read_edit(s->text_pos++);
+            text = memchr(text, literal[0], (size_t)(last - text) + 1);
 
-            if (c == EOF)
+            if (text == NULL)
             {
-                return false;
+                break;
             }
-            else if (!match_chr(c, s))
+            else if (memcmp(text, literal, len) == 0)
             {
-                return true;
+                return text;
             }
+
+            ++text;
         }
 
-        return false;
+        return NULL;
     }
-    else
+
+    // Use Horspool algorithm, comparing against character sets.
+
+    const struct element *elems = p->elems;
+
+    while (text <= last)
     {
-        while (s->match_len > 0)
-        {
-            int c = read_edit(s->text_pos++);
+        size_t i = len - 1;
 
-            if (c == EOF || !match_chr(c, s))
+        while (has_chr(elems[i].set, text[i]))
+        {
+            if (i-- == 0)
             {
-                return false;
+                return text;
             }
         }
 
-        return true;
+        text += p->skip[text[len - 1]];
     }
+
+    return NULL;
 }
 
 
 ///
-///  @brief    Deallocate memory for last search.
+///  @brief    Scan contiguous text for first (or last) match of simple search
+///            string, in parallel if there is enough text to make it worth it.
 ///
-///  @returns  Nothing.
+///  @returns  Pointer to match, or NULL if not found.
 ///
 ////////////////////////////////////////////////////////////////////////////////
 
-void reset_search(void)
+static const uchar *scan_text(const struct pattern *p, const uchar *text,
+                              int_t nbytes, bool rightmost)
 {
-    free_mem(&last_search.data);
+
+#if     !defined(NTHREADS)
+
+    if (nbytes >= PARALLEL_MIN && get_threads() > 1)
+    {
+        return scan_parallel(p, text, nbytes, rightmost);
+    }
+
+#endif
+
+    if (rightmost)
+    {
+        return scan_last(p, text, nbytes);
+    }
+    else
+    {
+        return scan_simple(p, text, nbytes);
+    }
 }
 
 
@@ -415,6 +1330,31 @@ bool search_backward(struct search *s)
 {
     assert(s != NULL);                  // Error if no search block
 
+    const struct pattern *p = get_pattern();
+
+    if (p == NULL)
+    {
+        return false;                   // If no previous search string, then fail
+    }
+    else if (p->simple)                 // Can we do a fast search?
+    {
+        int_t pos;
+
+        if (s->text_start < s->text_end ||
+            !find_simple_backward(p, t->dot + s->text_start,
+                                  t->dot + s->text_end, &pos))
+        {
+            s->text_start = s->text_end - 1;
+
+            return false;
+        }
+
+        s->text_start = pos - t->dot - 1;
+        s->text_pos   = pos - t->dot + (int_t)p->nelems;
+
+        return true;
+    }
+
     // Start search at current position and see if we can get a match. If not,
     // decrement position by one, and try again. If we reach the end of the
     // edit buffer without a match, then return failure, otherwise update our
@@ -422,15 +1362,9 @@ bool search_backward(struct search *s)
 
     while (s->text_start >= s->text_end) // Search to beginning of buffer
     {
-        s->text_pos  = s->text_start--; // Start at current position
-        s->match_len = last_search.len; // No. of characters left to match
-
-        if ((s->match_buf = last_search.data) == NULL) // Start of match characters
-        {
-            break;                      // If no previous search string, then fail
-        }
+        s->text_pos = s->text_start--; // Start at current position
 
-        if (match_str(s))
+        if (match_str(s, p))
         {
             return true;
         }
@@ -501,6 +1435,37 @@ bool search_forward(struct search *s)
 {
     assert(s != NULL);                  // Error if no search block
 
+    const struct pattern *p = get_pattern();
+
+    if (p == NULL)
+    {
+        return false;                   // If no previous search string, then fail
+    }
+    else if (p->simple)                 // Can we do a fast search?
+    {
+        int_t last = s->text_end - 1;   // Last position to check
+        int_t pos;
+
+        if (s->type == SEARCH_C)        // ::S only checks current position
+        {
+            last = s->text_start;
+        }
+
+        if (s->text_start >= s->text_end ||
+            !find_simple(p, t->dot + s->text_start, t->dot + last, &pos,
+                         (bool)false))
+        {
+            s->text_start = s->text_end;
+
+            return false;
+        }
+
+        s->text_pos   = pos - t->dot + (int_t)p->nelems;
+        s->text_start = f.ed.movedot ? pos - t->dot + 1 : s->text_pos;
+
+        return true;
+    }
+
     // Start search at current position and see if we can get a match. If not,
     // increment position by one, and try again. If we reach the end of the
     // edit buffer without a match, then return failure, otherwise update our
@@ -508,15 +1473,9 @@ bool search_forward(struct search *s)
 
     while (s->text_start < s->text_end) // Search to end of buffer
     {
-        s->text_pos  = s->text_start++; // Start at current position
-        s->match_len = last_search.len; // No. of characters left to match
+        s->text_pos = s->text_start++; // Start at current position
 
-        if ((s->match_buf = last_search.data) == NULL) // Start of match characters
-        {
-            break;                      // If no previous search string, then fail
-        }
-
-        if (match_str(s))
+        if (match_str(s, p))
         {
             // The following affects how much we move dot on multiple occurrence
             // searches. Normally we skip over the whole matched string when
@@ -681,3 +1640,126 @@ void search_success(struct cmd *cmd)
         store_val(SUCCESS);
     }
 }
+
+
+///
+///  @brief    Set search string element to issue error if we get that far
+///            when matching.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+static void set_error(struct element *elem, int error, int qname)
+{
+    assert(elem != NULL);
+
+    elem->type  = ELEM_ERROR;
+    elem->error = error;
+    elem->qname = qname;
+}
+
+
+///
+///  @brief    Set no. of threads to use for searching large buffers. Any
+///            worker threads are stopped, and will be restarted as needed.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void set_threads(uint n)
+{
+
+#if     !defined(NTHREADS)
+
+    stop_workers();
+
+#endif
+
+    nthreads = (n > THREADS_MAX) ? THREADS_MAX : n;
+}
+
+
+///
+///  @brief    Start worker threads for parallel searches, if not already done.
+///            Workers block all asynchronous signals, so that these are only
+///            handled by the main thread. Synchronous signals such as SIGBUS
+///            are left unblocked, so that they can be handled where they
+///            occur (see bus_handler() in gap_buf.c).
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#if     !defined(NTHREADS)
+
+static void start_workers(void)
+{
+    if (pool.nworkers != 0)
+    {
+        return;
+    }
+
+    sigset_t mask, oldmask;
+
+    (void)sigfillset(&mask);
+    (void)sigdelset(&mask, SIGBUS);     // Can't block synchronous signals
+    (void)sigdelset(&mask, SIGSEGV);
+    (void)pthread_sigmask(SIG_SETMASK, &mask, &oldmask);
+
+    for (uint i = 0; i < nthreads - 1; ++i)
+    {
+        if (pthread_create(&pool.workers[i], NULL, run_worker,
+                           (void *)(uintptr_t)pool.job) != 0)
+        {
+            break;
+        }
+
+        ++pool.nworkers;
+    }
+
+    (void)pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+    if (pool.nworkers == 0)
+    {
+        nthreads = 1;                   // Can't search in parallel
+    }
+}
+
+#endif
+
+
+///
+///  @brief    Stop any worker threads for parallel searches.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#if     !defined(NTHREADS)
+
+static void stop_workers(void)
+{
+    if (pool.nworkers == 0)
+    {
+        return;
+    }
+
+    (void)pthread_mutex_lock(&pool.lock);
+
+    pool.quit = true;
+
+    (void)pthread_cond_broadcast(&pool.start);
+    (void)pthread_mutex_unlock(&pool.lock);
+
+    for (uint i = 0; i < pool.nworkers; ++i)
+    {
+        (void)pthread_join(pool.workers[i], NULL);
+    }
+
+    pool.nworkers = 0;
+    pool.quit     = false;
+}
+
+#endif
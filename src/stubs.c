@@ -242,6 +242,19 @@ void init_keys(void)
 }
 
 
+///
+///  @brief    Mark text in edit buffer that has changed.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void mark_dpy(int_t unused1, int_t unused2, int_t unused3, int unused4)
+{
+    ;                                   // Nothing to do if no display
+}
+
+
 ///
 ///  @brief    Output character to command window.
 ///
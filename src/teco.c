@@ -54,6 +54,7 @@
 #include "estack.h"
 #include "exec.h"
 #include "file.h"
+#include "profile.h"
 #include "qreg.h"
 #include "term.h"
 #include "version.h"
@@ -179,6 +180,8 @@ struct flags f =                    ///< Global flag variables
 
 jmp_buf jump_main;                  ///< longjmp() buffer to reset main loop
 
+jmp_buf *jump_scan = NULL;          ///< longjmp() buffer to catch scan errors
+
 char scratch[PATH_MAX];             ///< General scratch buffer
 
 
@@ -227,6 +230,7 @@ int main(int argc, const char * const argv[])
                     read_cmd();         // Read input from terminal
                 }
 
+                check_edit();           // Check for changed input file
                 init_x();               // Initialize expression stack
 
                 f.e0.exec = true;       // Command is in progress
@@ -258,6 +262,7 @@ int main(int argc, const char * const argv[])
 
         f.e0.exec = false;              // Not executing commands
         f.e0.skip = false;              // Not skipping commands
+        jump_scan = NULL;               // Not catching scan errors
         f.e0.ctrl_t = false;            // No CTRL/T active
 
 #if     !defined(NSTRICT)
@@ -293,10 +298,12 @@ static void exit_teco(void)
 {
     exit_dpy();                         // Disable display first (if active)
     exit_term();                        // Restore terminal settings next
+    exit_prof();                        // Type profile (if requested)
     exit_files();                       // Close any open files
 
     reset_indirect();                   // Deallocate memory for EI commands
     reset_search();                     // Deallocate memory for last search
+    reset_tokens();                     // Deallocate memory for command tokens
 
     exit_map();                         // Deallocate memory for map commands
     exit_error();                       // Deallocate memory for errors
@@ -306,6 +313,7 @@ static void exit_teco(void)
     exit_x();                           // Deallocate memory for expression stack
     exit_tbuf();                        // Deallocate memory for terminal buffer
     exit_mem();                         // Deallocate memory blocks
+    flush_term();                       // Write any remaining output
     exit_EG();                          // Check for possible system command
 }
 
@@ -403,4 +411,5 @@ static void reset_teco(void)
     reset_cbuf();                       // Reset the input buffer
     reset_qreg();                       // Free up local Q-register storage
     reset_macro();                      // Reset macro stack
+    reset_tokens();                     // Discard compiled command tokens
 }
@@ -298,6 +298,8 @@ int getc_term(bool wait)
 
     if (wait)
     {
+        flush_term();                   // Make sure user sees all output
+
         c = read_wait();
     }
     else if ((c = get_nowait()) == EOF)
@@ -45,6 +45,19 @@
 
 int term_pos = 0;
 
+#define OUT_MAX     (KB * 8)            ///< Size of terminal output buffer
+
+///  @var    out
+///
+///  @brief  Terminal output is collected here and written with a single call,
+///          rather than a character at a time, since stdout is not buffered.
+
+static struct
+{
+    uint len;                           ///< No. of bytes in buffer
+    char data[OUT_MAX];                 ///< Buffered output
+} out = { .len = 0 };
+
 const char *table_8bit[] =          ///< 8-bit characters
 {
     "[80]",  "[81]",  "[82]",  "[83]",  "[84]",  "[85]",  "[86]",  "[87]",
@@ -178,6 +191,33 @@ void echo_in(int c)
 }
 
 
+///
+///  @brief    Write any buffered output to the terminal, and flush the log
+///            file. This is called before we wait for input, when we print a
+///            prompt, when we reset the terminal, and when the buffer is full.
+///
+///  @returns  Nothing.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+void flush_term(void)
+{
+    if (out.len != 0)
+    {
+        fwrite(out.data, 1uL, (size_t)out.len, stdout);
+
+        out.len = 0;
+    }
+
+    FILE *fp = ofiles[OFILE_LOG].fp;
+
+    if (fp != NULL)
+    {
+        fflush(fp);
+    }
+}
+
+
 ///
 ///  @brief    Print alert message. Typically used just before exiting TECO
 ///            because of a received signal.
@@ -300,6 +340,8 @@ void print_prompt(void)
     }
 
     tprint("%s", teco_prompt);
+
+    flush_term();
 }
 
 
@@ -366,7 +408,12 @@ static void term_out(int c)
     }
     else if (!f.et.truncate || term_pos < w.width)
     {
-        fputc(c, stdout);
+        out.data[out.len++] = (char)c;
+
+        if (out.len == OUT_MAX || f.ed.nobuffer)
+        {
+            flush_term();
+        }
     }
 }
 
@@ -273,6 +273,8 @@ void init_term(void)
 
 void reset_term(void)
 {
+    flush_term();                       // Write any pending output
+
     if (term_active)
     {
         term_active = false;
@@ -113,22 +113,38 @@ static void exec_type(int_t m, int_t n)
 {
     int last = EOF;
 
-    for (int_t i = m; i < n; ++i)
+    // Type the text a contiguous piece at a time, rather than calling
+    // read_edit() for each character.
+
+    for (int_t pos = t->dot + m; pos < t->dot + n; )
     {
-        int c = read_edit(i);
+        int_t nbytes;
+        const uchar *text = span_edit(pos, &nbytes);
 
-        if (c == EOF)
+        if (nbytes == 0)
         {
             break;
         }
-        else if (f.e3.CR_type && c == LF && last != CR)
+        else if (nbytes > t->dot + n - pos)
         {
-            type_out(CR);
+            nbytes = t->dot + n - pos;
         }
 
-        type_out(c);
+        for (int_t i = 0; i < nbytes; ++i)
+        {
+            int c = text[i];
+
+            if (f.e3.CR_type && c == LF && last != CR)
+            {
+                type_out(CR);
+            }
+
+            type_out(c);
+
+            last = c;
+        }
 
-        last = c;
+        pos += nbytes;
     }
 }
 
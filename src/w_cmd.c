@@ -70,6 +70,7 @@ struct watch w =
     },
     .maxline  = DEFAULT_MAXLINE,        // 11:W
     .status   = 0,                      // 12:W
+    .painted  = 0,                      // 13:W
     .botdot   = 0,                      // FZ
 };
 
@@ -174,6 +175,9 @@ static int_t get_w(int_t n)
         case 12:                        // Width of status window (or 0 if none)
             return w.status;
 
+        case 13:                        // No. of chrs. painted in edit window
+            return w.painted;
+
         default:
             throw(E_ARG);               // n:W is out of range
     }
@@ -390,6 +394,11 @@ static void set_w(int_t m, int_t n)
 
             break;
 
+        case 13:
+            w.painted = m;
+
+            break;
+
         default:
             throw(E_ARG);               // m,n:W is out of range
     }
@@ -107,16 +107,25 @@ void exec_X(struct cmd *cmd)
         delete_qtext(cmd->qindex);
     }
 
-    for (int_t i = m; i < n; ++i)
+    // Copy text a piece at a time, since the edit buffer may not be contiguous.
+
+    for (int_t pos = t->dot + m; pos < t->dot + n; )
     {
-        int c = read_edit(i);
+        int_t nbytes;
+        const uchar *text = span_edit(pos, &nbytes);
 
-        if (c == EOF)
+        if (nbytes == 0)
         {
             break;
         }
+        else if (nbytes > t->dot + n - pos)
+        {
+            nbytes = t->dot + n - pos;
+        }
+
+        append_qtext(cmd->qindex, (const char *)text, (uint_t)nbytes);
 
-        append_qchr(cmd->qindex, c);
+        pos += nbytes;
     }
 }
 
@@ -35,6 +35,7 @@
 #include "exec.h"
 #include "file.h"
 #include "page.h"
+#include "profile.h"
 
 
 ///
@@ -135,6 +136,10 @@ bool next_yank(void)
 
     (void)append_edit(ifile, (bool)false); // Read all we can
 
+    count_prof(read, t->Z);
+
+    read_ahead(ifile, (uint_t)t->Z);    // Start reading following page
+
     if (t->Z != 0)
     {
         return true;
@@ -0,0 +1,722 @@
+#!/usr/bin/perl
+
+#
+#  bench.pl - Run a suite of TECO performance benchmarks.
+#
+#  @copyright 2023 Franklin P. Johnston / Nowwith Treble Software
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a
+#  copy of this software and associated documentation files (the "Software"),
+#  to deal in the Software without restriction, including without limitation
+#  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+#  and/or sell copies of the Software, and to permit persons to whom the
+#  Software is furnished to do so, subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in
+#  all copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+#  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+#  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIA-
+#  BILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+#  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+#  THE SOFTWARE.
+#
+#  Usage: bench.pl [--size=MB]... [--runs=n] [--test=name]... [--calls=n]
+#                  [--edits=n] [--steps=n] [--[no]allocs] [--output=file]
+#                  [--variant=name]... [--teco=path]...
+#
+#  Creates test files of each specified size (1 MB, 64 MB, and 1 GB by
+#  default; use --size=4096 to go up to 4 GB) with LF line endings (lf), CR/LF
+#  line endings (crlf), form feeds every 50 lines (ff), 64 KB lines (long),
+#  and lines of no more than 8 bytes (short), and then times how long each
+#  TECO executable takes to do the following:
+#
+#      load     Read each file all the way through with ER and Y.
+#      type     Type out the buffer with HT.
+#      search   Search for every line with S.
+#      replace  Replace one word with a longer one on every line, with FS.
+#      lines    Walk through the buffer one line at a time with L.
+#      hxq      Copy the buffer to a Q-register with HXq.
+#      qchar    Build a Q-register the size of the file one character at a
+#               time, with n:^Uq.
+#      qstring  Build a Q-register the size of the file from 128-byte strings,
+#               with :^Uq.
+#      qlines   Build a Q-register from the lines in the buffer, with :Xq.
+#      scatter  Replace 5 bytes at each of n pseudo-random positions.
+#      ends     Insert a line alternately at the start and end of the buffer
+#               n times, so that each edit is as far as possible from the
+#               previous one.
+#      count    Count lines back from n pseudo-random positions with -1:L.
+#      nsearch  Search for every line with N, paging through the file.
+#      cold     Search for a string that isn't there with _, paging through
+#               the file, after dropping the file from the page cache, so that
+#               reading each page has to wait for the disk unless it was read
+#               ahead while the previous page was being searched.
+#      page     Copy the file page by page with ER, EW, Y, and EX.
+#      macro    Make nested macro calls with Mq, 50 levels deep.
+#      mq       Call a macro that does nothing in a loop, with Mq (which has
+#               to make a new set of local Q-registers).
+#      colonmq  Call a macro that does nothing in a loop, with :Mq.
+#      display  Move down the edit window one line at a time with L in
+#               display mode, with commands typed on a pseudo-terminal.
+#
+#  The time to start TECO and read in a file (if any) is subtracted from the
+#  other tests. Results are reported on stderr as they are made, and then as
+#  JSON on stdout (or in the file specified with --output), including MB/s,
+#  operations/s, the peak resident set size, and the no. of memory blocks
+#  allocated.
+#
+#  Executables to compare may be specified with --teco, or built from the
+#  current source tree with --variant, which takes one of the names below (or
+#  'all', which is the default if neither option is used). Each variant is
+#  built with 'make fast' in a temporary copy of the tree, together with a
+#  'make debug=3' build that is used to count memory allocations, unless
+#  --noallocs is specified.
+#
+#      gap      buffer=gap (the default build)
+#      rope     buffer=rope
+#      std      paging=std
+#      file     paging=file
+#      int64    int=64
+#
+#  The display test requires a TECO built with display mode and the script(1)
+#  command, and does not report the peak RSS. Elsewhere, the peak RSS is read
+#  from /proc, and is not reported if that is not available.
+#
+################################################################################
+
+use strict;
+use warnings;
+use version; our $VERSION = '1.0.0';
+
+use Carp;
+use English qw( -no_match_vars );
+use File::Basename;
+use File::Spec;
+use File::Temp qw( tempdir );
+use Getopt::Long;
+use IO::Handle;
+use JSON::PP;
+use POSIX qw( :sys_wait_h );
+use Time::HiRes qw( sleep time );
+
+my @sizes    = ();                      # File sizes in MB
+my $runs     = 3;                       # No. of runs (best time is used)
+my $calls    = 20_000;                  # No. of outer macro calls
+my $edits    = 2_000;                   # No. of edits for edit tests
+my $steps    = 1_000;                   # No. of display steps
+my $allocs   = 1;                       # Count memory allocations
+my $output   = q{};                     # JSON output file
+my @names    = ();                      # Tests to run
+my @variants = ();
+my @tecos    = ();
+
+GetOptions(
+    'size=i'    => \@sizes,
+    'runs=i'    => \$runs,
+    'calls=i'   => \$calls,
+    'edits=i'   => \$edits,
+    'steps=i'   => \$steps,
+    'allocs!'   => \$allocs,
+    'output=s'  => \$output,
+    'test=s'    => \@names,
+    'variant=s' => \@variants,
+    'teco=s'    => \@tecos,
+) or croak 'Invalid option';
+
+@sizes = ( 1, 64, 1024 ) if !@sizes;
+
+my %options = (
+    'gap'   => 'buffer=gap',
+    'rope'  => 'buffer=rope',
+    'std'   => 'paging=std',
+    'file'  => 'paging=file',
+    'int64' => 'int=64',
+);
+
+my @order = qw( gap rope std file int64 );
+
+@variants = @order if ( !@tecos && !@variants ) || grep { $_ eq 'all' } @variants;
+
+foreach my $variant (@variants)
+{
+    croak "Invalid variant: $variant" if !exists $options{$variant};
+}
+
+my $depth = 50;                         # Macro nesting depth (max. is 64)
+my $dir   = tempdir( CLEANUP => 1 );
+my $MB    = 1024 * 1024;
+
+# Each test has a name, the corpora it uses, a command to set up the test
+# (whose time is subtracted), the command to time, and the units measured
+# (bytes for MB/s, and lines, pages, edits, calls, or steps for operations/s).
+# In the commands, %f is replaced with the test file, %o with an output file,
+# %b with the size of the test file, %e with the no. of edits, and %c with the
+# no. of macro calls. Tests that write an output file end with EX; the others
+# are followed by HK EX, since EX would otherwise fail without an output file.
+#
+# Pseudo-random positions for the edit tests are generated in Q-register R
+# with a linear congruential generator, and scaled to the size of the buffer.
+
+my $random = 'QR*75+74UA QA-(QA/65537*65537)UR Z/65537*QR';
+my $string = 'x' x 128;
+
+my @tests = (
+    [ 'load',    [qw( lf crlf ff long short )], q{}, 'ER%f\e <:Y;>', 'bytes' ],
+    [ 'type',    [qw( lf )], 'ER%f\e Y', 'HT', 'bytes' ],
+    [ 'search',  [qw( lf crlf )], 'ER%f\e Y', 'J <:@S/Line/;>', 'lines' ],
+    [ 'replace', [qw( lf )], 'ER%f\e Y', 'J <:@FS/Line/Record/;>', 'lines' ],
+    [ 'lines',   [qw( lf long short )], 'ER%f\e Y', 'J <.-Z; L>', 'lines' ],
+    [ 'hxq',     [qw( lf )], 'ER%f\e Y', 'HXA', 'bytes' ],
+    [ 'qchar',   [qw( lf )], q{}, '%b<65:^UA\e>', 'bytes' ],
+    [ 'qstring', [qw( lf )], q{}, "%b/128<\@:^UA/$string/>", 'bytes' ],
+    [ 'qlines',  [qw( lf )], 'ER%f\e Y', 'J <.-Z; :XA L>', 'bytes' ],
+    [ 'scatter', [qw( lf )], 'ER%f\e Y', "1UR %e<$random J 5D \@I/12345/>", 'edits' ],
+    [ 'ends',    [qw( lf )], 'ER%f\e Y', "%e<J \@I/xxxx\n/ ZJ \@I/yyyy\n/>", 'edits' ],
+    [ 'count',   [qw( lf )], 'ER%f\e Y', "1UR %e<$random J -1:L UB>", 'edits' ],
+    [ 'nsearch', [qw( ff )], 'ER%f\e Y', 'EW%o\e <:@N/Line/;> EX', 'lines' ],
+    [ 'cold',    [qw( ff )], q{}, 'ER%f\e Y :@_/Not found/', 'bytes' ],
+    [ 'page',    [qw( ff )], q{}, 'ER%f\e EW%o\e Y EX', 'pages' ],
+    [ 'macro',   [undef], q{}, q{}, 'calls' ],
+    [ 'mq',      [undef], q{}, '@^UA/ / %c<MA>', 'calls' ],
+    [ 'colonmq', [undef], q{}, '@^UA/ / %c<:MA>', 'calls' ],
+    [ 'display', [qw( lf long )], 'ER%f\e Y', q{}, 'steps' ],
+);
+
+if (@names)
+{
+    my %valid = map { $_->[0] => 1 } @tests;
+
+    foreach my $name (@names)
+    {
+        croak "Invalid test: $name" if !$valid{$name};
+    }
+
+    my %wanted = map { $_ => 1 } @names;
+
+    @tests = grep { $wanted{ $_->[0] } } @tests;
+}
+
+my $script = find_path('script');
+my @results;
+
+my @builds = map { [ $_, $_, undef ] } @tecos;
+
+push @builds, build_variant($_) foreach @variants;
+
+foreach my $size (@sizes)
+{
+    my %corpora = make_corpora($size);
+
+    printf {*STDERR} "%-16s %-8s %-6s %6s %10s %12s %10s %10s\n", 'TECO',
+        'Test', 'File', 'MB', 'MB/s', 'Ops/s', 'RSS (KB)', 'Allocs';
+
+    foreach my $build (@builds)
+    {
+        my ( $name, $teco, $counter ) = @{$build};
+
+        croak "Can't find TECO executable: $teco" if !-x $teco;
+
+        my ($startup) = time_teco( $teco, q{} );
+
+        foreach my $test (@tests)
+        {
+            foreach my $type ( @{ $test->[1] } )
+            {
+                my $corpus = defined $type ? $corpora{$type} : undef;
+
+                push @results, run_test( $name, $teco, $counter, $test, $corpus,
+                                         $startup );
+            }
+        }
+    }
+}
+
+my $json = JSON::PP->new->canonical->pretty->encode(
+    {
+        version => $VERSION,
+        runs    => $runs,
+        sizes   => \@sizes,
+        results => \@results,
+    }
+);
+
+if ($output)
+{
+    open my $fh, '>', $output or croak "Can't create $output: $OS_ERROR";
+
+    print {$fh} $json;
+
+    close $fh;
+}
+else
+{
+    print $json;
+}
+
+exit 0;
+
+
+# Build a variant of TECO from a copy of the source tree, and return its name
+# along with the paths of the timed and counting executables.
+
+sub build_variant
+{
+    my ($variant) = @_;
+
+    my $base = dirname( dirname( dirname( File::Spec->rel2abs(__FILE__) ) ) );
+    my $tree = "$dir/tree";
+    my $opts = $options{$variant};
+
+    if ( !-d $tree )
+    {
+        mkdir $tree or croak "Can't create $tree: $OS_ERROR";
+
+        foreach my $path (qw( Makefile etc include lib src ))
+        {
+            system( 'cp', '-R', "$base/$path", $tree ) == 0
+                or croak "Can't copy $base/$path";
+        }
+    }
+
+    print {*STDERR} "Building $variant ($opts)...\n";
+
+    my $teco = "$dir/teco-$variant";
+
+    make_teco( $tree, "fast $opts", $teco );
+
+    my $counter;
+
+    if ($allocs)
+    {
+        $counter = "$dir/teco-$variant-allocs";
+
+        make_teco( $tree, "debug=3 $opts teco", $counter );
+    }
+
+    return [ $variant, $teco, $counter ];
+}
+
+
+# Count the memory blocks allocated by a TECO built with debug=3, which prints
+# the total when it exits.
+
+sub count_allocs
+{
+    my ( $counter, $cmdfile ) = @_;
+
+    open my $fh, q{-|}, "$counter -n --mung=$cmdfile 2>&1"
+        or croak "Can't run $counter: $OS_ERROR";
+
+    my $count;
+
+    while ( my $line = <$fh> )
+    {
+        $count = $1 if $line =~ /exit_mem\(\):\s(\d+)\sblocks/msx;
+    }
+
+    close $fh;
+
+    return $count;
+}
+
+
+# Drop a file from the page cache, after first making sure that none of it
+# still has to be written (since only clean pages can be dropped).
+
+sub drop_cache
+{
+    my ($file) = @_;
+
+    open my $fh, '<', $file or croak "Can't open $file: $OS_ERROR";
+
+    $fh->sync or croak "Can't sync $file: $OS_ERROR";
+
+    close $fh;
+
+    system( 'dd', "if=$file", 'iflag=nocache', 'count=0', 'status=none' ) == 0
+        or croak "Can't drop $file from page cache";
+
+    return;
+}
+
+
+# Find a command in the user's path.
+
+sub find_path
+{
+    my ($cmd) = @_;
+
+    foreach my $path ( File::Spec->path )
+    {
+        return "$path/$cmd" if -x "$path/$cmd";
+    }
+
+    return;
+}
+
+
+# Create one test file of each type for the specified size. Lines are created
+# in 1 MB blocks, which are then written repeatedly.
+
+sub make_corpora
+{
+    my ($size) = @_;
+
+    my %corpora;
+
+    print {*STDERR} "Creating $size MB test files...\n";
+
+    my @lines = map { sprintf 'Line %u: %s', $_, 'x' x ( $_ % 80 ) } 1 .. 50;
+
+    my %types = (
+        lf    => [ map {"$_\n"} @lines ],
+        crlf  => [ map {"$_\r\n"} @lines ],
+        ff    => [ ( map {"$_\n"} @lines[ 0 .. 48 ] ), "$lines[49]\f" ],
+        long  => [ 'Line ' . ( 'x' x ( 65_536 - 6 ) ) . "\n" ],
+        short => [ map { 'x' x $_ . "\n" } 0 .. 7 ],
+    );
+
+    foreach my $type ( sort keys %types )
+    {
+        my $text  = join q{}, @{ $types{$type} };
+        my $count = @{ $types{$type} };
+        my $block = $text x ( $MB / length $text );
+        my $file  = "$dir/$type.txt";
+
+        $count *= int( $MB / length $text );
+
+        open my $fh, '>', $file or croak "Can't create $file: $OS_ERROR";
+
+        print {$fh} $block foreach 1 .. $size;
+
+        close $fh;
+
+        my $pages = ( $type eq 'ff' ) ? $count * $size / 50 : 1;
+
+        $corpora{$type} = {
+            type  => $type,
+            file  => $file,
+            bytes => $size * length $block,
+            lines => $count * $size,
+            pages => $pages,
+        };
+    }
+
+    return %corpora;
+}
+
+
+# Build TECO in the copy of the source tree, and save the executable.
+
+sub make_teco
+{
+    my ( $tree, $opts, $teco ) = @_;
+
+    system("make -s -C $tree clean >/dev/null 2>&1") == 0
+        or croak "Can't clean $tree";
+
+    system("make -s -C $tree $opts >/dev/null 2>&1") == 0
+        or croak "Can't build TECO with 'make $opts'";
+
+    system( 'cp', "$tree/bin/teco", $teco ) == 0 or croak "Can't copy TECO";
+
+    return;
+}
+
+
+# Run one test on one corpus, and return a hash of the results.
+
+sub run_test
+{
+    my ( $name, $teco, $counter, $test, $corpus, $startup ) = @_;
+    my ( $testname, undef, $setup, $cmd, $units ) = @{$test};
+
+    my $out = "$dir/out.txt";
+    my %result = (
+        teco   => $name,
+        test   => $testname,
+        corpus => $corpus ? $corpus->{type} : undef,
+        bytes  => $corpus ? $corpus->{bytes} : undef,
+    );
+
+    my %args = (
+        e => $edits,
+        c => $calls * $depth,
+    );
+
+    if ($corpus)
+    {
+        $args{f} = $corpus->{file};
+        $args{o} = $out;
+        $args{b} = $corpus->{bytes};
+    }
+
+    foreach my $str ( $setup, $cmd )
+    {
+        $str =~ s{%([bcefo])}{$args{$1} // "%$1"}gemsx;
+    }
+
+    my ( $overhead, $secs, $rss, $ok );
+
+    ($overhead) = $setup ? time_teco( $teco, $setup ) : ($startup);
+
+    if ( $testname eq 'macro' )
+    {
+        $cmd = "\@^UA/QB-1UB QB\"G MA'/ $calls<${depth}UB MA>";
+    }
+
+    if ( $testname eq 'display' )
+    {
+        ( $secs, $rss, $ok ) = time_display( $teco, $setup );
+    }
+    elsif ( $testname eq 'cold' )
+    {
+        ( $secs, $rss, $ok ) = time_teco( $teco, "$setup $cmd", $corpus->{file} );
+    }
+    else
+    {
+        ( $secs, $rss, $ok ) = time_teco( $teco, "$setup $cmd" );
+    }
+
+    if ( !defined $secs )
+    {
+        $result{status} = 'skipped';
+    }
+    elsif ( !$ok )
+    {
+        $result{status} = 'failed';
+    }
+    else
+    {
+        $secs -= $overhead;
+        $secs = 1e-6 if $secs <= 0;
+
+        my %ops = (
+            lines => $corpus ? $corpus->{lines} : 0,
+            pages => $corpus ? $corpus->{pages} : 0,
+            edits => $edits,
+            calls => $calls * $depth,
+            steps => $steps,
+        );
+
+        $result{status}  = 'ok';
+        $result{seconds} = 0 + sprintf '%.6f', $secs;
+
+        if ( $corpus && $units eq 'bytes' )
+        {
+            $result{mb_per_s} = 0 + sprintf '%.1f', $corpus->{bytes} / $MB / $secs;
+        }
+        else
+        {
+            $result{ops}       = $ops{$units};
+            $result{ops_per_s} = 0 + sprintf '%.1f', $ops{$units} / $secs;
+        }
+
+        $result{peak_rss_kb} = $rss;
+
+        if ( $counter && $testname ne 'display' )
+        {
+            my $count = count_allocs( $counter, write_cmd("$setup $cmd") );
+
+            $result{allocs} = 0 + $count if defined $count;
+        }
+    }
+
+    printf {*STDERR} "%-16s %-8s %-6s %6s %10s %12s %10s %10s\n", $name,
+        $testname, $result{corpus} // q{-},
+        $corpus ? sprintf( '%.0f', $corpus->{bytes} / $MB ) : q{-},
+        $result{mb_per_s} // q{-},
+        $result{ops_per_s} // ( $result{status} eq 'ok' ? q{-} : $result{status} ),
+        $result{peak_rss_kb} // q{-}, $result{allocs} // q{-};
+
+    return \%result;
+}
+
+
+# Time TECO moving through a file in display mode. Commands are sent to TECO
+# on a pseudo-terminal created by script(1), in stages so that none of them
+# arrive while the terminal is being reset. The accent grave is used as a
+# delimiter once display mode is active, so that ESCape doesn't start an
+# escape sequence.
+
+sub time_display
+{
+    my ( $teco, $setup ) = @_;
+
+    return if !$script;
+
+    ( my $load = $setup ) =~ s/\\e/`/msx;
+
+    my @stages = ( "-1W 10,7:W\e\e", "$load``" . ( 'L``' x $steps ) . 'HKEX``' );
+    my $cmd    = "stty rows 40 cols 120; exec $teco -n";
+    my $screen = "$dir/screen.txt";
+
+    my ( $best, $ok );
+
+    for ( 1 .. $runs )
+    {
+        pipe my $reader, my $writer or croak "Can't create pipe: $OS_ERROR";
+
+        my $pid = fork // croak "Can't fork: $OS_ERROR";
+
+        if ( $pid == 0 )
+        {
+            close $writer;
+
+            open STDIN,  '<&', $reader or croak "Can't redirect stdin: $OS_ERROR";
+            open STDOUT, '>',  $screen or croak "Can't redirect stdout: $OS_ERROR";
+
+            exec $script, '-qec', $cmd, '/dev/null'
+                or croak "Can't run $script: $OS_ERROR";
+        }
+
+        close $reader;
+
+        $writer->autoflush(1);
+
+        sleep 0.5;
+        print {$writer} $stages[0];
+        sleep 0.5;
+
+        my $start = time;
+
+        print {$writer} $stages[1];
+
+        local $SIG{ALRM} = sub { kill 'KILL', $pid };
+
+        alarm 600;
+
+        waitpid $pid, 0;
+
+        alarm 0;
+
+        my $secs = time - $start;
+
+        close $writer;
+
+        open my $fh, '<', $screen or croak "Can't open $screen: $OS_ERROR";
+
+        local $RS = undef;
+
+        my $text = <$fh>;
+
+        close $fh;
+
+        # Skip the test if TECO was built without display mode, in which case
+        # -1W is accepted but never sends any escape sequences.
+
+        return if $text !~ /\e\[/msx;
+
+        $ok = ( $CHILD_ERROR == 0 && $text !~ /[?][[:upper:]]{3}\s/msx );
+
+        $best = $secs if !defined $best || $secs < $best;
+    }
+
+    return ( $best, undef, $ok );
+}
+
+
+# Time TECO executing a command, and return the best time, along with the
+# peak RSS and whether TECO exited normally. The peak RSS is measured on an
+# extra run, since it has to be polled from /proc while TECO is running (its
+# ru_maxrss would include that of this script, which was inherited by fork()).
+# If a file is specified, it is dropped from the page cache before each run.
+
+sub time_teco
+{
+    my ( $teco, $cmd, $file ) = @_;
+
+    my $cmdfile = write_cmd($cmd);
+    my ( $best, $rss, $ok );
+
+    for ( 1 .. $runs )
+    {
+        drop_cache($file) if defined $file;
+
+        my $start = time;
+        my $pid   = start_teco( $teco, $cmdfile );
+
+        waitpid $pid, 0;
+
+        my $secs = time - $start;
+
+        $ok = ( $CHILD_ERROR == 0 );
+
+        $best = $secs if !defined $best || $secs < $best;
+    }
+
+    if ( -r '/proc/self/status' )
+    {
+        my $name = substr basename($teco), 0, 15;
+        my $pid  = start_teco( $teco, $cmdfile );
+
+        while ( waitpid( $pid, WNOHANG ) == 0 )
+        {
+            if ( open my $fh, '<', "/proc/$pid/status" )
+            {
+                local $RS = undef;
+
+                my $status = <$fh>;
+
+                close $fh;
+
+                # Skip anything read before the exec().
+
+                if ( $status =~ /^Name:\s+\Q$name\E$/msx
+                     && $status =~ /^VmHWM:\s+(\d+)/msx )
+                {
+                    $rss = $1 if !defined $rss || $1 > $rss;
+                }
+            }
+
+            sleep 0.001;
+        }
+
+        $rss += 0 if defined $rss;
+    }
+
+    return ( $best, $rss, $ok );
+}
+
+
+# Start TECO executing a command file, and return its process ID.
+
+sub start_teco
+{
+    my ( $teco, $cmdfile ) = @_;
+
+    my $pid = fork // croak "Can't fork: $OS_ERROR";
+
+    if ( $pid == 0 )
+    {
+        open STDOUT, '>', '/dev/null' or croak "Can't redirect stdout";
+        open STDERR, '>', '/dev/null' or croak "Can't redirect stderr";
+
+        exec $teco, '-n', "--mung=$cmdfile" or croak "Can't run $teco";
+    }
+
+    return $pid;
+}
+
+
+# Write TECO commands to a file, and return its name.
+
+sub write_cmd
+{
+    my ($cmd) = @_;
+
+    my $cmdfile = "$dir/cmd.tec";
+
+    $cmd =~ s/\\e/\e/gmsx;
+
+    open my $fh, '>', $cmdfile or croak "Can't create $cmdfile: $OS_ERROR";
+
+    print {$fh} "1,0E3 $cmd HK EX";
+
+    close $fh;
+
+    return $cmdfile;
+}